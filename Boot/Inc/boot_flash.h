@@ -0,0 +1,70 @@
+/**
+  ******************************************************************************
+  * @file    boot_flash.h
+  * @brief   Page writer of the bootloader, shared by the DFU and the SysEx
+  *          update functions.
+  *
+  *          An update session writes the application region one page at a
+  *          time, in order. Pages are received into one of two RAM slots
+  *          from the USB interrupt and queued with BOOT_Flash_Commit(); the
+  *          main loop erases and programs the oldest queued page while the
+  *          next one arrives. Erase and programming are waited for from
+  *          SRAM, polling USB through BOOT_Flash_BusyCallback(), so the
+  *          next page keeps arriving while the flash is busy. The writer
+  *          keeps a CRC of everything queued, and BOOT_Flash_Finish()
+  *          checks the written image against it before committing the
+  *          trailer (boot.h). The trailer is cleared with the first written
+  *          page, so an interrupted session leaves no bootable image
+  *          behind.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOOT_FLASH_H
+#define __BOOT_FLASH_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "boot.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define BOOT_FLASH_PAGE                 1024U
+#define BOOT_FLASH_SLOTS                2U
+#define BOOT_FLASH_PAGES                ((BOOT_APP_MAX + BOOT_FLASH_PAGE - 1U) / BOOT_FLASH_PAGE)
+
+/* Session owners */
+#define BOOT_FLASH_NONE                 0U
+#define BOOT_FLASH_DFU                  1U
+#define BOOT_FLASH_SYSEX                2U
+
+/* Status, same values as the DFU bStatus codes */
+#define BOOT_FLASH_OK                   0x00U
+#define BOOT_FLASH_ERR_WRITE            0x03U
+#define BOOT_FLASH_ERR_ERASE            0x04U
+#define BOOT_FLASH_ERR_VERIFY           0x07U
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t  BOOT_Flash_Begin(uint32_t owner);
+uint32_t  BOOT_Flash_Owner(void);
+uint32_t *BOOT_Flash_Slot(void);
+void      BOOT_Flash_Commit(uint32_t page, uint32_t len);
+uint32_t  BOOT_Flash_Free(void);
+uint32_t  BOOT_Flash_Queued(void);
+uint8_t   BOOT_Flash_Status(void);
+uint32_t  BOOT_Flash_Crc(void);
+void      BOOT_Flash_Poll(void);
+uint8_t   BOOT_Flash_Finish(void);
+void      BOOT_Flash_End(void);
+
+/* Provided by the user of the writer: polls USB while the flash is busy,
+   with interrupts masked. Must be __RAM_FUNC and call only RAM code. */
+void      BOOT_Flash_BusyCallback(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOT_FLASH_H */
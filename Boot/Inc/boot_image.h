@@ -0,0 +1,28 @@
+/**
+  ******************************************************************************
+  * @file    boot_image.h
+  * @brief   Application image checks of the bootloader, on the CRC service.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOOT_IMAGE_H
+#define __BOOT_IMAGE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "boot.h"
+#include "crc32.h"
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t BOOT_Blank(uint32_t addr, uint32_t n);
+uint32_t BOOT_ImageValid(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOT_IMAGE_H */
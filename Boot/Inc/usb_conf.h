@@ -0,0 +1,50 @@
+/**
+  ******************************************************************************
+  * @file    usb_conf.h
+  * @brief   USB device identity, interfaces and endpoints of the bootloader.
+  *
+  *          Shadows Inc/usb_conf.h for the boot image, which builds the
+  *          application's device core (usb_device.c) and packet memory
+  *          allocator (usb_pma.c) against this file instead.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_CONF_H
+#define __USB_CONF_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* ########################## Identity ###################################### */
+#define USBD_VID                        0x1209U
+#define USBD_PID                        0x0001U
+#define USBD_BCD_DEVICE                 0x0100U
+#define USBD_MANUFACTURER_STRING        "FluorumLabs"
+#define USBD_PRODUCT_STRING             "F1042 MIDI Interface (DFU)"
+
+/* ########################## Interfaces #################################### */
+#define USBD_ITF_DFU                    0U
+#define USBD_ITF_AUDIO_CONTROL          1U
+#define USBD_ITF_MIDI_STREAMING         2U
+#define USBD_ITF_COUNT                  3U
+
+/* ########################## Endpoints ##################################### */
+/* SysEx update (usbd_sysex.c); DFU runs on the control endpoint only */
+#define SYSEX_EP_OUT                    0x01U
+#define SYSEX_EP_IN                     0x81U
+#define SYSEX_EP_SIZE                   64U
+
+/* ########################## Packet memory ################################# */
+#define USBD_EP_LIST(X)                                                        \
+  X(0x00U,          PCD_EP_TYPE_CTRL, USBD_EP0_SIZE)                           \
+  X(0x80U,          PCD_EP_TYPE_CTRL, USBD_EP0_SIZE)                           \
+  X(SYSEX_EP_OUT,   PCD_EP_TYPE_BULK, SYSEX_EP_SIZE)                           \
+  X(SYSEX_EP_IN,    PCD_EP_TYPE_BULK, SYSEX_EP_SIZE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_CONF_H */
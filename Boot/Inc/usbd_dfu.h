@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    usbd_dfu.h
+  * @brief   USB DFU 1.1 function of the bootloader, download only.
+  *
+  *          Block n of a download is page n of the application region, so
+  *          wTransferSize is one flash page and every block is erased and
+  *          programmed as a whole. Blocks are received into one of the two
+  *          buffers of the page writer (boot_flash.h) while the main loop
+  *          writes the other one: GETSTATUS after a block answers
+  *          dfuDNLOAD-IDLE with a zero poll timeout as soon as a buffer is
+  *          free, and is simply held off (NAK) while both are full, so the host sends block n+1 while page n is being
+  *          erased and programmed and never sleeps on a guessed timeout.
+  *
+  *          The end of the download is held off the same way until every
+  *          page is written, the image CRC is checked against what was
+  *          received and the trailer (boot.h) is programmed; the device
+  *          then restarts into the new image on its own (bitWillDetach).
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_DFU_H
+#define __USBD_DFU_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+#include "boot_flash.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_DFU_XFER_SIZE              BOOT_FLASH_PAGE
+
+/* Requests */
+#define DFU_REQ_DETACH                  0x00U
+#define DFU_REQ_DNLOAD                  0x01U
+#define DFU_REQ_UPLOAD                  0x02U
+#define DFU_REQ_GETSTATUS               0x03U
+#define DFU_REQ_CLRSTATUS               0x04U
+#define DFU_REQ_GETSTATE                0x05U
+#define DFU_REQ_ABORT                   0x06U
+
+/* bState */
+#define DFU_STATE_IDLE                  2U
+#define DFU_STATE_DNLOAD_SYNC           3U
+#define DFU_STATE_DNLOAD_IDLE           5U
+#define DFU_STATE_MANIFEST_SYNC         6U
+#define DFU_STATE_MANIFEST_WAIT_RESET   8U
+#define DFU_STATE_ERROR                 10U
+
+/* bStatus */
+#define DFU_STATUS_OK                   0x00U
+#define DFU_STATUS_ERR_WRITE            0x03U
+#define DFU_STATUS_ERR_ERASE            0x04U
+#define DFU_STATUS_ERR_VERIFY           0x07U
+#define DFU_STATUS_ERR_ADDRESS          0x08U
+#define DFU_STATUS_ERR_NOTDONE          0x09U
+#define DFU_STATUS_ERR_UNKNOWN          0x0EU    /*!< SysEx update running */
+#define DFU_STATUS_ERR_STALLEDPKT       0x0FU
+
+/* Exported variables --------------------------------------------------------*/
+extern const USBD_ClassTypeDef USBD_DFU;
+
+/* Exported functions ------------------------------------------------------- */
+void USBD_DFU_Poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_DFU_H */
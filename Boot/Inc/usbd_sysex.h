@@ -0,0 +1,39 @@
+/**
+  ******************************************************************************
+  * @file    usbd_sysex.h
+  * @brief   USB-MIDI function of the bootloader: firmware update over SysEx
+  *          (sysex_update.h) on a single "Updater" port.
+  *
+  *          OUT packets are decoded in the USB interrupt as they arrive: the
+  *          7-bit data of a DATA message is unpacked straight into its
+  *          place in the page buffer of the page writer (boot_flash.h), so
+  *          a block costs no copy and no buffer of its own. Four blocks fill
+  *          a page; the window offered to the host ends with the last page
+  *          buffer that is free, and it is widened from the main loop each
+  *          time the writer finishes a page.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_SYSEX_H
+#define __USBD_SYSEX_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+
+/* Exported variables --------------------------------------------------------*/
+extern const USBD_ClassTypeDef USBD_SYSEX;
+
+/* Exported functions ------------------------------------------------------- */
+void USBD_SysEx_Poll(void);
+void USBD_SysEx_RxPoll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_SYSEX_H */
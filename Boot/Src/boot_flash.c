@@ -0,0 +1,337 @@
+/**
+  ******************************************************************************
+  * @file    boot_flash.c
+  * @brief   Page writer of the bootloader, shared by the DFU and the SysEx
+  *          update functions.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include "boot_flash.h"
+#include "boot_image.h"
+#include "ramfunc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BOOT_TRAILER_MAGIC_ADDR         (BOOT_TRAILER_ADDR + offsetof(BOOT_TrailerTypeDef, Magic))
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Buf[BOOT_FLASH_PAGE / 4U];
+  uint16_t Page;
+  uint16_t Len;
+} BOOT_SlotTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static BOOT_SlotTypeDef flash_slot[BOOT_FLASH_SLOTS];
+static __IO uint8_t flash_queued;       /* Slots received, not yet written */
+static uint8_t flash_rx;                /* Slot of the next page           */
+static uint8_t flash_wr;                /* Slot the writer takes next      */
+
+static __IO uint8_t flash_owner;
+static __IO uint8_t flash_status;
+static __IO uint8_t flash_abort;        /* Drop what is still queued       */
+static uint8_t flash_invalidate;        /* Trailer not yet cleared         */
+static uint32_t flash_size;             /* Image bytes written             */
+static uint32_t flash_crc;              /* CRC of the pages queued so far  */
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Wait for the end of a flash operation, from SRAM: any fetch from
+  *         flash would stall until then. Interrupts are masked meanwhile
+  *         and BOOT_Flash_BusyCallback() keeps USB reception going.
+  * @retval HAL_OK, HAL_ERROR on a programming or protection error
+  */
+__RAM_FUNC static HAL_StatusTypeDef BOOT_Flash_Wait(void)
+{
+  uint32_t sr;
+
+  while ((FLASH->SR & FLASH_SR_BSY) != 0U)
+  {
+    BOOT_Flash_BusyCallback();
+  }
+  sr = FLASH->SR;
+  /* Write 1 to clear */
+  FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+  return ((sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) != 0U) ? HAL_ERROR : HAL_OK;
+}
+
+/**
+  * @brief  Erase one page. Flash unlocked, main loop.
+  */
+__RAM_FUNC static HAL_StatusTypeDef BOOT_Flash_ErasePage(uint32_t addr)
+{
+  HAL_StatusTypeDef status;
+
+  __disable_irq();
+  SET_BIT(FLASH->CR, FLASH_CR_PER);
+  FLASH->AR = addr;
+  SET_BIT(FLASH->CR, FLASH_CR_STRT);
+  status = BOOT_Flash_Wait();
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PER);
+  __enable_irq();
+  return status;
+}
+
+/**
+  * @brief  Program n halfwords, skipping erased ones. Interrupts are let in
+  *         between halfwords, while the flash reads. Flash unlocked, main
+  *         loop.
+  */
+__RAM_FUNC static HAL_StatusTypeDef BOOT_Flash_Program(uint32_t addr, const uint16_t *src, uint32_t n)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  uint32_t i;
+
+  SET_BIT(FLASH->CR, FLASH_CR_PG);
+  for (i = 0; (i < n) && (status == HAL_OK); i++)
+  {
+    if (src[i] != 0xFFFFU)
+    {
+      __disable_irq();
+      *(__IO uint16_t *)(addr + 2U * i) = src[i];
+      status = BOOT_Flash_Wait();
+      __enable_irq();
+    }
+  }
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+  return status;
+}
+
+/**
+  * @brief  Program one word. Flash unlocked, main loop.
+  */
+static HAL_StatusTypeDef BOOT_Flash_Word(uint32_t addr, uint32_t data)
+{
+  return BOOT_Flash_Program(addr, (const uint16_t *)(void *)&data, 2U);
+}
+
+/**
+  * @brief  Erase the page of a slot unless it already reads blank, then
+  *         program its halfwords, skipping erased ones.
+  */
+static uint8_t BOOT_Flash_Write(const BOOT_SlotTypeDef *slot)
+{
+  uint32_t addr = BOOT_APP_BASE + (uint32_t)slot->Page * BOOT_FLASH_PAGE;
+
+  if (flash_invalidate != 0U)
+  {
+    /* Zero may be programmed over anything: the old image is void from
+       the first written page on */
+    flash_invalidate = 0;
+    if ((*(const uint32_t *)BOOT_TRAILER_MAGIC_ADDR != 0xFFFFFFFFU) &&
+        (BOOT_Flash_Word(BOOT_TRAILER_MAGIC_ADDR, 0U) != HAL_OK))
+    {
+      return BOOT_FLASH_ERR_WRITE;
+    }
+  }
+
+  if ((BOOT_Blank(addr, BOOT_FLASH_PAGE / 4U) == 0U) && (BOOT_Flash_ErasePage(addr) != HAL_OK))
+  {
+    return BOOT_FLASH_ERR_ERASE;
+  }
+  if (BOOT_Flash_Program(addr, (const uint16_t *)slot->Buf, (slot->Len + 1U) / 2U) != HAL_OK)
+  {
+    return BOOT_FLASH_ERR_WRITE;
+  }
+  return BOOT_FLASH_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start an update session. Refused while the other function owns
+  *         one or a page of a dropped session is still being written.
+  * @param  owner: BOOT_FLASH_DFU or BOOT_FLASH_SYSEX
+  * @retval 1 if started
+  */
+uint32_t BOOT_Flash_Begin(uint32_t owner)
+{
+  if (((flash_owner != BOOT_FLASH_NONE) && (flash_owner != owner)) || (flash_queued != 0U))
+  {
+    return 0;
+  }
+  flash_owner = (uint8_t)owner;
+  flash_status = BOOT_FLASH_OK;
+  flash_abort = 0;
+  flash_invalidate = 1;
+  flash_size = 0;
+  flash_crc = CRC32_INIT;
+  return 1;
+}
+
+/**
+  * @brief  Owner of the running session, BOOT_FLASH_NONE if idle.
+  */
+uint32_t BOOT_Flash_Owner(void)
+{
+  return flash_owner;
+}
+
+/**
+  * @brief  Buffer for the next page, BOOT_FLASH_PAGE bytes, word aligned.
+  *         Also runs from SRAM while the flash is busy.
+  * @retval NULL while both slots are queued or after an error
+  */
+__RAM_FUNC uint32_t *BOOT_Flash_Slot(void)
+{
+  if ((flash_queued >= BOOT_FLASH_SLOTS) || (flash_status != BOOT_FLASH_OK))
+  {
+    return NULL;
+  }
+  return flash_slot[flash_rx].Buf;
+}
+
+/**
+  * @brief  Queue the slot returned by BOOT_Flash_Slot(). USB interrupt.
+  * @param  page: page index in the application region, pages in order
+  * @param  len: bytes in the slot, less than a page for the last one only
+  * @retval None
+  */
+void BOOT_Flash_Commit(uint32_t page, uint32_t len)
+{
+  flash_slot[flash_rx].Page = (uint16_t)page;
+  flash_slot[flash_rx].Len = (uint16_t)len;
+  flash_rx = (uint8_t)((flash_rx + 1U) % BOOT_FLASH_SLOTS);
+  flash_queued++;
+}
+
+/**
+  * @brief  Slots that can take a page, the one being received included.
+  */
+uint32_t BOOT_Flash_Free(void)
+{
+  return BOOT_FLASH_SLOTS - flash_queued;
+}
+
+/**
+  * @brief  Pages queued or being written.
+  */
+uint32_t BOOT_Flash_Queued(void)
+{
+  return flash_queued;
+}
+
+/**
+  * @brief  BOOT_FLASH_OK, or the first error of the session.
+  */
+uint8_t BOOT_Flash_Status(void)
+{
+  return flash_status;
+}
+
+/**
+  * @brief  CRC of the pages written so far, the whole image once
+  *         BOOT_Flash_Queued() is 0.
+  */
+uint32_t BOOT_Flash_Crc(void)
+{
+  return flash_crc;
+}
+
+/**
+  * @brief  Write the oldest queued page, or drop the queue after an error
+  *         or BOOT_Flash_End(). Call from the main loop.
+  * @retval None
+  */
+void BOOT_Flash_Poll(void)
+{
+  BOOT_SlotTypeDef *slot;
+  uint32_t words;
+  uint8_t status;
+
+  if (flash_queued == 0U)
+  {
+    return;
+  }
+
+  if ((flash_status != BOOT_FLASH_OK) || (flash_abort != 0U))
+  {
+    NVIC_DisableIRQ(USB_IRQn);
+    flash_wr = flash_rx;
+    flash_queued = 0;
+    NVIC_EnableIRQ(USB_IRQn);
+    return;
+  }
+
+  slot = &flash_slot[flash_wr];
+
+  /* Pad the last word with erased bytes, as the CRC covers whole words */
+  words = (slot->Len + 3U) / 4U;
+  if ((slot->Len & 3U) != 0U)
+  {
+    slot->Buf[words - 1U] |= 0xFFFFFFFFU << (8U * (slot->Len & 3U));
+  }
+  /* The SysEx function checks its blocks on the CRC unit in the USB
+     interrupt */
+  NVIC_DisableIRQ(USB_IRQn);
+  flash_crc = CRC32_Calc(flash_crc, slot->Buf, words);
+  NVIC_EnableIRQ(USB_IRQn);
+  flash_size = (uint32_t)slot->Page * BOOT_FLASH_PAGE + slot->Len;
+
+  HAL_FLASH_Unlock();
+  status = BOOT_Flash_Write(slot);
+  HAL_FLASH_Lock();
+
+  NVIC_DisableIRQ(USB_IRQn);
+  flash_wr = (uint8_t)((flash_wr + 1U) % BOOT_FLASH_SLOTS);
+  flash_queued--;
+  if (flash_status == BOOT_FLASH_OK)
+  {
+    flash_status = status;
+  }
+  NVIC_EnableIRQ(USB_IRQn);
+}
+
+/**
+  * @brief  Close the session once the queue is empty: check the written
+  *         image against the CRC of what was queued and commit the
+  *         trailer, magic last. Main loop.
+  * @retval BOOT_FLASH_OK once the image is bootable
+  */
+uint8_t BOOT_Flash_Finish(void)
+{
+  uint8_t status = flash_status;
+  uint32_t crc;
+
+  NVIC_DisableIRQ(USB_IRQn);
+  crc = CRC32_Calc(CRC32_INIT, (const uint32_t *)BOOT_APP_BASE, (flash_size + 3U) / 4U);
+  NVIC_EnableIRQ(USB_IRQn);
+  if ((status == BOOT_FLASH_OK) && (crc != flash_crc))
+  {
+    status = BOOT_FLASH_ERR_VERIFY;
+  }
+
+  HAL_FLASH_Unlock();
+  /* Only an image that stops short of the last page leaves the old,
+     cleared trailer there */
+  if ((status == BOOT_FLASH_OK) &&
+      (BOOT_Blank(BOOT_TRAILER_ADDR, sizeof(BOOT_TrailerTypeDef) / 4U) == 0U) &&
+      (BOOT_Flash_ErasePage(BOOT_TRAILER_ADDR & ~(BOOT_FLASH_PAGE - 1U)) != HAL_OK))
+  {
+    status = BOOT_FLASH_ERR_ERASE;
+  }
+  if ((status == BOOT_FLASH_OK) &&
+      ((BOOT_Flash_Word(BOOT_TRAILER_ADDR + offsetof(BOOT_TrailerTypeDef, Size), flash_size) != HAL_OK) ||
+       (BOOT_Flash_Word(BOOT_TRAILER_ADDR + offsetof(BOOT_TrailerTypeDef, Crc), flash_crc) != HAL_OK) ||
+       (BOOT_Flash_Word(BOOT_TRAILER_MAGIC_ADDR, BOOT_TRAILER_MAGIC) != HAL_OK)))
+  {
+    status = BOOT_FLASH_ERR_WRITE;
+  }
+  HAL_FLASH_Lock();
+
+  flash_owner = BOOT_FLASH_NONE;
+  return status;
+}
+
+/**
+  * @brief  Abandon the session; pages still queued are dropped. Any
+  *         context.
+  * @retval None
+  */
+void BOOT_Flash_End(void)
+{
+  flash_abort = 1;
+  flash_owner = BOOT_FLASH_NONE;
+}
@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file    boot_image.c
+  * @brief   Application image checks of the bootloader, on the CRC service.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "boot_image.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BOOT_RAM_END                    (SRAM_BASE + 6U * 1024U)
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Whether a flash range reads erased.
+  * @param  addr: word aligned address
+  * @param  n: number of words
+  */
+uint32_t BOOT_Blank(uint32_t addr, uint32_t n)
+{
+  const uint32_t *p = (const uint32_t *)addr;
+
+  while (n-- != 0U)
+  {
+    if (*p++ != 0xFFFFFFFFU)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  Whether the application region holds a complete image: the
+  *         trailer is committed, the vectors point into the image and SRAM,
+  *         and the CRC matches. The CRC is fed by DMA, well under a
+  *         millisecond at 8 MHz.
+  */
+uint32_t BOOT_ImageValid(void)
+{
+  const BOOT_TrailerTypeDef *trailer = (const BOOT_TrailerTypeDef *)BOOT_TRAILER_ADDR;
+  const uint32_t *app = (const uint32_t *)BOOT_APP_BASE;
+
+  if ((trailer->Magic != BOOT_TRAILER_MAGIC) ||
+      (trailer->Size < 8U) || (trailer->Size > BOOT_APP_MAX))
+  {
+    return 0;
+  }
+  if ((app[0] <= SRAM_BASE) || (app[0] > BOOT_RAM_END) ||
+      (app[1] < BOOT_APP_BASE) || (app[1] >= (BOOT_APP_BASE + trailer->Size)))
+  {
+    return 0;
+  }
+  return CRC32_Calc(CRC32_INIT, app, (trailer->Size + 3U) / 4U) == trailer->Crc;
+}
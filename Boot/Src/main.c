@@ -0,0 +1,177 @@
+/**
+  ******************************************************************************
+  * @file    main.c
+  * @brief   Resident DFU bootloader.
+  *
+  *          Decides at reset, still on the 8 MHz HSI and with nothing but
+  *          the CRC unit, DMA1 and GPIOB clocked, whether to start the
+  *          application; all are back in their reset state before the
+  *          jump, so the application starts from reset conditions. Otherwise it brings
+  *          up HSI48 and USB and serves DFU (usbd_dfu.c) and the SysEx
+  *          update (usbd_sysex.c) until a completed download restarts it.
+  *
+  *          The BOOT button shares PB8 with BOOT0: it only reaches this
+  *          check once the nBOOT_SEL option bit is cleared, otherwise a
+  *          held button starts the system memory bootloader instead.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "mxconstants.h"
+#include "boot_image.h"
+#include "usb_device.h"
+#include "usbd_dfu.h"
+#include "usbd_sysex.h"
+#include "boot_flash.h"
+#include "ramfunc.h"
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef boot_pcd;
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Whether BOOT is held. The pin is sampled with its pull-down on.
+  */
+static uint32_t BOOT_ButtonHeld(void)
+{
+  uint32_t held;
+  volatile uint32_t settle;
+
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  MODIFY_REG(BOOT_GPIO_Port->PUPDR, GPIO_PUPDR_PUPDR8, GPIO_PUPDR_PUPDR8_1);
+  for (settle = 0; settle < 100U; settle++)
+  {
+  }
+  held = (BOOT_GPIO_Port->IDR & BOOT_Pin) != 0U;
+
+  __HAL_RCC_GPIOB_FORCE_RESET();
+  __HAL_RCC_GPIOB_RELEASE_RESET();
+  __HAL_RCC_GPIOB_CLK_DISABLE();
+  return held;
+}
+
+/**
+  * @brief  Start the application: stack pointer and reset handler from its
+  *         vector table. Its main() maps its own vectors (vectors.h).
+  */
+__attribute__((noreturn)) static void BOOT_Jump(void)
+{
+  const uint32_t *app = (const uint32_t *)BOOT_APP_BASE;
+
+  CRC32_DeInit();
+
+  __ASM volatile ("msr msp, %0\n"
+                  "bx  %1\n" : : "r" (app[0]), "r" (app[1]));
+  for (;;)
+  {
+  }
+}
+
+/**
+  * @brief  HSI48 as system and USB clock, as in the application.
+  */
+static void BOOT_ClockConfig(void)
+{
+  RCC_OscInitTypeDef osc;
+  RCC_ClkInitTypeDef clk;
+  RCC_PeriphCLKInitTypeDef periph;
+
+  osc.OscillatorType = RCC_OSCILLATORTYPE_HSI48;
+  osc.HSI48State = RCC_HSI48_ON;
+  osc.PLL.PLLState = RCC_PLL_NONE;
+  HAL_RCC_OscConfig(&osc);
+
+  clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1;
+  clk.SYSCLKSource = RCC_SYSCLKSOURCE_HSI48;
+  clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  clk.APB1CLKDivider = RCC_HCLK_DIV1;
+  HAL_RCC_ClockConfig(&clk, FLASH_LATENCY_1);
+
+  periph.PeriphClockSelection = RCC_PERIPHCLK_USB;
+  periph.UsbClockSelection = RCC_USBCLKSOURCE_HSI48;
+  HAL_RCCEx_PeriphCLKConfig(&periph);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(void)
+{
+  uint32_t request = _sboot_flag;
+
+  _sboot_flag = 0;
+  CRC32_Init();
+
+  if ((request != BOOT_REQUEST_DFU) && (BOOT_ButtonHeld() == 0U) &&
+      (BOOT_ImageValid() != 0U))
+  {
+    BOOT_Jump();
+  }
+
+  HAL_Init();
+  BOOT_ClockConfig();
+
+  /* Blue LED: waiting for a download */
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  MODIFY_REG(BLUE_GPIO_Port->MODER, GPIO_MODER_MODER1, GPIO_MODER_MODER1_0);
+  BLUE_GPIO_Port->BSRR = BLUE_Pin;
+
+  boot_pcd.Instance = USB;
+  boot_pcd.Init.dev_endpoints = 8;
+  boot_pcd.Init.speed = PCD_SPEED_FULL;
+  boot_pcd.Init.ep0_mps = DEP0CTL_MPS_8;
+  boot_pcd.Init.phy_itface = PCD_PHY_EMBEDDED;
+  boot_pcd.Init.low_power_enable = DISABLE;
+  boot_pcd.Init.lpm_enable = DISABLE;
+  HAL_PCD_Init(&boot_pcd);
+
+  USBD_Init(&boot_pcd);
+  USBD_RegisterClass(&USBD_DFU);
+  USBD_RegisterClass(&USBD_SYSEX);
+  HAL_PCD_Start(&boot_pcd);
+
+  for (;;)
+  {
+    BOOT_Flash_Poll();
+    USBD_DFU_Poll();
+    USBD_SysEx_Poll();
+  }
+}
+
+/**
+  * @brief  USB pins on PA11/PA12 (remapped over PA9/PA10 on this package),
+  *         clock and interrupt.
+  */
+void HAL_PCD_MspInit(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+  __HAL_REMAP_PIN_ENABLE(HAL_REMAP_PA11_PA12);
+  __HAL_RCC_USB_CLK_ENABLE();
+  HAL_NVIC_SetPriority(USB_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(USB_IRQn);
+}
+
+/**
+  * @brief  Page writer hook while the flash is busy: keep the data of a
+  *         DFU block or of SysEx DATA messages flowing into the free slot.
+  *         Everything else waits for the USB interrupt.
+  */
+__RAM_FUNC void BOOT_Flash_BusyCallback(void)
+{
+  USBD_CtlRxPoll(&boot_pcd);
+  USBD_SysEx_RxPoll();
+}
+
+/* Interrupt handlers --------------------------------------------------------*/
+
+void SysTick_Handler(void)
+{
+  HAL_IncTick();
+}
+
+void USB_IRQHandler(void)
+{
+  HAL_PCD_IRQHandler(&boot_pcd);
+}
@@ -0,0 +1,365 @@
+/**
+  ******************************************************************************
+  * @file    usb_desc.c
+  * @brief   USB descriptors of the bootloader: a DFU 1.1 interface in DFU
+  *          mode and a USB-MIDI function with one "Updater" port for the
+  *          SysEx update, with the serial number of the application so a
+  *          host tool can follow the device across the detach.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+#include "usb_conf.h"
+#include <stddef.h>
+#include "usbd_dfu.h"
+
+/* Private define ------------------------------------------------------------*/
+#define USB_DESC_TYPE_DEVICE            0x01U
+#define USB_DESC_TYPE_CONFIGURATION     0x02U
+#define USB_DESC_TYPE_STRING            0x03U
+#define USB_DESC_TYPE_INTERFACE         0x04U
+#define USB_DESC_TYPE_ENDPOINT          0x05U
+#define USB_DESC_TYPE_DFU_FUNCTIONAL    0x21U
+#define USB_DESC_TYPE_CS_INTERFACE      0x24U
+#define USB_DESC_TYPE_CS_ENDPOINT       0x25U
+
+#define USB_CLASS_AUDIO                 0x01U
+#define USB_CLASS_APP_SPECIFIC          0xFEU
+#define AUDIO_SUBCLASS_CONTROL          0x01U
+#define AUDIO_SUBCLASS_MIDI_STREAMING   0x03U
+#define DFU_SUBCLASS                    0x01U
+#define DFU_PROTOCOL_DFU_MODE           0x02U
+
+/* bmAttributes: bitCanDnload | bitWillDetach. Not manifestation tolerant:
+   the bootloader restarts into the new image by itself. */
+#define DFU_ATTRIBUTES                  0x09U
+#define DFU_DETACH_TIMEOUT              255U
+#define DFU_VERSION                     0x0110U
+
+#define MS_HEADER                       0x01U
+#define MS_MIDI_IN_JACK                 0x02U
+#define MS_MIDI_OUT_JACK                0x03U
+#define MS_GENERAL                      0x01U
+#define MS_JACK_EMBEDDED                0x01U
+#define MS_JACK_EXTERNAL                0x02U
+
+/* One port, jack ids as for the first port of the application */
+#define USBD_JACK_EMB_IN                0x01U
+#define USBD_JACK_EXT_IN                0x02U
+#define USBD_JACK_EMB_OUT               0x03U
+#define USBD_JACK_EXT_OUT               0x04U
+
+#define USBD_IDX_LANGID_STR             0x00U
+#define USBD_IDX_MFC_STR                0x01U
+#define USBD_IDX_PRODUCT_STR            0x02U
+#define USBD_IDX_SERIAL_STR             0x03U
+#define USBD_IDX_DFU_ITF_STR            0x04U
+#define USBD_IDX_PORT_STR               0x05U
+
+#define USBD_DFU_ITF_STRING             "Application @ 0x08002000"
+#define USBD_PORT_STRING                "Updater"
+#define USBD_LANGID                     0x0409U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint16_t wTotalLength;
+  uint8_t  bNumInterfaces;
+  uint8_t  bConfigurationValue;
+  uint8_t  iConfiguration;
+  uint8_t  bmAttributes;
+  uint8_t  bMaxPower;
+} USB_ConfigDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bInterfaceNumber;
+  uint8_t  bAlternateSetting;
+  uint8_t  bNumEndpoints;
+  uint8_t  bInterfaceClass;
+  uint8_t  bInterfaceSubClass;
+  uint8_t  bInterfaceProtocol;
+  uint8_t  iInterface;
+} USB_InterfaceDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bmAttributes;
+  uint16_t wDetachTimeOut;
+  uint16_t wTransferSize;
+  uint16_t bcdDFUVersion;
+} DFU_FunctionalDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bEndpointAddress;
+  uint8_t  bmAttributes;
+  uint16_t wMaxPacketSize;
+  uint8_t  bInterval;
+  uint8_t  bRefresh;
+  uint8_t  bSynchAddress;
+} AUDIO_EndpointDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint16_t bcdADC;
+  uint16_t wTotalLength;
+  uint8_t  bInCollection;
+  uint8_t  baInterfaceNr;
+} AUDIO_ACHeaderDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint16_t bcdMSC;
+  uint16_t wTotalLength;
+} MS_HeaderDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bJackType;
+  uint8_t  bJackID;
+  uint8_t  iJack;
+} MS_InJackDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bJackType;
+  uint8_t  bJackID;
+  uint8_t  bNrInputPins;
+  uint8_t  baSourceID;
+  uint8_t  baSourcePin;
+  uint8_t  iJack;
+} MS_OutJackDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bNumEmbMIDIJack;
+  uint8_t  baAssocJackID;
+} MS_EndpointDescTypeDef;
+
+typedef struct __packed
+{
+  USB_ConfigDescTypeDef     Config;
+  USB_InterfaceDescTypeDef  DfuItf;
+  DFU_FunctionalDescTypeDef DfuFunc;
+
+  USB_InterfaceDescTypeDef  AcItf;
+  AUDIO_ACHeaderDescTypeDef AcHeader;
+
+  USB_InterfaceDescTypeDef  MsItf;
+  MS_HeaderDescTypeDef      MsHeader;
+  MS_InJackDescTypeDef      EmbIn;
+  MS_InJackDescTypeDef      ExtIn;
+  MS_OutJackDescTypeDef     EmbOut;
+  MS_OutJackDescTypeDef     ExtOut;
+  AUDIO_EndpointDescTypeDef OutEp;
+  MS_EndpointDescTypeDef    OutEpMs;
+  AUDIO_EndpointDescTypeDef InEp;
+  MS_EndpointDescTypeDef    InEpMs;
+} USBD_ConfigDescSetTypeDef;
+
+/* Private macro -------------------------------------------------------------*/
+/**
+  * @brief  Define a const string descriptor from an ASCII literal. The
+  *         literal is widened to UTF-16 by the compiler.
+  */
+#define USBD_STRING_DESC(__NAME__, __STR__)                                    \
+  static const struct __packed                                                 \
+  {                                                                            \
+    uint8_t  bLength;                                                          \
+    uint8_t  bDescriptorType;                                                  \
+    uint16_t bString[sizeof(u"" __STR__) / 2U - 1U];                           \
+  } __NAME__ = { sizeof(u"" __STR__), USB_DESC_TYPE_STRING, u"" __STR__ }
+
+#define LOBYTE(x)                       ((uint8_t)((x) & 0x00FFU))
+#define HIBYTE(x)                       ((uint8_t)(((x) & 0xFF00U) >> 8))
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t usbd_device_desc[18] =
+{
+  0x12,                                 /* bLength */
+  USB_DESC_TYPE_DEVICE,                 /* bDescriptorType */
+  0x00, 0x02,                           /* bcdUSB 2.00 */
+  0x00,                                 /* bDeviceClass: per interface */
+  0x00,                                 /* bDeviceSubClass */
+  0x00,                                 /* bDeviceProtocol */
+  USBD_EP0_SIZE,                        /* bMaxPacketSize0 */
+  LOBYTE(USBD_VID), HIBYTE(USBD_VID),
+  LOBYTE(USBD_PID), HIBYTE(USBD_PID),
+  LOBYTE(USBD_BCD_DEVICE), HIBYTE(USBD_BCD_DEVICE),
+  USBD_IDX_MFC_STR,
+  USBD_IDX_PRODUCT_STR,
+  USBD_IDX_SERIAL_STR,
+  0x01                                  /* bNumConfigurations */
+};
+
+static const USBD_ConfigDescSetTypeDef usbd_config_desc =
+{
+  /* Configuration: bus powered, 100 mA */
+  { sizeof(USB_ConfigDescTypeDef), USB_DESC_TYPE_CONFIGURATION,
+    sizeof(USBD_ConfigDescSetTypeDef), USBD_ITF_COUNT, 0x01, 0x00, 0x80, 0x32 },
+
+  /* DFU mode interface, control endpoint only */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_DFU,
+    0x00, 0x00, USB_CLASS_APP_SPECIFIC, DFU_SUBCLASS, DFU_PROTOCOL_DFU_MODE,
+    USBD_IDX_DFU_ITF_STR },
+  { sizeof(DFU_FunctionalDescTypeDef), USB_DESC_TYPE_DFU_FUNCTIONAL, DFU_ATTRIBUTES,
+    DFU_DETACH_TIMEOUT, USBD_DFU_XFER_SIZE, DFU_VERSION },
+
+  /* Audio control interface and header: one streaming interface */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_AUDIO_CONTROL,
+    0x00, 0x00, USB_CLASS_AUDIO, AUDIO_SUBCLASS_CONTROL, 0x00, 0x00 },
+  { sizeof(AUDIO_ACHeaderDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_HEADER,
+    0x0100, sizeof(AUDIO_ACHeaderDescTypeDef), 0x01, USBD_ITF_MIDI_STREAMING },
+
+  /* MIDI streaming interface with the "Updater" port */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_MIDI_STREAMING,
+    0x00, 0x02, USB_CLASS_AUDIO, AUDIO_SUBCLASS_MIDI_STREAMING, 0x00, 0x00 },
+  { sizeof(MS_HeaderDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_HEADER, 0x0100,
+    sizeof(USBD_ConfigDescSetTypeDef) - offsetof(USBD_ConfigDescSetTypeDef, MsHeader) },
+  { sizeof(MS_InJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_IN_JACK,
+    MS_JACK_EMBEDDED, USBD_JACK_EMB_IN, USBD_IDX_PORT_STR },
+  { sizeof(MS_InJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_IN_JACK,
+    MS_JACK_EXTERNAL, USBD_JACK_EXT_IN, 0x00 },
+  { sizeof(MS_OutJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_OUT_JACK,
+    MS_JACK_EMBEDDED, USBD_JACK_EMB_OUT, 0x01, USBD_JACK_EXT_IN, 0x01, USBD_IDX_PORT_STR },
+  { sizeof(MS_OutJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_OUT_JACK,
+    MS_JACK_EXTERNAL, USBD_JACK_EXT_OUT, 0x01, USBD_JACK_EMB_IN, 0x01, 0x00 },
+
+  /* Bulk OUT and IN of the port */
+  { sizeof(AUDIO_EndpointDescTypeDef), USB_DESC_TYPE_ENDPOINT, SYSEX_EP_OUT, 0x02,
+    SYSEX_EP_SIZE, 0x00, 0x00, 0x00 },
+  { sizeof(MS_EndpointDescTypeDef), USB_DESC_TYPE_CS_ENDPOINT, MS_GENERAL,
+    0x01, USBD_JACK_EMB_IN },
+  { sizeof(AUDIO_EndpointDescTypeDef), USB_DESC_TYPE_ENDPOINT, SYSEX_EP_IN, 0x02,
+    SYSEX_EP_SIZE, 0x00, 0x00, 0x00 },
+  { sizeof(MS_EndpointDescTypeDef), USB_DESC_TYPE_CS_ENDPOINT, MS_GENERAL,
+    0x01, USBD_JACK_EMB_OUT }
+};
+
+static const uint8_t usbd_langid_desc[4] =
+{
+  0x04, USB_DESC_TYPE_STRING, LOBYTE(USBD_LANGID), HIBYTE(USBD_LANGID)
+};
+
+USBD_STRING_DESC(usbd_mfc_str, USBD_MANUFACTURER_STRING);
+USBD_STRING_DESC(usbd_product_str, USBD_PRODUCT_STRING);
+USBD_STRING_DESC(usbd_dfu_itf_str, USBD_DFU_ITF_STRING);
+USBD_STRING_DESC(usbd_port_str, USBD_PORT_STRING);
+
+/* Serial number string, built once from the unique device ID */
+static uint8_t usbd_serial_desc[2 + 2 * 12];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Build the serial number string from the 96-bit unique device ID,
+  *         the same way as the application does.
+  */
+static const uint8_t *USBD_GetSerial(void)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  uint32_t hi = *(__IO uint32_t *)(UID_BASE) + *(__IO uint32_t *)(UID_BASE + 8U);
+  uint32_t lo = *(__IO uint32_t *)(UID_BASE + 4U);
+  int32_t i;
+
+  if (usbd_serial_desc[0] != 0U)
+  {
+    return usbd_serial_desc;
+  }
+
+  for (i = 7; i >= 0; i--)
+  {
+    usbd_serial_desc[2 + 2 * i] = (uint8_t)hex[hi & 0x0FU];
+    hi >>= 4;
+  }
+  for (i = 11; i >= 8; i--)
+  {
+    usbd_serial_desc[2 + 2 * i] = (uint8_t)hex[lo & 0x0FU];
+    lo >>= 4;
+  }
+  usbd_serial_desc[1] = USB_DESC_TYPE_STRING;
+  usbd_serial_desc[0] = sizeof(usbd_serial_desc);
+
+  return usbd_serial_desc;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Look up a descriptor for GET_DESCRIPTOR.
+  * @param  wValue: descriptor type (high byte) and index (low byte)
+  * @param  wIndex: language id for strings
+  * @param  len: descriptor length
+  * @retval Descriptor, or NULL to stall the request
+  */
+const uint8_t *USBD_GetDescriptor(uint16_t wValue, uint16_t wIndex, uint16_t *len)
+{
+  const uint8_t *desc;
+
+  UNUSED(wIndex);
+
+  switch (wValue >> 8)
+  {
+  case USB_DESC_TYPE_DEVICE:
+    *len = sizeof(usbd_device_desc);
+    return usbd_device_desc;
+
+  case USB_DESC_TYPE_CONFIGURATION:
+    *len = sizeof(usbd_config_desc);
+    return (const uint8_t *)&usbd_config_desc;
+
+  case USB_DESC_TYPE_STRING:
+    switch (wValue & 0xFFU)
+    {
+    case USBD_IDX_LANGID_STR:
+      desc = usbd_langid_desc;
+      break;
+    case USBD_IDX_MFC_STR:
+      desc = (const uint8_t *)&usbd_mfc_str;
+      break;
+    case USBD_IDX_PRODUCT_STR:
+      desc = (const uint8_t *)&usbd_product_str;
+      break;
+    case USBD_IDX_SERIAL_STR:
+      desc = USBD_GetSerial();
+      break;
+    case USBD_IDX_DFU_ITF_STR:
+      desc = (const uint8_t *)&usbd_dfu_itf_str;
+      break;
+    case USBD_IDX_PORT_STR:
+      desc = (const uint8_t *)&usbd_port_str;
+      break;
+    default:
+      return NULL;
+    }
+    *len = desc[0];
+    return desc;
+
+  default:
+    return NULL;
+  }
+}
@@ -0,0 +1,289 @@
+/**
+  ******************************************************************************
+  * @file    usbd_dfu.c
+  * @brief   USB DFU 1.1 function of the bootloader, download only.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_dfu.h"
+#include "usb_conf.h"
+#include "boot_flash.h"
+
+/* Private define ------------------------------------------------------------*/
+#define DFU_RESET_DELAY                 20U     /* ms for the last status stage */
+#define DFU_LAST_BLOCK                  (BOOT_FLASH_PAGES - 1U)
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef *dfu_pcd;
+
+static __IO uint8_t dfu_state = DFU_STATE_IDLE;
+static __IO uint8_t dfu_status = DFU_STATUS_OK;
+static __IO uint8_t dfu_pending;        /* GETSTATUS held off              */
+static uint16_t dfu_next;               /* Expected block number           */
+static uint16_t dfu_len;                /* Length of the block in transfer */
+static uint32_t dfu_reset_tick;
+static uint8_t dfu_reset;
+
+static uint8_t dfu_reply[6];
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBD_DFU_Init(PCD_HandleTypeDef *hpcd);
+static void USBD_DFU_DeInit(PCD_HandleTypeDef *hpcd);
+static uint8_t USBD_DFU_Setup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+static void USBD_DFU_EP0_RxReady(PCD_HandleTypeDef *hpcd);
+
+/* Exported variables --------------------------------------------------------*/
+const USBD_ClassTypeDef USBD_DFU =
+{
+  USBD_DFU_Init,
+  USBD_DFU_DeInit,
+  USBD_DFU_Setup,
+  USBD_DFU_EP0_RxReady,
+  NULL,
+  NULL,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Enter dfuERROR; the page writer drops the blocks still pending.
+  */
+static void USBD_DFU_Fail(uint8_t status)
+{
+  dfu_state = DFU_STATE_ERROR;
+  dfu_status = status;
+  if (BOOT_Flash_Owner() == BOOT_FLASH_DFU)
+  {
+    BOOT_Flash_End();
+  }
+}
+
+/**
+  * @brief  Answer GETSTATUS with the current state. The poll timeout is
+  *         always 0: a busy device holds the request off instead.
+  */
+static void USBD_DFU_Reply(PCD_HandleTypeDef *hpcd)
+{
+  dfu_pending = 0;
+  dfu_reply[0] = dfu_status;
+  dfu_reply[1] = 0;
+  dfu_reply[2] = 0;
+  dfu_reply[3] = 0;
+  dfu_reply[4] = dfu_state;
+  dfu_reply[5] = 0;
+  USBD_CtlSendData(hpcd, dfu_reply, sizeof(dfu_reply));
+}
+
+/**
+  * @brief  GETSTATUS: move on from the sync states if possible, else hold
+  *         the answer until USBD_DFU_Poll() can give it.
+  */
+static void USBD_DFU_GetStatus(PCD_HandleTypeDef *hpcd)
+{
+  if (dfu_state == DFU_STATE_DNLOAD_SYNC)
+  {
+    if (BOOT_Flash_Free() == 0U)
+    {
+      dfu_pending = 1;
+      return;
+    }
+    dfu_state = DFU_STATE_DNLOAD_IDLE;
+  }
+  else if (dfu_state == DFU_STATE_MANIFEST_SYNC)
+  {
+    dfu_pending = 1;
+    return;
+  }
+  USBD_DFU_Reply(hpcd);
+}
+
+/**
+  * @brief  DNLOAD: take the next block into a free slot, or end the
+  *         download on a zero length block.
+  */
+static uint8_t USBD_DFU_Download(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  uint32_t *slot;
+
+  if ((dfu_state != DFU_STATE_IDLE) && (dfu_state != DFU_STATE_DNLOAD_IDLE))
+  {
+    return USBD_FAIL;
+  }
+
+  if (req->wLength == 0U)
+  {
+    if (dfu_state == DFU_STATE_IDLE)
+    {
+      USBD_DFU_Fail(DFU_STATUS_ERR_NOTDONE);
+      return USBD_FAIL;
+    }
+    dfu_state = DFU_STATE_MANIFEST_SYNC;
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+  }
+
+  if (dfu_state == DFU_STATE_IDLE)
+  {
+    /* New download, unless a SysEx update runs or the writer is still
+       dropping what an error left */
+    if (BOOT_Flash_Begin(BOOT_FLASH_DFU) == 0U)
+    {
+      USBD_DFU_Fail(DFU_STATUS_ERR_UNKNOWN);
+      return USBD_FAIL;
+    }
+    dfu_next = 0;
+  }
+  slot = BOOT_Flash_Slot();
+  if ((req->wLength > USBD_DFU_XFER_SIZE) || (req->wValue != dfu_next) ||
+      (req->wValue > DFU_LAST_BLOCK) ||
+      (((uint32_t)req->wValue * USBD_DFU_XFER_SIZE + req->wLength) > BOOT_APP_MAX) ||
+      (slot == NULL))
+  {
+    USBD_DFU_Fail(DFU_STATUS_ERR_ADDRESS);
+    return USBD_FAIL;
+  }
+
+  dfu_len = req->wLength;
+  dfu_next++;
+  dfu_state = DFU_STATE_DNLOAD_SYNC;
+  USBD_CtlPrepareRx(hpcd, (uint8_t *)slot, req->wLength);
+  return USBD_OK;
+}
+
+static void USBD_DFU_Init(PCD_HandleTypeDef *hpcd)
+{
+  dfu_pcd = hpcd;
+}
+
+static void USBD_DFU_DeInit(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  /* A bus reset drops a held GETSTATUS; the writer carries on */
+  dfu_pending = 0;
+}
+
+static uint8_t USBD_DFU_Setup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  if (((req->bmRequest & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_CLASS) ||
+      ((req->bmRequest & USB_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_INTERFACE) ||
+      ((req->wIndex & 0xFFU) != USBD_ITF_DFU))
+  {
+    return USBD_FAIL;
+  }
+
+  switch (req->bRequest)
+  {
+  case DFU_REQ_DETACH:
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case DFU_REQ_DNLOAD:
+    return USBD_DFU_Download(hpcd, req);
+
+  case DFU_REQ_GETSTATUS:
+    USBD_DFU_GetStatus(hpcd);
+    return USBD_OK;
+
+  case DFU_REQ_CLRSTATUS:
+    if (dfu_state == DFU_STATE_ERROR)
+    {
+      dfu_state = DFU_STATE_IDLE;
+      dfu_status = DFU_STATUS_OK;
+    }
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case DFU_REQ_GETSTATE:
+    dfu_reply[0] = dfu_state;
+    USBD_CtlSendData(hpcd, dfu_reply, 1);
+    return USBD_OK;
+
+  case DFU_REQ_ABORT:
+    if ((dfu_state == DFU_STATE_IDLE) || (dfu_state == DFU_STATE_DNLOAD_IDLE))
+    {
+      if (BOOT_Flash_Owner() == BOOT_FLASH_DFU)
+      {
+        BOOT_Flash_End();
+      }
+      dfu_state = DFU_STATE_IDLE;
+      USBD_CtlSendStatus(hpcd);
+      return USBD_OK;
+    }
+    USBD_DFU_Fail(DFU_STATUS_ERR_STALLEDPKT);
+    return USBD_FAIL;
+
+  default:
+    /* UPLOAD is not offered (bitCanUpload clear) */
+    USBD_DFU_Fail(DFU_STATUS_ERR_STALLEDPKT);
+    return USBD_FAIL;
+  }
+}
+
+static void USBD_DFU_EP0_RxReady(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  BOOT_Flash_Commit((uint32_t)dfu_next - 1U, dfu_len);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Follow the page writer: report its errors, answer held GETSTATUS
+  *         requests once a buffer is free and finish the download once all
+  *         blocks are written. Call from the main loop, after
+  *         BOOT_Flash_Poll().
+  * @retval None
+  */
+void USBD_DFU_Poll(void)
+{
+  uint8_t status;
+
+  if (dfu_reset != 0U)
+  {
+    if ((HAL_GetTick() - dfu_reset_tick) >= DFU_RESET_DELAY)
+    {
+      NVIC_SystemReset();
+    }
+    return;
+  }
+
+  NVIC_DisableIRQ(USB_IRQn);
+  status = BOOT_Flash_Status();
+  if (((dfu_state == DFU_STATE_DNLOAD_SYNC) || (dfu_state == DFU_STATE_DNLOAD_IDLE)) &&
+      (status != BOOT_FLASH_OK))
+  {
+    USBD_DFU_Fail(status);
+  }
+  if ((dfu_pending != 0U) && (dfu_state != DFU_STATE_MANIFEST_SYNC) &&
+      ((dfu_state != DFU_STATE_DNLOAD_SYNC) || (BOOT_Flash_Free() != 0U)))
+  {
+    if (dfu_state == DFU_STATE_DNLOAD_SYNC)
+    {
+      dfu_state = DFU_STATE_DNLOAD_IDLE;
+    }
+    USBD_DFU_Reply(dfu_pcd);
+  }
+  NVIC_EnableIRQ(USB_IRQn);
+
+  if ((dfu_state == DFU_STATE_MANIFEST_SYNC) && (dfu_pending != 0U) &&
+      (BOOT_Flash_Queued() == 0U))
+  {
+    status = BOOT_Flash_Finish();
+
+    NVIC_DisableIRQ(USB_IRQn);
+    if (status != BOOT_FLASH_OK)
+    {
+      USBD_DFU_Fail(status);
+    }
+    else
+    {
+      dfu_state = DFU_STATE_MANIFEST_WAIT_RESET;
+      dfu_reset_tick = HAL_GetTick();
+      dfu_reset = 1;
+    }
+    USBD_DFU_Reply(dfu_pcd);
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+}
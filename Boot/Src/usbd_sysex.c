@@ -0,0 +1,610 @@
+/**
+  ******************************************************************************
+  * @file    usbd_sysex.c
+  * @brief   USB-MIDI function of the bootloader, firmware update over SysEx.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_sysex.h"
+#include "usb_conf.h"
+#include "boot_flash.h"
+#include "crc32.h"
+#include "sysex_update.h"
+#include "usb_pma.h"
+#include "ramfunc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SYSEX_EP_OUT_NUM                (SYSEX_EP_OUT & 0x7FU)
+#define SYSEX_EP_IN_NUM                 (SYSEX_EP_IN & 0x7FU)
+
+#define SYSEX_RESET_DELAY               20U     /* ms for the last ACK */
+#define SYSEX_BLOCKS_PER_PAGE           (BOOT_FLASH_PAGE / SYSEX_UPD_BLOCK)
+
+/* Payload offset of the packed data in DATA, after the block number */
+#define SYSEX_DATA_START                2U
+/* Groups of the block CRC at the end of DATA */
+#define SYSEX_CHECK_LEN                 5U
+
+/* Bytes carried by each Code Index Number, two bits each: SysEx
+   start/continue, ends and single bytes only, anything else is not ours.
+   A literal rather than a table, which RAM code could not read while the
+   flash is busy. */
+#define SYSEX_CIN_LENS                  ((3UL << 8) | (1UL << 10) | (2UL << 12) | (3UL << 14) | (1UL << 30))
+#define SYSEX_CIN_LEN(__EVT__)          ((SYSEX_CIN_LENS >> (2U * ((__EVT__) & 0x0FU))) & 3U)
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef *sx_pcd;
+static uint32_t sx_rx_buf[SYSEX_EP_SIZE / 4U];
+static uint32_t sx_tx_buf[4];           /* One ACK, four event packets */
+static __IO uint8_t sx_ready;
+static __IO uint8_t sx_tx_busy;
+static __IO uint8_t sx_ack_due;
+static uint8_t sx_ack_status;
+static uint16_t sx_limit;               /* Window last offered */
+
+/* Message decoder, USB interrupt only */
+static uint8_t sx_in;                   /* Inside a message for us */
+static uint16_t sx_pos;                 /* Bytes after F0 */
+static uint8_t sx_cmd;
+static uint32_t sx_arg;                 /* Number being received */
+static uint8_t sx_hold[SYSEX_CHECK_LEN]; /* Last payload bytes, the check */
+static uint8_t sx_held;
+static uint8_t sx_hold_pos;             /* Oldest held byte */
+static uint8_t *sx_dst;                 /* Block destination, NULL to skip */
+static uint16_t sx_count;               /* Bytes unpacked */
+static uint8_t sx_msb;
+static uint8_t sx_grp;
+
+/* Update session */
+static __IO uint8_t sx_session;
+static uint32_t sx_size;
+static uint16_t sx_blocks;
+static uint16_t sx_next;                /* Expected block */
+static uint8_t sx_nak;                  /* Error sent, ignoring until sx_next */
+static __IO uint8_t sx_end;             /* END received, waiting for the writer */
+static uint32_t sx_crc;
+static uint32_t sx_reset_tick;
+static uint8_t sx_reset;
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBD_SysEx_Init(PCD_HandleTypeDef *hpcd);
+static void USBD_SysEx_DeInit(PCD_HandleTypeDef *hpcd);
+static void USBD_SysEx_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+static void USBD_SysEx_DataOut(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+
+/* Exported variables --------------------------------------------------------*/
+const USBD_ClassTypeDef USBD_SYSEX =
+{
+  USBD_SysEx_Init,
+  USBD_SysEx_DeInit,
+  NULL,
+  NULL,
+  USBD_SysEx_DataIn,
+  USBD_SysEx_DataOut,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Send the pending ACK if the IN endpoint is idle. USB interrupt,
+  *         or main loop with it masked.
+  */
+static void USBD_SysEx_Flush(void)
+{
+  uint32_t limit;
+
+  if ((sx_ready == 0U) || (sx_tx_busy != 0U) || (sx_ack_due == 0U))
+  {
+    return;
+  }
+
+  /* Up to the last free page buffer, the one being filled included */
+  limit = (sx_next - sx_next % SYSEX_BLOCKS_PER_PAGE) + SYSEX_BLOCKS_PER_PAGE * BOOT_Flash_Free();
+  if ((sx_session == 0U) || (limit > sx_blocks))
+  {
+    limit = sx_blocks;
+  }
+  sx_limit = (uint16_t)limit;
+
+  sx_tx_buf[0] = 0x04U | (0xF0U << 8) | (SYSEX_UPD_MANUFACTURER << 16) | (SYSEX_UPD_DEVICE << 24);
+  sx_tx_buf[1] = 0x04U | (SYSEX_UPD_ACK << 8) | ((sx_next & 0x7FU) << 16) | (((sx_next >> 7) & 0x7FU) << 24);
+  sx_tx_buf[2] = 0x04U | ((limit & 0x7FU) << 8) | (((limit >> 7) & 0x7FU) << 16) | ((uint32_t)sx_ack_status << 24);
+  sx_tx_buf[3] = 0x05U | (0xF7U << 8);
+  sx_ack_due = 0;
+  sx_tx_busy = 1;
+  HAL_PCD_EP_Transmit(sx_pcd, SYSEX_EP_IN, (uint8_t *)sx_tx_buf, sizeof(sx_tx_buf));
+}
+
+/**
+  * @brief  Queue an ACK. ACKs are cumulative, so one waiting for the
+  *         endpoint is simply brought up to date, keeping an error.
+  */
+static void USBD_SysEx_Ack(uint8_t status)
+{
+  if ((sx_ack_due == 0U) || (sx_ack_status == SYSEX_UPD_OK))
+  {
+    sx_ack_status = status;
+  }
+  sx_ack_due = 1;
+  USBD_SysEx_Flush();
+}
+
+/**
+  * @brief  One payload byte of a DATA message after the block number:
+  *         unpack it into the page buffer.
+  */
+__RAM_INLINE void USBD_SysEx_Unpack(uint8_t b)
+{
+  if (sx_grp == 0U)
+  {
+    sx_msb = b;
+  }
+  else
+  {
+    if ((sx_dst != NULL) && (sx_count < SYSEX_UPD_BLOCK))
+    {
+      sx_dst[sx_count] = (uint8_t)(b | ((sx_msb << (8U - sx_grp)) & 0x80U));
+    }
+    sx_count++;
+  }
+  sx_grp = (uint8_t)((sx_grp + 1U) & 7U);
+}
+
+/**
+  * @brief  Payload byte n of a message.
+  */
+__RAM_INLINE void USBD_SysEx_Payload(uint32_t n, uint8_t b)
+{
+  if (sx_cmd != SYSEX_UPD_DATA)
+  {
+    /* Numbers of up to five groups */
+    if (n < 5U)
+    {
+      sx_arg |= (uint32_t)b << (7U * n);
+    }
+    return;
+  }
+
+  if (n < SYSEX_DATA_START)
+  {
+    sx_arg |= (uint32_t)b << (7U * n);
+    if (n == SYSEX_DATA_START - 1U)
+    {
+      /* Only the expected block is unpacked, into the buffer of its page */
+      sx_dst = NULL;
+      if ((sx_session != 0U) && (sx_arg == sx_next) && (sx_end == 0U))
+      {
+        sx_dst = (uint8_t *)BOOT_Flash_Slot();
+        if (sx_dst != NULL)
+        {
+          sx_dst += (sx_arg % SYSEX_BLOCKS_PER_PAGE) * SYSEX_UPD_BLOCK;
+        }
+      }
+    }
+    return;
+  }
+
+  /* The last bytes are the check: unpack each byte SYSEX_CHECK_LEN
+     behind, through a ring of the held ones */
+  if (sx_held == SYSEX_CHECK_LEN)
+  {
+    USBD_SysEx_Unpack(sx_hold[sx_hold_pos]);
+    sx_hold[sx_hold_pos] = b;
+    /* No division: the Cortex-M0 calls a library routine for it */
+    if (++sx_hold_pos == SYSEX_CHECK_LEN)
+    {
+      sx_hold_pos = 0;
+    }
+  }
+  else
+  {
+    sx_hold[sx_held++] = b;
+  }
+}
+
+/**
+  * @brief  The check received at the end of a DATA message.
+  */
+static uint32_t USBD_SysEx_Check(void)
+{
+  uint32_t check = 0;
+  uint32_t i;
+
+  for (i = 0; i < SYSEX_CHECK_LEN; i++)
+  {
+    check |= (uint32_t)sx_hold[(sx_hold_pos + i) % SYSEX_CHECK_LEN] << (7U * i);
+  }
+  return check;
+}
+
+/**
+  * @brief  A complete DATA message: accept the block if it is the expected
+  *         one, complete and intact, and queue its page once it is full.
+  *         The block CRC runs on the CRC unit, by DMA.
+  */
+static uint8_t USBD_SysEx_Block(void)
+{
+  uint32_t len;
+  uint32_t words;
+  uint32_t page;
+  uint32_t i;
+
+  if (sx_dst == NULL)
+  {
+    return SYSEX_UPD_ERR_SEQ;
+  }
+  len = sx_size - (uint32_t)sx_next * SYSEX_UPD_BLOCK;
+  if (len > SYSEX_UPD_BLOCK)
+  {
+    len = SYSEX_UPD_BLOCK;
+  }
+  if ((sx_held != SYSEX_CHECK_LEN) || (sx_count != len))
+  {
+    return SYSEX_UPD_ERR_CHECK;
+  }
+
+  /* Pad a short block with erased bytes, as the page writer does */
+  words = (len + 3U) / 4U;
+  for (i = len; i < 4U * words; i++)
+  {
+    sx_dst[i] = 0xFFU;
+  }
+  if (CRC32_Calc(CRC32_INIT, (const uint32_t *)(void *)sx_dst, words) != USBD_SysEx_Check())
+  {
+    return SYSEX_UPD_ERR_CHECK;
+  }
+
+  sx_next++;
+  if (((sx_next % SYSEX_BLOCKS_PER_PAGE) == 0U) || (sx_next == sx_blocks))
+  {
+    page = (sx_next - 1U) / SYSEX_BLOCKS_PER_PAGE;
+    len = sx_size - page * BOOT_FLASH_PAGE;
+    BOOT_Flash_Commit(page, (len > BOOT_FLASH_PAGE) ? BOOT_FLASH_PAGE : len);
+  }
+  return SYSEX_UPD_OK;
+}
+
+/**
+  * @brief  BEGIN: start a session for an image of sx_arg bytes. A session
+  *         still running is dropped first; its queued pages keep the
+  *         writer busy for a moment, and the host retries on BUSY.
+  */
+static uint8_t USBD_SysEx_Begin(void)
+{
+  if ((sx_arg < 8U) || (sx_arg > BOOT_APP_MAX))
+  {
+    return SYSEX_UPD_ERR_SIZE;
+  }
+  if (sx_session != 0U)
+  {
+    sx_session = 0;
+    BOOT_Flash_End();
+  }
+  if ((sx_end != 0U) || (BOOT_Flash_Begin(BOOT_FLASH_SYSEX) == 0U))
+  {
+    return SYSEX_UPD_BUSY;
+  }
+  sx_size = sx_arg;
+  sx_blocks = (uint16_t)((sx_size + SYSEX_UPD_BLOCK - 1U) / SYSEX_UPD_BLOCK);
+  sx_next = 0;
+  sx_nak = 0;
+  sx_session = 1;
+  return SYSEX_UPD_OK;
+}
+
+/**
+  * @brief  F7: act on a complete message.
+  */
+static void USBD_SysEx_Message(void)
+{
+  uint8_t status;
+
+  switch (sx_cmd)
+  {
+  case SYSEX_UPD_BEGIN:
+    USBD_SysEx_Ack(USBD_SysEx_Begin());
+    break;
+
+  case SYSEX_UPD_DATA:
+    status = USBD_SysEx_Block();
+    if (status == SYSEX_UPD_OK)
+    {
+      sx_nak = 0;
+      USBD_SysEx_Ack(status);
+    }
+    else if (sx_nak == 0U)
+    {
+      /* One error per gap; the blocks the host already has in flight
+         behind it are dropped silently */
+      sx_nak = 1;
+      USBD_SysEx_Ack(status);
+    }
+    break;
+
+  case SYSEX_UPD_END:
+    if ((sx_session != 0U) && (sx_next == sx_blocks))
+    {
+      /* Answered by USBD_SysEx_Poll() once the last page is written */
+      sx_crc = sx_arg;
+      sx_end = 1;
+    }
+    else
+    {
+      USBD_SysEx_Ack(SYSEX_UPD_ERR_SEQ);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+  * @brief  F0: start decoding a message.
+  */
+__RAM_INLINE void USBD_SysEx_Start(void)
+{
+  sx_in = 1;
+  sx_pos = 0;
+  sx_arg = 0;
+  sx_held = 0;
+  sx_hold_pos = 0;
+  sx_dst = NULL;
+  sx_count = 0;
+  sx_grp = 0;
+}
+
+/**
+  * @brief  One data byte inside a message: header, then payload. Runs from
+  *         SRAM, USBD_SysEx_RxPoll() needs it too.
+  */
+__RAM_FUNC static void USBD_SysEx_Data(uint8_t b)
+{
+  if (sx_pos == 0U)
+  {
+    sx_in = (b == SYSEX_UPD_MANUFACTURER);
+  }
+  else if (sx_pos == 1U)
+  {
+    sx_in = (b == SYSEX_UPD_DEVICE);
+  }
+  else if (sx_pos == 2U)
+  {
+    sx_cmd = b;
+  }
+  else
+  {
+    USBD_SysEx_Payload(sx_pos - (SYSEX_UPD_HEADER_LEN - 1U), b);
+  }
+  sx_pos++;
+}
+
+/**
+  * @brief  One MIDI byte from the host.
+  */
+static void USBD_SysEx_Byte(uint8_t b)
+{
+  if (b == 0xF0U)
+  {
+    USBD_SysEx_Start();
+    return;
+  }
+  if (sx_in == 0U)
+  {
+    return;
+  }
+  if (b == 0xF7U)
+  {
+    sx_in = 0;
+    if (sx_pos >= (SYSEX_UPD_HEADER_LEN - 1U))
+    {
+      USBD_SysEx_Message();
+    }
+    return;
+  }
+  if ((b & 0x80U) != 0U)
+  {
+    /* Any other status byte ends the message unfinished */
+    sx_in = 0;
+    return;
+  }
+  USBD_SysEx_Data(b);
+}
+
+static void USBD_SysEx_Init(PCD_HandleTypeDef *hpcd)
+{
+  sx_pcd = hpcd;
+
+  HAL_PCD_EP_Open(hpcd, SYSEX_EP_OUT, SYSEX_EP_SIZE, PCD_EP_TYPE_BULK);
+  HAL_PCD_EP_Open(hpcd, SYSEX_EP_IN, SYSEX_EP_SIZE, PCD_EP_TYPE_BULK);
+  sx_tx_busy = 0;
+  sx_in = 0;
+  sx_ready = 1;
+  HAL_PCD_EP_Receive(hpcd, SYSEX_EP_OUT, (uint8_t *)sx_rx_buf, SYSEX_EP_SIZE);
+}
+
+static void USBD_SysEx_DeInit(PCD_HandleTypeDef *hpcd)
+{
+  /* A session survives a bus reset, the host goes back to the last ACK */
+  sx_ready = 0;
+  sx_ack_due = 0;
+  HAL_PCD_EP_Close(hpcd, SYSEX_EP_OUT);
+  HAL_PCD_EP_Close(hpcd, SYSEX_EP_IN);
+}
+
+static void USBD_SysEx_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  UNUSED(hpcd);
+
+  if (epnum == SYSEX_EP_IN_NUM)
+  {
+    sx_tx_busy = 0;
+    USBD_SysEx_Flush();
+  }
+}
+
+static void USBD_SysEx_DataOut(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  uint32_t count;
+  uint32_t evt;
+  uint32_t len;
+  uint32_t i;
+  uint32_t j;
+
+  if (epnum != SYSEX_EP_OUT_NUM)
+  {
+    return;
+  }
+
+  count = HAL_PCD_EP_GetRxCount(hpcd, SYSEX_EP_OUT) / 4U;
+  for (i = 0; i < count; i++)
+  {
+    evt = sx_rx_buf[i];
+    len = SYSEX_CIN_LEN(evt);
+    for (j = 1; j <= len; j++)
+    {
+      USBD_SysEx_Byte((uint8_t)(evt >> (8U * j)));
+    }
+  }
+  HAL_PCD_EP_Receive(hpcd, SYSEX_EP_OUT, (uint8_t *)sx_rx_buf, SYSEX_EP_SIZE);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Take an OUT packet straight from packet memory, for the page
+  *         writer while the flash is busy and the HAL can not run. Only
+  *         packets of plain message data are taken: unpacking DATA into
+  *         its page buffer runs from SRAM, acting on a complete message
+  *         does not, so a packet with F7 or any status byte but F0 waits
+  *         for the HAL. USB interrupt masked.
+  * @retval None
+  */
+__RAM_FUNC void USBD_SysEx_RxPoll(void)
+{
+  USB_TypeDef *usb;
+  __IO uint16_t *pma;
+  uint32_t count;
+  uint32_t evt;
+  uint32_t len;
+  uint32_t i;
+  uint32_t j;
+  uint8_t b;
+
+  if (sx_ready == 0U)
+  {
+    return;
+  }
+  usb = sx_pcd->Instance;
+  if ((PCD_GET_ENDPOINT(usb, SYSEX_EP_OUT_NUM) & USB_EP_CTR_RX) == 0U)
+  {
+    return;
+  }
+  pma = USBD_PMA_PTR(sx_pcd->OUT_ep[SYSEX_EP_OUT_NUM].pmaadress);
+  count = PCD_GET_EP_RX_CNT(usb, SYSEX_EP_OUT_NUM) / 4U;
+
+  for (i = 0; i < count; i++)
+  {
+    evt = USBD_PMA_ReadEvent(pma + 2U * i);
+    len = SYSEX_CIN_LEN(evt);
+    for (j = 1; j <= len; j++)
+    {
+      b = (uint8_t)(evt >> (8U * j));
+      if (((b & 0x80U) != 0U) && (b != 0xF0U))
+      {
+        return;
+      }
+    }
+  }
+
+  /* The HAL endpoint state is left alone: it still describes the last
+     HAL_PCD_EP_Receive() into sx_rx_buf, which is what the HAL path
+     expects should it take the next packet */
+  PCD_CLEAR_RX_EP_CTR(usb, SYSEX_EP_OUT_NUM);
+  for (i = 0; i < count; i++)
+  {
+    evt = USBD_PMA_ReadEvent(pma + 2U * i);
+    len = SYSEX_CIN_LEN(evt);
+    for (j = 1; j <= len; j++)
+    {
+      b = (uint8_t)(evt >> (8U * j));
+      if (b == 0xF0U)
+      {
+        USBD_SysEx_Start();
+      }
+      else if (sx_in != 0U)
+      {
+        USBD_SysEx_Data(b);
+      }
+    }
+  }
+  /* COUNTn_RX keeps its block size, only the status needs setting */
+  PCD_SET_EP_RX_STATUS(usb, SYSEX_EP_OUT_NUM, USB_EP_RX_VALID);
+}
+
+/**
+  * @brief  Follow the page writer: widen the window as pages are written,
+  *         report its errors and finish the session once END has arrived
+  *         and every page is written. Call from the main loop, after
+  *         BOOT_Flash_Poll().
+  * @retval None
+  */
+void USBD_SysEx_Poll(void)
+{
+  uint8_t status;
+
+  if (sx_reset != 0U)
+  {
+    if ((HAL_GetTick() - sx_reset_tick) >= SYSEX_RESET_DELAY)
+    {
+      NVIC_SystemReset();
+    }
+    return;
+  }
+  if (sx_session == 0U)
+  {
+    return;
+  }
+
+  NVIC_DisableIRQ(USB_IRQn);
+  if (BOOT_Flash_Status() != BOOT_FLASH_OK)
+  {
+    sx_session = 0;
+    sx_end = 0;
+    BOOT_Flash_End();
+    USBD_SysEx_Ack(SYSEX_UPD_ERR_FLASH);
+  }
+  else if ((sx_end == 0U) && (sx_limit < sx_blocks) &&
+           ((sx_next - sx_next % SYSEX_BLOCKS_PER_PAGE) + SYSEX_BLOCKS_PER_PAGE * BOOT_Flash_Free() > sx_limit))
+  {
+    USBD_SysEx_Ack(SYSEX_UPD_OK);
+  }
+  NVIC_EnableIRQ(USB_IRQn);
+
+  if ((sx_end == 0U) || (BOOT_Flash_Queued() != 0U))
+  {
+    return;
+  }
+
+  if (BOOT_Flash_Crc() != sx_crc)
+  {
+    BOOT_Flash_End();
+    status = SYSEX_UPD_ERR_CRC;
+  }
+  else if (BOOT_Flash_Finish() != BOOT_FLASH_OK)
+  {
+    status = SYSEX_UPD_ERR_FLASH;
+  }
+  else
+  {
+    status = SYSEX_UPD_DONE;
+    sx_reset_tick = HAL_GetTick();
+    sx_reset = 1;
+  }
+
+  NVIC_DisableIRQ(USB_IRQn);
+  sx_session = 0;
+  sx_end = 0;
+  USBD_SysEx_Ack(status);
+  NVIC_EnableIRQ(USB_IRQn);
+}
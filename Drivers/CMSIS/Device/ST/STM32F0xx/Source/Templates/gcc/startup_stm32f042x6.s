@@ -113,6 +113,23 @@ LoopCopyDataInit:
   adds r2, r0, r1
   cmp r2, r3
   bcc CopyDataInit
+
+/* Copy the RAM functions from flash to SRAM */
+  movs r1, #0
+  b LoopCopyRamfunc
+
+CopyRamfunc:
+  ldr r3, =_siramfunc
+  ldr r3, [r3, r1]
+  str r3, [r0, r1]
+  adds r1, r1, #4
+
+LoopCopyRamfunc:
+  ldr r0, =_sramfunc
+  ldr r3, =_eramfunc
+  adds r2, r0, r1
+  cmp r2, r3
+  bcc CopyRamfunc
   ldr r2, =_sbss
   b LoopFillZerobss
 /* Zero fill the bss segment. */
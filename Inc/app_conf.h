@@ -0,0 +1,201 @@
+/**
+  ******************************************************************************
+  * @file    app_conf.h
+  * @brief   Application configuration file.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __APP_CONF_H
+#define __APP_CONF_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* ########################## Instrumentation ############################### */
+/**
+  * @brief Set to 1 to record ISR enter/exit events into the trace ring.
+  *        When 0 every TRACE_xxx probe compiles to nothing.
+  */
+#define  TRACE_ENABLED                0
+
+/**
+  * @brief Number of 32-bit entries in the trace ring, must be a power of 2.
+  */
+#define  TRACE_RING_SIZE              64
+
+/* ########################## MIDI Ports #################################### */
+/**
+  * @brief Port list, one X(id, name, driver) entry per port in cable order:
+  *        port n is exposed as USB-MIDI cable n, its name becomes the jack
+  *        string and driver is the MIDI_DriverTypeDef that serves it.
+  *        The USB descriptors and the port queues are generated from this
+  *        list. What reaches a port, and where its input goes, is set by
+  *        MIDI_ROUTE_LIST. Available drivers:
+  *          MIDI_DIN_Driver       DIN socket on USART2 (PA2 TX, PA3 RX)
+  *          MIDI_Loopback_Driver  input is whatever is routed to the port
+  *          MIDI_Monitor_Driver   the same, meant for copies of other traffic
+  *          MIDI_System_Driver    restarts into the bootloader on request
+  */
+#define  MIDI_PORT_LIST(X)                                                    \
+  X(DIN,      "DIN",      MIDI_DIN_Driver)                                    \
+  X(LOOPBACK, "Loopback", MIDI_Loopback_Driver)                               \
+  X(MONITOR,  "Monitor",  MIDI_Monitor_Driver)                                \
+  X(SYSTEM,   "System",   MIDI_System_Driver)
+
+/**
+  * @brief Number of entries in MIDI_PORT_LIST, at most 16.
+  */
+#define  MIDI_PORT_COUNT              4
+
+/**
+  * @brief Routing rules, one X(source, classes, channels, destinations,
+  *        transform) entry per rule (midi_route.h). Sources are
+  *        MIDI_FROM_HOST(cable) and MIDI_FROM_PORT(port), classes
+  *        MIDI_CLASS_xxx bits, channels MIDI_CHANNELS(first, last) or
+  *        MIDI_CHANNELS_ALL, destinations MIDI_TO_PORT(port) and
+  *        MIDI_TO_HOST(cable) bits, transform MIDI_XFORM_<id> from
+  *        MIDI_XFORM_LIST or MIDI_XFORM_NONE. Messages matching several
+  *        rules go to every destination. A DIN thru, for example:
+  *          X(MIDI_FROM_PORT(MIDI_PORT_DIN), MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,
+  *            MIDI_TO_PORT(MIDI_PORT_DIN), MIDI_XFORM_NONE)
+  */
+#define  MIDI_ROUTE_LIST(X)                                                   \
+  X(MIDI_FROM_HOST(MIDI_PORT_DIN),      MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_PORT(MIDI_PORT_DIN) | MIDI_TO_PORT(MIDI_PORT_MONITOR),            \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_HOST(MIDI_PORT_LOOPBACK), MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_PORT(MIDI_PORT_LOOPBACK) | MIDI_TO_PORT(MIDI_PORT_MONITOR),       \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_HOST(MIDI_PORT_MONITOR),  MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_PORT(MIDI_PORT_MONITOR),                                          \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_HOST(MIDI_PORT_SYSTEM),   MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_PORT(MIDI_PORT_SYSTEM) | MIDI_TO_PORT(MIDI_PORT_MONITOR),         \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_PORT(MIDI_PORT_DIN),      MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_HOST(MIDI_PORT_DIN),                                              \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_PORT(MIDI_PORT_LOOPBACK), MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_HOST(MIDI_PORT_LOOPBACK),                                         \
+    MIDI_XFORM_NONE)                                                          \
+  X(MIDI_FROM_PORT(MIDI_PORT_MONITOR),  MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,    \
+    MIDI_TO_HOST(MIDI_PORT_MONITOR),                                          \
+    MIDI_XFORM_NONE)
+
+/**
+  * @brief Port filters, one X(port, input classes, input channels, output
+  *        classes, output channels) entry per port that filters, in the
+  *        terms of MIDI_ROUTE_LIST. Input filters apply to what the port
+  *        receives, before any rule; output filters to what the rules send
+  *        to the port. Ports not listed, and the host's cables, pass
+  *        everything. The list is compiled in and applies to stored
+  *        rules as well; it cannot be changed over USB. A DIN port that
+  *        keeps Active Sensing and poly pressure off the wire and only
+  *        sends channels 1 to 10:
+  *          X(MIDI_PORT_DIN, MIDI_CLASS_ALL, MIDI_CHANNELS_ALL,
+  *            MIDI_CLASS_ALL & ~(MIDI_CLASS_ACTIVE_SENSING |
+  *            MIDI_CLASS_POLY_PRESSURE), MIDI_CHANNELS(0, 9))
+  */
+#define  MIDI_FILTER_LIST(X)
+
+/**
+  * @brief Distinct rows of 16 destination masks each of the two compiled
+  *        routing tables holds, row 0 included. Every source uses up to 16
+  *        rows, one per USB-MIDI code index number, and identical rows are
+  *        shared.
+  */
+#define  MIDI_ROUTE_ROWS              12
+
+/**
+  * @brief Transforms the rules may name, one X(id, parameters) entry per
+  *        transform (midi_xform.h). Parameters are designated initialisers
+  *        of MIDI_XformTypeDef; the ones left out change nothing. Rules
+  *        refer to them as MIDI_XFORM_<id>. Two octaves up within the range
+  *        of a piano, for example:
+  *          X(PIANO_UP, .Transpose = 24, .NoteLo = 21, .NoteHi = 108)
+  */
+#define  MIDI_XFORM_LIST(X)
+
+/**
+  * @brief Transforms per rule set, and 128-byte transform tables a rule set
+  *        may take between all its transforms. Each parameter group a
+  *        transform changes (channel, notes, velocities, controller number,
+  *        controller values) takes a table; equal ones are shared. The pool
+  *        holds the identity table and room for two rule sets, the one in
+  *        use and the one replacing it, so a rule set within
+  *        MIDI_XFORM_TABLES can always be switched to at run time. The
+  *        PIANO_UP example above takes one; a softer touch as well
+  *        (.VelCurve = 4) would take a second.
+  */
+#define  MIDI_XFORMS                  4
+#define  MIDI_XFORM_TABLES            1
+#define  MIDI_XFORM_LUTS              (1 + (2 * MIDI_XFORM_TABLES))
+
+/**
+  * @brief Events buffered per port on the way from USB to the port, must be
+  *        a power of 2.
+  */
+#define  MIDI_OUT_QUEUE_SIZE          16
+
+/**
+  * @brief USB OUT flow control. Once any port queue holds more than
+  *        MIDI_OUT_QUEUE_HIGH events the MIDI OUT endpoint is left in NAK,
+  *        it is re-armed when every queue is down to MIDI_OUT_QUEUE_LOW.
+  *        HIGH must leave room for one full packet (16 events) to stay
+  *        lossless; with 16-event queues the endpoint takes a packet once
+  *        every queue is empty.
+  */
+#define  MIDI_OUT_QUEUE_HIGH          (MIDI_OUT_QUEUE_SIZE - 16)
+#define  MIDI_OUT_QUEUE_LOW           (MIDI_OUT_QUEUE_HIGH / 2)
+
+/* ########################## Scheduler ##################################### */
+/**
+  * @brief Main loop tasks, one X(id, function) entry per task, highest
+  *        priority first. Interrupts post SCHED_EVT_<id>; the loop runs the
+  *        highest priority posted task, then looks again, and sleeps in
+  *        WFI once nothing is posted.
+  */
+#define  SCHED_TASK_LIST(X)                                                   \
+  X(MIDI,     MIDI_Port_Poll)                                                 \
+  X(VENDOR,   USBD_Vendor_Poll)                                               \
+  X(POWER,    USBD_Power_Poll)                                                \
+  X(JOBS,     PT_Poll)
+
+/**
+  * @brief Set to 1 to run the tasks from PendSV with sleep-on-exit instead
+  *        of from the main loop: the core then only ever leaves sleep to
+  *        run interrupt handlers.
+  */
+#define  SCHED_SLEEP_ON_EXIT          0
+
+/* ########################## Configuration ################################# */
+/**
+  * @brief Configuration log keys and largest value in bytes. Every key at
+  *        its largest, plus one more record, must fit in one 1 KB page.
+  */
+#define  CFG_KEY_COUNT                12
+#define  CFG_VALUE_MAX                64
+
+/**
+  * @brief First configuration log key of the stored routing rules and the
+  *        number of keys they may take (midi_route.h). The stored transforms
+  *        take the key after them.
+  */
+#define  MIDI_ROUTE_CFG_KEY           0
+#define  MIDI_ROUTE_CFG_KEYS          4
+
+/* ########################## Telemetry ##################################### */
+/**
+  * @brief Number of log2 microsecond buckets in each latency histogram.
+  *        Bucket 0 counts 0 us, bucket n counts [2^(n-1), 2^n) us and the
+  *        last bucket also collects everything above its range.
+  */
+#define  TELEM_LATENCY_BUCKETS        16
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APP_CONF_H */
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    boot.h
+  * @brief   Flash layout shared by the DFU bootloader (Boot/) and the
+  *          application.
+  *
+  *          0x08000000  bootloader, 8 KB
+  *          0x08002000  application, linked here (STM32F042F6Px_FLASH.ld)
+  *          0x080077F0  image trailer, written last by the bootloader
+  *          0x08007800  configuration log, two pages (cfg_log.c)
+  *
+  *          At reset the bootloader starts the application unless BOOT is
+  *          held, the application asked for DFU through the request word at
+  *          the top of SRAM, or the image does not match its trailer. The
+  *          request word survives the system reset; both linker scripts
+  *          keep it out of the stack.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define BOOT_SIZE                       0x2000U
+#define BOOT_APP_BASE                   (FLASH_BASE + BOOT_SIZE)
+#define BOOT_APP_END                    0x08007800U  /*!< Configuration log from here */
+#define BOOT_TRAILER_ADDR               (BOOT_APP_END - sizeof(BOOT_TrailerTypeDef))
+#define BOOT_APP_MAX                    (BOOT_TRAILER_ADDR - BOOT_APP_BASE)
+
+#define BOOT_TRAILER_MAGIC              0xB007C0DEU
+#define BOOT_REQUEST_DFU                0xDF11B007U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Image trailer, in the last 16 bytes of the application region.
+  *         Crc is the CRC unit's CRC-32 (poly 0x04C11DB7, init all ones, no
+  *         reflection) over Size bytes from BOOT_APP_BASE, rounded up to
+  *         whole words. Magic is programmed last and cleared first.
+  */
+typedef struct
+{
+  uint32_t Size;
+  uint32_t Crc;
+  uint32_t Reserved;
+  uint32_t Magic;                          /*!< BOOT_TRAILER_MAGIC              */
+} BOOT_TrailerTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern __IO uint32_t _sboot_flag;          /*!< Linker script: boot request word */
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Restart into the bootloader and stay there for a DFU download.
+  * @retval Does not return
+  */
+static inline void BOOT_EnterDfu(void)
+{
+  _sboot_flag = BOOT_REQUEST_DFU;
+  __DSB();
+  NVIC_SystemReset();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOT_H */
@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file    cfg_log.h
+  * @brief   Configuration log: a key/value store in the two flash pages
+  *          reserved at the end of the FLASH region (CONFIG in the linker
+  *          script).
+  *
+  *          One page is active at a time and only ever appended to. A
+  *          record is a header halfword (key << 8 | length in bytes), the
+  *          value padded to halfwords and a check halfword written last,
+  *          so a record torn by a power cut fails its check and is skipped.
+  *          The newest valid record of a key wins; length 0 deletes it.
+  *
+  *          Once the active page is full the live records are copied to
+  *          the other page, which becomes active when its header, written
+  *          last, carries the next sequence number. The pages take turns,
+  *          which spreads the erase cycles over both.
+  *
+  *          Values are read in place: CFG_Get() returns a pointer into
+  *          flash that stays valid until the next CFG_Set() completes.
+  *          Writes run in the background through the flash writer (nvm.h),
+  *          one at a time.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CFG_LOG_H
+#define __CFG_LOG_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+
+/* Exported functions ------------------------------------------------------- */
+void              CFG_Init(void);
+const void       *CFG_Get(uint32_t key, uint32_t *len);
+HAL_StatusTypeDef CFG_Set(uint32_t key, const void *data, uint32_t len);
+HAL_StatusTypeDef CFG_Delete(uint32_t key);
+HAL_StatusTypeDef CFG_Status(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CFG_LOG_H */
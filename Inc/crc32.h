@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    crc32.h
+  * @brief   CRC-32 service on the CRC unit, shared by the application and
+  *          the bootloader.
+  *
+  *          The CRC of the CRC unit in its reset configuration: polynomial
+  *          0x04C11DB7, no reflection, no final XOR, data taken as whole
+  *          words (or halfwords) in memory order. A CRC is built piecewise
+  *          by passing the previous result back in; CRC32_INIT starts one.
+  *
+  *          Runs of CRC32_DMA_MIN words and more are fed to the unit by DMA1
+  *          channel 1 in memory-to-memory mode while the core waits in WFE,
+  *          woken by the pending transfer-complete interrupt (SEVONPEND;
+  *          the interrupt itself stays disabled). Shorter runs are written
+  *          by the core.
+  *
+  *          There is one unit: calls from different contexts must not
+  *          overlap. Host builds, and builds defining CRC32_SOFTWARE, get a
+  *          bitwise implementation with the same results.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CRC32_H
+#define __CRC32_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define CRC32_INIT                      0xFFFFFFFFU
+#define CRC32_POLY                      0x04C11DB7U
+#define CRC32_DMA_MIN                   32U     /*!< Words, shorter runs use the core */
+
+#if !defined(__arm__) && !defined(CRC32_SOFTWARE)
+#define CRC32_SOFTWARE
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+void     CRC32_Init(void);
+void     CRC32_DeInit(void);
+uint32_t CRC32_Calc(uint32_t crc, const uint32_t *p, uint32_t n);
+uint32_t CRC32_Calc16(uint32_t crc, const uint16_t *p, uint32_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CRC32_H */
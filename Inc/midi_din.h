@@ -0,0 +1,38 @@
+/**
+  ******************************************************************************
+  * @file    midi_din.h
+  * @brief   DIN MIDI port on USART2 (PA2 TX, PA3 RX) at 31250 baud.
+  *          Both directions use DMA: RX runs continuously into a circular
+  *          buffer, TX sends one batch of serialised events at a time.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_DIN_H
+#define __MIDI_DIN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "midi_port.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MIDI_DIN_BAUDRATE     31250U
+/* 128 bytes last 40 ms at 31250 baud, the longest page erase (nvm.h) */
+#define MIDI_DIN_RX_SIZE      128U       /*!< Circular RX buffer, power of 2 */
+#define MIDI_DIN_TX_SIZE      48U        /*!< Bytes per TX DMA batch         */
+
+/* Exported variables --------------------------------------------------------*/
+extern const MIDI_DriverTypeDef MIDI_DIN_Driver;
+
+/* Exported functions ------------------------------------------------------- */
+void MIDI_DIN_USART_IRQHandler(void);
+void MIDI_DIN_DMA_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_DIN_H */
@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    midi_port.h
+  * @brief   MIDI ports and their routing.
+  *
+  *          Every port in MIDI_PORT_LIST owns cable n on both USB endpoints.
+  *          Events from the host and from the port inputs go through the
+  *          compiled routing table (midi_route.h) to any number of port
+  *          output queues and host cables. The USB interrupt produces into
+  *          the port queues; the main loop only does so, for routes from
+  *          port to port, with interrupts masked around the put.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_PORT_H
+#define __MIDI_PORT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "midi_queue.h"
+#include "midi_route.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MIDI_PORT_ENUM(__ID__, __NAME__, __DRV__)   MIDI_PORT_##__ID__,
+
+/* Port ids, MIDI_PORT_xxx equals the cable number */
+enum
+{
+  MIDI_PORT_LIST(MIDI_PORT_ENUM)
+  MIDI_PORT_LIST_COUNT
+};
+
+#if (MIDI_PORT_COUNT < 1) || (MIDI_PORT_COUNT > 16)
+#error "MIDI_PORT_COUNT must be between 1 and 16"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  A port driver. The same driver may serve several ports; port is
+  *         the MIDI_PORT_xxx id, which is also the cable number.
+  */
+typedef struct
+{
+  void (*Init)(uint32_t port);
+  void (*Poll)(uint32_t port);          /*!< Called from the main loop */
+} MIDI_DriverTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern MIDI_QueueTypeDef *MIDI_PortOut[MIDI_PORT_COUNT];
+
+extern const MIDI_DriverTypeDef MIDI_Loopback_Driver;
+extern const MIDI_DriverTypeDef MIDI_Monitor_Driver;
+extern const MIDI_DriverTypeDef MIDI_System_Driver;
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Queue one event from the host for every port its route names.
+  *         Runs in the USB interrupt. Events no route takes are counted in
+  *         TELEM.Unrouted.
+  * @param  evt: USB-MIDI event packet
+  * @retval None
+  */
+__RAM_INLINE void MIDI_Port_Route(uint32_t evt)
+{
+  const MIDI_RouteTableTypeDef *t = MIDI_Route;
+  uint32_t src = t->Cable[(evt >> 4) & 0x0FU];
+  uint32_t mask = MIDI_Route_Lookup(t, src, evt);
+  uint32_t port;
+
+  TELEM.Unrouted += (mask == 0U);
+  for (port = 0; mask != 0U; port++, mask >>= 1)
+  {
+    if ((mask & 1U) == 0U)
+    {
+      continue;
+    }
+    if (MIDI_QueuePut(MIDI_PortOut[port], MIDI_Route_Transform(t, src, port, evt)) == 0U)
+    {
+      TELEM_DROP(port, TELEM_DROP_QUEUE_FULL);
+      TRACE_MARK(TRACE_ID_QUEUE_DROP);
+    }
+    else if (port == MIDI_PORT_DIN)
+    {
+      /* The DIN writer runs below the USB interrupt: stamp after the put */
+      TELEM_LatencyStart(TELEM_PATH_USB_TO_PORT, (uint16_t)(MIDI_PortOut[port]->Head - 1U));
+    }
+  }
+  TRACE_MARK(TRACE_ID_QUEUE_PUT);
+}
+
+void MIDI_Port_Init(void);
+void MIDI_Port_Poll(void);
+void MIDI_Port_Input(uint32_t port, uint32_t evt);
+uint32_t MIDI_Port_EchoMask(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_PORT_H */
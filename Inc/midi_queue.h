@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file    midi_queue.h
+  * @brief   Single producer / single consumer queue of 32-bit USB-MIDI event
+  *          packets. Head is written only by the producer and Tail only by
+  *          the consumer, so neither side needs to mask interrupts.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_QUEUE_H
+#define __MIDI_QUEUE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "ramfunc.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint16_t Head;       /*!< Next slot to write, producer owned */
+  __IO uint16_t Tail;       /*!< Next slot to read, consumer owned  */
+  uint16_t      Mask;       /*!< Capacity - 1, capacity is 2^n      */
+  uint16_t     *Hwm;        /*!< High-water mark, usually in TELEM  */
+  uint32_t     *Buf;
+} MIDI_QueueTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief  Define a queue and its storage. __SIZE__ must be a power of 2,
+  *         __HWM__ points to the uint16_t that tracks its high-water mark.
+  */
+#define MIDI_QUEUE_DEFINE(__NAME__, __SIZE__, __HWM__)                         \
+  static uint32_t __NAME__##_buf[(__SIZE__)];                                  \
+  MIDI_QueueTypeDef __NAME__ = { 0, 0, (__SIZE__) - 1, (__HWM__), __NAME__##_buf }
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Number of events waiting in the queue.
+  */
+__RAM_INLINE uint32_t MIDI_QueueLevel(const MIDI_QueueTypeDef *q)
+{
+  return (uint16_t)(q->Head - q->Tail);
+}
+
+/**
+  * @brief  Free slots left in the queue.
+  */
+__RAM_INLINE uint32_t MIDI_QueueSpace(const MIDI_QueueTypeDef *q)
+{
+  return (uint32_t)q->Mask + 1U - MIDI_QueueLevel(q);
+}
+
+/**
+  * @brief  Append one event (producer side).
+  * @retval 1 if queued, 0 if the queue was full
+  */
+__RAM_INLINE uint32_t MIDI_QueuePut(MIDI_QueueTypeDef *q, uint32_t evt)
+{
+  uint16_t head = q->Head;
+  uint32_t level = (uint16_t)(head - q->Tail);
+
+  if (level > q->Mask)
+  {
+    return 0;
+  }
+  q->Buf[head & q->Mask] = evt;
+  q->Head = head + 1U;
+  if (level >= *q->Hwm)
+  {
+    *q->Hwm = (uint16_t)(level + 1U);
+  }
+  return 1;
+}
+
+/**
+  * @brief  Remove one event (consumer side).
+  * @retval 1 if *evt was filled, 0 if the queue was empty
+  */
+__RAM_INLINE uint32_t MIDI_QueueGet(MIDI_QueueTypeDef *q, uint32_t *evt)
+{
+  uint16_t tail = q->Tail;
+
+  if (tail == q->Head)
+  {
+    return 0;
+  }
+  *evt = q->Buf[tail & q->Mask];
+  q->Tail = tail + 1U;
+  return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_QUEUE_H */
@@ -0,0 +1,250 @@
+/**
+  ******************************************************************************
+  * @file    midi_route.h
+  * @brief   Routing matrix, compiled into flat lookup tables.
+  *
+  *          Sources are the host's cables (events from the MIDI OUT
+  *          endpoint) and the inputs of the ports (a DIN receiver, the
+  *          echo of the loopback and monitor ports). Destinations are the
+  *          port output queues and the host's cables. A rule sends the
+  *          messages of one source whose class is in Classes and, for
+  *          channel messages, whose channel is in Channels to every
+  *          destination in Dst; rules add up, so a message fans out to the
+  *          union of the rules it matches.
+  *
+  *          A rule set compiles into three tables:
+  *            Cable[cable]      host cable -> source
+  *            Index[src][cin]   source and code index number -> row
+  *            Row[row][col]     -> destination mask
+  *          where col is the low nibble of the first MIDI byte: the
+  *          channel of a channel message, the status of a system one. A
+  *          packet is routed with the same three loads however many rules
+  *          there are. Identical rows are stored once, MIDI_ROUTE_ROWS of
+  *          them at most; row 0 routes nowhere.
+  *
+  *          The host's cables are routed in the USB interrupt, which only
+  *          feeds the port queues: to send host traffic back to the host,
+  *          route it through the loopback port. The loopback and monitor
+  *          ports echo their output as input, so a rule set in which they
+  *          route back into themselves, directly or through each other,
+  *          does not compile.
+  *
+  *          There are two tables. MIDI_Route points to the one in use; the
+  *          other is where MIDI_Route_Apply() builds the next rule set, a
+  *          source per job step, before publishing it with one pointer
+  *          store. A lookup loads the pointer once, so it sees either table
+  *          whole. Lookups run in the USB interrupt and in the main loop,
+  *          never at a priority below the builder's, so none of them can
+  *          be half way through the old table when the builder next runs:
+  *          that next step is the quiescent point after which the old
+  *          table is rebuilt. Traffic is never held up by a rebuild.
+  *
+  *          Each port may filter what enters it and what leaves it by
+  *          class and channel (MIDI_FILTER_LIST). Filters are folded into
+  *          the rules as they compile, so filtered messages find no
+  *          destination: they cost nothing at run time and never take up
+  *          room in a queue or time on a DIN wire. Filters are fixed at
+  *          build time: they are not stored in the configuration log, a
+  *          switch to stored rules (SET_ROUTES, APPLY_ROUTES) keeps them
+  *          as they are, and the host's cables have none, so rules from
+  *          and to the host are only narrowed by their own classes and
+  *          channels.
+  *
+  *          A rule may name a transform (midi_xform.h) for what it sends.
+  *          Transforms belong to a source and destination pair: the table
+  *          keeps one per pair, that of the last rule naming one, and it
+  *          applies to whatever takes that way.
+  *
+  *          The rule set is MIDI_ROUTE_LIST and MIDI_XFORM_LIST, unless
+  *          rules are stored in the configuration log under
+  *          MIDI_ROUTE_CFG_KEY and the keys after it, MIDI_ROUTE_CFG_RULES
+  *          rules per key; then those replace it, with the transforms
+  *          stored under MIDI_ROUTE_CFG_XFORM_KEY.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_ROUTE_H
+#define __MIDI_ROUTE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "midi_xform.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MIDI_CABLES           16U
+
+/* Message classes: channel messages by status nibble, system messages by
+   the low nibble of their status. F7 counts as SysEx. */
+#define MIDI_CLASS_NOTE_OFF       (1UL << 0x08)
+#define MIDI_CLASS_NOTE_ON        (1UL << 0x09)
+#define MIDI_CLASS_POLY_PRESSURE  (1UL << 0x0A)
+#define MIDI_CLASS_CONTROL        (1UL << 0x0B)
+#define MIDI_CLASS_PROGRAM        (1UL << 0x0C)
+#define MIDI_CLASS_PRESSURE       (1UL << 0x0D)
+#define MIDI_CLASS_PITCH_BEND     (1UL << 0x0E)
+#define MIDI_CLASS_SYSEX          (1UL << 0x10)
+#define MIDI_CLASS_MTC            (1UL << 0x11)
+#define MIDI_CLASS_SONG_POSITION  (1UL << 0x12)
+#define MIDI_CLASS_SONG_SELECT    (1UL << 0x13)
+#define MIDI_CLASS_TUNE_REQUEST   (1UL << 0x16)
+#define MIDI_CLASS_CLOCK          (1UL << 0x18)
+#define MIDI_CLASS_START          (1UL << 0x1A)
+#define MIDI_CLASS_CONTINUE       (1UL << 0x1B)
+#define MIDI_CLASS_STOP           (1UL << 0x1C)
+#define MIDI_CLASS_ACTIVE_SENSING (1UL << 0x1E)
+#define MIDI_CLASS_RESET          (1UL << 0x1F)
+#define MIDI_CLASS_CHANNEL        0x00007F00UL
+#define MIDI_CLASS_SYSTEM         0xFFFF0000UL
+#define MIDI_CLASS_ALL            (MIDI_CLASS_CHANNEL | MIDI_CLASS_SYSTEM)
+
+#define MIDI_CHANNELS_ALL         0xFFFFU
+
+/* Sources and destinations of a rule */
+#define MIDI_ROUTE_FROM_PORT_FLAG 0x10U
+
+/* Sources of the compiled tables: the host's cables of the ports, the
+   ports' inputs, then one that routes nowhere */
+#define MIDI_ROUTE_SOURCES        (2U * MIDI_PORT_COUNT + 1U)
+#define MIDI_ROUTE_SRC_NONE       (2U * MIDI_PORT_COUNT)
+
+/* Stored rules: per configuration log key, and in all */
+#define MIDI_ROUTE_CFG_RULES      (CFG_VALUE_MAX / sizeof(MIDI_RouteRuleTypeDef))
+#define MIDI_ROUTE_CFG_MAX        (MIDI_ROUTE_CFG_KEYS * MIDI_ROUTE_CFG_RULES)
+#define MIDI_ROUTE_CFG_XFORM_KEY  (MIDI_ROUTE_CFG_KEY + MIDI_ROUTE_CFG_KEYS)
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief  Channels __LO__ to __HI__, 0 based.
+  */
+#define MIDI_CHANNELS(__LO__, __HI__)                                          \
+  ((uint16_t)((0xFFFFUL << (__LO__)) & (0xFFFFUL >> (15U - (__HI__)))))
+
+#define MIDI_FROM_HOST(__CABLE__) ((uint8_t)(__CABLE__))
+#define MIDI_FROM_PORT(__PORT__)  ((uint8_t)(MIDI_ROUTE_FROM_PORT_FLAG | (__PORT__)))
+#define MIDI_TO_PORT(__PORT__)    (1UL << (__PORT__))
+#define MIDI_TO_HOST(__CABLE__)   (1UL << (16U + (__CABLE__)))
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  Src;           /*!< MIDI_FROM_HOST(cable) or MIDI_FROM_PORT(port)   */
+  uint8_t  Xform;         /*!< Transform id, MIDI_XFORM_NONE for none          */
+  uint16_t Channels;      /*!< Channel bits, for channel messages              */
+  uint32_t Classes;       /*!< MIDI_CLASS_xxx bits                             */
+  uint32_t Dst;           /*!< MIDI_TO_PORT() and MIDI_TO_HOST() bits          */
+} MIDI_RouteRuleTypeDef;
+
+/**
+  * @brief  What a port filter lets through: messages whose class is in
+  *         Classes and, for channel messages, whose channel is in Channels.
+  */
+typedef struct
+{
+  uint32_t Classes;       /*!< MIDI_CLASS_xxx bits                             */
+  uint16_t Channels;      /*!< Channel bits                                    */
+} MIDI_RouteFilterTypeDef;
+
+/**
+  * @brief  Destination mask of a compiled row: bit n for the output queue
+  *         of port n, bit MIDI_PORT_COUNT + n for host cable n.
+  */
+#if (MIDI_PORT_COUNT <= 4)
+typedef uint8_t  MIDI_RouteMaskTypeDef;
+#elif (MIDI_PORT_COUNT <= 8)
+typedef uint16_t MIDI_RouteMaskTypeDef;
+#else
+typedef uint32_t MIDI_RouteMaskTypeDef;
+#endif
+
+typedef struct
+{
+  uint8_t Cable[MIDI_CABLES];
+  uint8_t Index[MIDI_ROUTE_SOURCES][16];
+  MIDI_RouteMaskTypeDef Row[MIDI_ROUTE_ROWS][16];
+  uint8_t Rows;           /*!< Rows in use                                     */
+  uint8_t Xform[MIDI_ROUTE_SRC_NONE][2U * MIDI_PORT_COUNT];  /*!< By source and
+                               destination bit, 0 for none                     */
+  MIDI_XformLutsTypeDef Xf[MIDI_XFORMS + 1U];   /*!< By transform id           */
+} MIDI_RouteTableTypeDef;
+
+/**
+  * @brief  Rule source for the compiler: fill *rule with rule i. Rules are
+  *         fetched more than once.
+  */
+typedef void (*MIDI_RouteGetTypeDef)(uint32_t i, MIDI_RouteRuleTypeDef *rule);
+
+/**
+  * @brief  Transform source for the compiler: fill *x with transform id i.
+  */
+typedef void (*MIDI_RouteXformGetTypeDef)(uint32_t i, MIDI_XformTypeDef *x);
+
+/**
+  * @brief  A rule set.
+  */
+typedef struct
+{
+  MIDI_RouteGetTypeDef      Rule;
+  uint32_t                  Rules;
+  MIDI_RouteXformGetTypeDef Xform;
+  uint32_t                  Xforms;     /*!< Highest transform id             */
+} MIDI_RouteSetTypeDef;
+
+/**
+  * @brief  Result of MIDI_Route_Bench().
+  */
+typedef struct
+{
+  uint16_t Rules;         /*!< Rules compiled, 0 while a run is pending        */
+  uint8_t  Rows;          /*!< Rows the rules needed, MIDI_ROUTE_ROWS when
+                               they did not fit                                */
+  uint8_t  Status;        /*!< HAL_OK, HAL_ERROR when out of rows, HAL_BUSY
+                               while MIDI_Route_Apply() holds the spare table  */
+  uint32_t CompileUs;     /*!< Time to compile the rules                       */
+  uint32_t LookupNs;      /*!< Time to route one packet, lookup and bit scan   */
+} MIDI_RouteBenchTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern const MIDI_RouteTableTypeDef *volatile MIDI_Route;
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Destinations of an event from a table source. Load MIDI_Route
+  *         once per event and pass it here and to MIDI_Route_Transform().
+  */
+__RAM_INLINE uint32_t MIDI_Route_Lookup(const MIDI_RouteTableTypeDef *t, uint32_t src, uint32_t evt)
+{
+  return t->Row[t->Index[src][evt & 0x0FU]][(evt >> 8) & 0x0FU];
+}
+
+/**
+  * @brief  An event as it leaves for one destination.
+  * @param  t: table the destinations came from
+  * @param  src: table source
+  * @param  dst: destination bit
+  */
+__RAM_INLINE uint32_t MIDI_Route_Transform(const MIDI_RouteTableTypeDef *t, uint32_t src,
+                                           uint32_t dst, uint32_t evt)
+{
+  uint32_t x = t->Xform[src][dst];
+
+  return (x == 0U) ? evt : MIDI_Xform_Apply(&t->Xf[x], evt);
+}
+
+HAL_StatusTypeDef MIDI_Route_Init(void);
+void              MIDI_Route_Apply(void);
+HAL_StatusTypeDef MIDI_Route_Status(void);
+void              MIDI_Route_Bench(uint32_t n, MIDI_RouteBenchTypeDef *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_ROUTE_H */
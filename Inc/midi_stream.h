@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    midi_stream.h
+  * @brief   Conversion between MIDI 1.0 byte streams and 32-bit USB-MIDI
+  *          event packets, shared by every byte oriented port driver.
+  *
+  *          Event packets are little-endian words:
+  *            [3:0]   code index number (CIN)
+  *            [7:4]   cable number
+  *            [31:8]  up to three MIDI bytes, unused bytes are 0
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_STREAM_H
+#define __MIDI_STREAM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MIDI_PARSE_NONE       0U   /*!< Byte consumed, no packet yet         */
+#define MIDI_PARSE_EVENT      1U   /*!< *evt holds a complete packet         */
+#define MIDI_PARSE_ERROR      2U   /*!< Byte or partial message discarded    */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t Cable;          /*!< Cable number stamped into every packet        */
+  uint8_t Status;         /*!< Running status, 0xF0 inside SysEx, 0 if none  */
+  uint8_t Need;           /*!< Message length including the status byte      */
+  uint8_t Idx;            /*!< Bytes collected in Buf                        */
+  uint8_t Buf[3];
+} MIDI_ParserTypeDef;
+
+typedef struct
+{
+  uint8_t Status;         /*!< Last channel status sent, 0 if none           */
+} MIDI_WriterTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern const uint8_t MIDI_CinLength[16];
+
+/* Exported functions ------------------------------------------------------- */
+void     MIDI_Parser_Init(MIDI_ParserTypeDef *p, uint32_t cable);
+uint32_t MIDI_Parse(MIDI_ParserTypeDef *p, uint8_t byte, uint32_t *evt);
+uint32_t MIDI_Write(MIDI_WriterTypeDef *w, uint32_t evt, uint8_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_STREAM_H */
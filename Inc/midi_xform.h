@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file    midi_xform.h
+  * @brief   Per-route message transforms through shared 128-entry tables.
+  *
+  *          A transform changes the channel of channel messages, transposes
+  *          notes into a range, bends velocities along a curve, renumbers
+  *          one controller and scales controller values. When a rule set is
+  *          compiled, every transform it uses becomes up to five lookup
+  *          tables of 128 bytes, one per role below; tables with the same
+  *          contents are stored once, whichever transforms they come from,
+  *          and the identity table serves every role a transform leaves
+  *          alone.
+  *
+  *          MIDI_XformRole gives the role of each byte of a USB-MIDI event
+  *          by code index number, so applying a transform takes, per byte,
+  *          a role load, a table number load and a table load, the same for
+  *          every kind of message. Bit 7 of a byte is kept as it is, which
+  *          leaves the bytes of system messages alone.
+  *
+  *          The tables live in a pool of MIDI_XFORM_LUTS shared by the two
+  *          routing tables (midi_route.h). A pool table is only rewritten
+  *          once neither routing table uses it, so the one in use never
+  *          sees a transform change under it. The new rule set therefore
+  *          needs free tables next to those of the old one; the pool keeps
+  *          MIDI_XFORM_TABLES for each.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MIDI_XFORM_H
+#define __MIDI_XFORM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MIDI_XFORM_KEEP           0xFFU   /*!< Channel and CcFrom: no change   */
+
+/* Byte roles, and the tables of a compiled transform */
+#define MIDI_XFORM_ROLE_SAME      0U
+#define MIDI_XFORM_ROLE_STATUS    1U      /*!< Channel of a channel message    */
+#define MIDI_XFORM_ROLE_NOTE      2U
+#define MIDI_XFORM_ROLE_VELOCITY  3U
+#define MIDI_XFORM_ROLE_CC_NUMBER 4U
+#define MIDI_XFORM_ROLE_CC_VALUE  5U
+#define MIDI_XFORM_ROLES          6U
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief  Transform parameters that change nothing, the base every entry
+  *         of MIDI_XFORM_LIST starts from.
+  */
+#define MIDI_XFORM_DEFAULTS                                                    \
+  .Transpose = 0, .NoteLo = 0, .NoteHi = 127, .VelCurve = 0, .VelLo = 1,       \
+  .VelHi = 127, .Channel = MIDI_XFORM_KEEP, .CcFrom = MIDI_XFORM_KEEP,         \
+  .CcTo = 0, .CcLo = 0, .CcHi = 127, .Reserved = 0
+
+#define MIDI_XFORM_ENUM(__ID__, ...)  MIDI_XFORM_##__ID__,
+
+/* Ids of MIDI_XFORM_LIST, from 1 */
+enum
+{
+  MIDI_XFORM_NONE,
+  MIDI_XFORM_LIST(MIDI_XFORM_ENUM)
+  MIDI_XFORM_LISTED
+};
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  int8_t  Transpose;      /*!< Semitones added to note numbers                 */
+  uint8_t NoteLo;         /*!< Transposed notes are clamped to NoteLo..NoteHi  */
+  uint8_t NoteHi;
+  int8_t  VelCurve;       /*!< -8 (hard) .. 0 (linear) .. 8 (soft)             */
+  uint8_t VelLo;          /*!< Velocities 1..127 land in VelLo..VelHi, 0 stays */
+  uint8_t VelHi;
+  uint8_t Channel;        /*!< Channel messages go to this channel, 0 based    */
+  uint8_t CcFrom;         /*!< Controller CcFrom becomes CcTo                  */
+  uint8_t CcTo;
+  uint8_t CcLo;           /*!< Controller values 0..127 land in CcLo..CcHi     */
+  uint8_t CcHi;
+  uint8_t Reserved;
+} MIDI_XformTypeDef;
+
+/**
+  * @brief  A compiled transform: the pool table of each role.
+  */
+typedef struct
+{
+  uint8_t Lut[MIDI_XFORM_ROLES];
+} MIDI_XformLutsTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+/* Not const: the USB interrupt reads them from RAM code, see ramfunc.h */
+extern uint8_t MIDI_XformLut[MIDI_XFORM_LUTS][128];
+extern uint8_t MIDI_XformRole[3][16];
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Apply a compiled transform to a USB-MIDI event packet.
+  */
+__RAM_INLINE uint32_t MIDI_Xform_Apply(const MIDI_XformLutsTypeDef *x, uint32_t evt)
+{
+  uint32_t cin = evt & 0x0FU;
+  uint32_t b1 = (evt >> 8) & 0xFFU;
+  uint32_t b2 = (evt >> 16) & 0xFFU;
+  uint32_t b3 = evt >> 24;
+
+  b1 = MIDI_XformLut[x->Lut[MIDI_XformRole[0][cin]]][b1 & 0x7FU] | (b1 & 0x80U);
+  b2 = MIDI_XformLut[x->Lut[MIDI_XformRole[1][cin]]][b2 & 0x7FU] | (b2 & 0x80U);
+  b3 = MIDI_XformLut[x->Lut[MIDI_XformRole[2][cin]]][b3 & 0x7FU] | (b3 & 0x80U);
+  return (evt & 0xFFU) | (b1 << 8) | (b2 << 16) | (b3 << 24);
+}
+
+void              MIDI_Xform_Init(void);
+void              MIDI_Xform_Release(uint32_t owner);
+HAL_StatusTypeDef MIDI_Xform_Compile(MIDI_XformLutsTypeDef *out, const MIDI_XformTypeDef *x,
+                                     uint32_t owner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MIDI_XFORM_H */
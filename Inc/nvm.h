@@ -0,0 +1,42 @@
+/**
+  ******************************************************************************
+  * @file    nvm.h
+  * @brief   Background flash writer.
+  *
+  *          One erase or program operation at a time, driven by the flash
+  *          end-of-operation interrupt, NVM_IRQHandler().
+  *          A program operation writes one halfword per interrupt, so the
+  *          main loop runs between halfwords; poll NVM_Busy() from a job
+  *          (PT_WAIT_UNTIL) to wait for the end.
+  *
+  *          A page erase stalls every flash fetch for up to 40 ms. NVM_Erase()
+  *          therefore starts it and waits for it from SRAM, with interrupts
+  *          enabled and the USB and SysTick vectors swapped for RAM handlers
+  *          (vectors.h), and only returns once the page is blank.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __NVM_H
+#define __NVM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported functions ------------------------------------------------------- */
+void              NVM_Init(void);
+HAL_StatusTypeDef NVM_Erase(uint32_t addr);
+HAL_StatusTypeDef NVM_Program(uint32_t addr, const uint16_t *src, uint32_t n);
+uint32_t          NVM_Busy(void);
+HAL_StatusTypeDef NVM_Status(void);
+void              NVM_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __NVM_H */
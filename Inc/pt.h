@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    pt.h
+  * @brief   Stackless protothreads for long-running main loop jobs.
+  *
+  *          A job is a function that resumes where it last left off. Its
+  *          whole execution state is one 16-bit resume point plus whatever
+  *          it keeps in its own static or job structure: locals do not
+  *          survive a PT_YIELD() or PT_WAIT_UNTIL(). Resume points are
+  *          line numbers, so put at most one of them on a line and none
+  *          inside a switch statement of the job itself.
+  *
+  *          static uint8_t Job_Run(PT_JobTypeDef *job)
+  *          {
+  *            PT_BEGIN(job);
+  *            while (step() != 0U)
+  *            {
+  *              PT_YIELD(job);
+  *            }
+  *            PT_WAIT_UNTIL(job, done());
+  *            PT_END(job);
+  *          }
+  *
+  *          PT_Poll() is a scheduler task. It steps every started job in
+  *          turn, again and again while the job yields and its BudgetUs
+  *          slice is not used up, so MIDI handling is never held back for
+  *          longer than one step.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PT_H
+#define __PT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define PT_WAITING            0U   /*!< Blocked on a condition, retry next tick */
+#define PT_YIELDED            1U   /*!< More work ready, step again             */
+#define PT_ENDED              2U   /*!< Finished, removed from the job list     */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct PT_JobTypeDef PT_JobTypeDef;
+
+struct PT_JobTypeDef
+{
+  uint8_t (*Run)(PT_JobTypeDef *job);   /*!< Job body, returns PT_xxx        */
+  uint16_t BudgetUs;                    /*!< Slice per PT_Poll() call        */
+  uint16_t Lc;                          /*!< Resume point, 0 = start         */
+  uint16_t WorstUs;                     /*!< Longest single step             */
+  uint16_t Overruns;                    /*!< Steps longer than BudgetUs      */
+  PT_JobTypeDef *Next;                  /*!< Job list link, owned by pt.c    */
+};
+
+/* Exported macro ------------------------------------------------------------*/
+#define PT_BEGIN(__JOB__)             switch ((__JOB__)->Lc) { case 0:
+
+#define PT_YIELD(__JOB__)                                                      \
+  do { (__JOB__)->Lc = __LINE__; return PT_YIELDED; case __LINE__:; } while (0)
+
+#define PT_WAIT_UNTIL(__JOB__, __COND__)                                       \
+  do { (__JOB__)->Lc = __LINE__; __attribute__((fallthrough));               \
+       case __LINE__: if (!(__COND__)) { return PT_WAITING; } } while (0)
+
+#define PT_EXIT(__JOB__)                                                       \
+  do { (__JOB__)->Lc = 0; return PT_ENDED; } while (0)
+
+#define PT_END(__JOB__)                                                        \
+  } (__JOB__)->Lc = 0; return PT_ENDED
+
+/**
+  * @brief  Define a job. __RUN__ is the job body, __BUDGET__ its slice in us.
+  */
+#define PT_JOB_DEFINE(__NAME__, __RUN__, __BUDGET__)                           \
+  PT_JobTypeDef __NAME__ = { (__RUN__), (__BUDGET__), 0, 0, 0, NULL }
+
+/* Exported functions ------------------------------------------------------- */
+void     PT_Start(PT_JobTypeDef *job);
+uint32_t PT_Running(const PT_JobTypeDef *job);
+void     PT_Poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PT_H */
@@ -0,0 +1,42 @@
+/**
+  ******************************************************************************
+  * @file    ramfunc.h
+  * @brief   Placement of functions that must run from SRAM.
+  *
+  *          Flash answers with one wait state at 48 MHz, which every taken
+  *          branch pays, and any fetch from it stalls while the flash is
+  *          being erased or programmed. Hot interrupt paths and code that
+  *          has to keep running through a flash operation are put
+  *          in the .ramfunc section, which Reset_Handler copies into SRAM
+  *          next to the initialised data. The build prints the size of
+  *          .ramfunc, its RAM cost.
+  *
+  *          Helpers that RAM code calls (the queue primitives,
+  *          SCHED_Post(), the routing lookups) are __RAM_INLINE: always
+  *          inlined, at any optimisation level, so they follow their
+  *          caller. Whatever they read must not be const data in flash
+  *          either. The build checks that nothing in .ramfunc calls out
+  *          of it (Tools/check_ramfunc.py).
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RAMFUNC_H
+#define __RAMFUNC_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Exported macro ------------------------------------------------------------*/
+/** @brief  Run this function from SRAM. It is never inlined into flash code. */
+#define __RAM_FUNC            __attribute__((section(".ramfunc"), noinline))
+
+/** @brief  A helper of RAM code: inlined into every caller, flash or RAM. */
+#define __RAM_INLINE          static inline __attribute__((always_inline))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RAMFUNC_H */
@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    sched.h
+  * @brief   Event flag scheduler for the main loop.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHED_TASK_ENUM(__ID__, __FN__)   SCHED_TASK_##__ID__,
+#define SCHED_EVT_ENUM(__ID__, __FN__)    SCHED_EVT_##__ID__ = 1U << SCHED_TASK_##__ID__,
+
+enum
+{
+  SCHED_TASK_LIST(SCHED_TASK_ENUM)
+  SCHED_TASK_COUNT
+};
+
+enum
+{
+  SCHED_TASK_LIST(SCHED_EVT_ENUM)
+  SCHED_EVT_ALL = (1U << SCHED_TASK_COUNT) - 1U
+};
+
+#define SCHED_WINDOW_US       1000000U   /*!< Idle accounting window */
+
+/* Exported variables --------------------------------------------------------*/
+extern __IO uint32_t SCHED_Pending;
+
+/* Exported functions ------------------------------------------------------- */
+void SCHED_Run(void);
+void SCHED_PendSV(void);
+
+/**
+  * @brief  Ask for tasks to run. Safe to call from any context.
+  * @param  events: SCHED_EVT_xxx mask
+  * @retval None
+  */
+__RAM_INLINE void SCHED_Post(uint32_t events)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  SCHED_Pending |= events;
+  __set_PRIMASK(primask);
+#if (SCHED_SLEEP_ON_EXIT == 1)
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHED_H */
@@ -52,6 +52,7 @@ void PendSV_Handler(void);
 void SysTick_Handler(void);
 void EXTI4_15_IRQHandler(void);
 void TIM1_BRK_UP_TRG_COM_IRQHandler(void);
+void USB_IRQHandler(void);
 
 #ifdef __cplusplus
 }
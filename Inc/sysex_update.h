@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    sysex_update.h
+  * @brief   Firmware update over MIDI System Exclusive, for hosts that can
+  *          reach the device as a class compliant MIDI interface only.
+  *
+  *          The application answers ENTER on its "System" port by restarting
+  *          into the bootloader, which enumerates with a single "Updater"
+  *          MIDI port next to its DFU interface. The image then goes out as
+  *          DATA messages of one 256 byte block each, 7-bit packed. Blocks
+  *          are numbered from 0 and block n is image offset 256 * n.
+  *
+  *          Every accepted block is answered by an ACK carrying the next
+  *          block the device expects and the first block it cannot buffer
+  *          yet; the host keeps sending up to that limit without waiting,
+  *          so blocks arrive while earlier pages are being programmed. A
+  *          block that is out of order or fails its check is answered by
+  *          one error ACK and everything after it is ignored until the
+  *          expected block arrives again, so the host goes back to the
+  *          acknowledged block on an error or a timeout.
+  *
+  *          All messages are F0 7D 46 <cmd> <payload> F7 (7D: non-commercial
+  *          manufacturer id). Multi-byte numbers are sent as 7-bit groups,
+  *          least significant first:
+  *
+  *            ENTER   host -> app   (none)
+  *            BEGIN   host -> boot  size (3 groups)
+  *            DATA    host -> boot  block (2), packed data, check (5)
+  *            END     host -> boot  image CRC (5)
+  *            ACK     boot -> host  next (2), limit (2), status (1)
+  *
+  *          Packed data is groups of a header byte and up to 7 data bytes
+  *          with their top bit cleared; bit k of the header is the top bit
+  *          of data byte k + 1. The last block of an image is short. The
+  *          check of a block and the image CRC are both the CRC-32 the
+  *          bootloader keeps in its trailer (boot.h, crc32.h), over the
+  *          block or the image padded with 0xFF to whole words.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SYSEX_UPDATE_H
+#define __SYSEX_UPDATE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+#define SYSEX_UPD_MANUFACTURER          0x7DU
+#define SYSEX_UPD_DEVICE                0x46U
+#define SYSEX_UPD_HEADER_LEN            4U      /*!< F0, ids and command */
+
+/* Commands */
+#define SYSEX_UPD_ENTER                 0x01U
+#define SYSEX_UPD_BEGIN                 0x02U
+#define SYSEX_UPD_DATA                  0x03U
+#define SYSEX_UPD_END                   0x04U
+#define SYSEX_UPD_ACK                   0x10U
+
+/* ACK status */
+#define SYSEX_UPD_OK                    0x00U
+#define SYSEX_UPD_BUSY                  0x01U   /*!< DFU download running   */
+#define SYSEX_UPD_ERR_SIZE              0x02U
+#define SYSEX_UPD_ERR_SEQ               0x03U   /*!< Unexpected or unbuffered block */
+#define SYSEX_UPD_ERR_CHECK             0x04U
+#define SYSEX_UPD_ERR_CRC               0x05U   /*!< Image CRC differs      */
+#define SYSEX_UPD_ERR_FLASH             0x06U
+#define SYSEX_UPD_DONE                  0x7FU   /*!< Image committed, restarting */
+
+#define SYSEX_UPD_BLOCK                 256U
+#define SYSEX_UPD_PACKED(__LEN__)       ((__LEN__) + ((__LEN__) + 6U) / 7U)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSEX_UPDATE_H */
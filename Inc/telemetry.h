@@ -0,0 +1,170 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.h
+  * @brief   Throughput, drop and latency counters.
+  *
+  *          Every counter has exactly one writing context (the ISR or loop
+  *          that owns the corresponding data path), so updates are plain
+  *          increments with no locking. Readers take a consistent copy of
+  *          the whole block with TELEM_Snapshot().
+  *
+  *          The latency histograms time one event per path at a time: the
+  *          producer stamps the queue position it is about to fill, the
+  *          consumer stamps the dequeue that passes it, and the MIDI task
+  *          bins the finished sample with TELEM_LatencyPoll().
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TELEM_DROP_QUEUE_FULL     0U   /*!< Destination queue had no room     */
+#define TELEM_DROP_PARSE          1U   /*!< Malformed or unexpected MIDI data */
+#define TELEM_DROP_FRAMING        2U   /*!< USART framing or noise error      */
+#define TELEM_DROP_CAUSES         3U
+
+#define TELEM_PATH_USB_TO_PORT    0U   /*!< USB OUT packet to port wire       */
+#define TELEM_PATH_PORT_TO_USB    1U   /*!< Port input to USB IN packet       */
+#define TELEM_PATHS               2U
+
+#define TELEM_SAMPLE_IDLE         0U   /*!< Next enqueue may start a sample   */
+#define TELEM_SAMPLE_ARMED        1U   /*!< Waiting for the dequeue           */
+#define TELEM_SAMPLE_DONE         2U   /*!< Waiting for TELEM_LatencyPoll()   */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t MsgIn;                          /*!< Messages received on the port  */
+  uint32_t MsgOut;                         /*!< Messages sent on the port      */
+  uint32_t BytesIn;                        /*!< Bytes received on the port     */
+  uint32_t BytesOut;                       /*!< Bytes sent on the port         */
+  uint32_t Drop[TELEM_DROP_CAUSES];        /*!< Dropped messages by cause      */
+  uint16_t OutQueueHwm;                    /*!< Port output queue high water   */
+  uint16_t InQueueHwm;                     /*!< Port input queue high water    */
+} TELEM_PortTypeDef;
+
+typedef struct
+{
+  uint32_t PmaOverrun;                     /*!< USB_ISTR_PMAOVR events         */
+  uint32_t BusError;                       /*!< USB_ISTR_ERR events            */
+  uint32_t Unrouted;                       /*!< Host events routed nowhere     */
+  uint16_t UsbInQueueHwm;                  /*!< USB IN event queue high water  */
+  uint16_t UsbOutPauses;                   /*!< MIDI OUT endpoint NAK pauses   */
+  uint16_t Suspends;                       /*!< STOP mode entries on suspend   */
+  uint16_t ResumeUsMax;                    /*!< Worst wake to HSI48 time, us   */
+  uint32_t RemoteWakeups;                  /*!< Host woken by local activity   */
+  uint16_t IdlePermille;                   /*!< CPU idle over the last second  */
+  uint16_t WakeRate;                       /*!< Sleep exits over the last second */
+  uint32_t JobOverruns;                    /*!< Job steps longer than budget   */
+  TELEM_PortTypeDef Port[MIDI_PORT_COUNT];
+  uint32_t Latency[TELEM_PATHS][TELEM_LATENCY_BUCKETS];
+} TELEM_TypeDef;
+
+typedef struct
+{
+  uint32_t StartUs;                        /*!< Enqueue time                   */
+  uint32_t EndUs;                          /*!< Dequeue time                   */
+  uint16_t Pos;                            /*!< Queue slot of the timed event  */
+  __IO uint8_t State;                      /*!< TELEM_SAMPLE_xxx               */
+} TELEM_SampleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern TELEM_TypeDef TELEM;
+extern TELEM_SampleTypeDef TELEM_Sample[TELEM_PATHS];
+
+/* Exported macro ------------------------------------------------------------*/
+#define TELEM_MSG_IN(__PORT__, __BYTES__)   do { TELEM.Port[(__PORT__)].MsgIn++; \
+                                                 TELEM.Port[(__PORT__)].BytesIn += (__BYTES__); } while (0)
+#define TELEM_MSG_OUT(__PORT__, __BYTES__)  do { TELEM.Port[(__PORT__)].MsgOut++; \
+                                                 TELEM.Port[(__PORT__)].BytesOut += (__BYTES__); } while (0)
+#define TELEM_DROP(__PORT__, __CAUSE__)     (TELEM.Port[(__PORT__)].Drop[(__CAUSE__)]++)
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Account the error flags of a USB ISTR value before the HAL clears them.
+  * @param  istr: ISTR register value
+  * @retval None
+  */
+__RAM_INLINE void TELEM_UsbIstr(uint32_t istr)
+{
+  if ((istr & (USB_ISTR_PMAOVR | USB_ISTR_ERR)) != 0U)
+  {
+    TELEM.PmaOverrun += (istr & USB_ISTR_PMAOVR) != 0U;
+    TELEM.BusError += (istr & USB_ISTR_ERR) != 0U;
+  }
+}
+
+uint32_t TELEM_NowUs(void);
+
+/**
+  * @brief  Time the event queued at slot pos, unless a sample of the path
+  *         is already running. A consumer that can preempt the producer
+  *         could pass the slot unseen: there, call before the put and cancel
+  *         if the put fails.
+  * @param  path: TELEM_PATH_xxx
+  * @param  pos: queue slot of the event
+  * @retval None
+  */
+__RAM_INLINE void TELEM_LatencyStart(uint32_t path, uint16_t pos)
+{
+  TELEM_SampleTypeDef *s = &TELEM_Sample[path];
+
+  if (s->State == TELEM_SAMPLE_IDLE)
+  {
+    s->StartUs = TELEM_NowUs();
+    s->Pos = pos;
+    s->State = TELEM_SAMPLE_ARMED;
+  }
+}
+
+/**
+  * @brief  Forget the sample started for slot pos after a failed put.
+  */
+__RAM_INLINE void TELEM_LatencyCancel(uint32_t path, uint16_t pos)
+{
+  TELEM_SampleTypeDef *s = &TELEM_Sample[path];
+
+  if ((s->State == TELEM_SAMPLE_ARMED) && (s->Pos == pos))
+  {
+    s->State = TELEM_SAMPLE_IDLE;
+  }
+}
+
+/**
+  * @brief  Stop the running sample once the consumer has dequeued its slot.
+  * @param  path: TELEM_PATH_xxx
+  * @param  tail: queue Tail after the dequeue
+  * @retval None
+  */
+__RAM_INLINE void TELEM_LatencyEnd(uint32_t path, uint16_t tail)
+{
+  TELEM_SampleTypeDef *s = &TELEM_Sample[path];
+
+  if ((s->State == TELEM_SAMPLE_ARMED) && ((int16_t)(tail - s->Pos) > 0))
+  {
+    s->EndUs = TELEM_NowUs();
+    s->State = TELEM_SAMPLE_DONE;
+  }
+}
+
+void TELEM_LatencyPoll(void);
+void TELEM_Snapshot(TELEM_TypeDef *dst);
+void TELEM_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_H */
@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    trace.h
+  * @brief   ISR enter/exit trace ring.
+  *
+  *          Each probe stores one 32-bit word:
+  *            [31]    0 = enter, 1 = exit
+  *            [30:27] source id (TRACE_ID_xxx)
+  *            [26:16] low 11 bits of the HAL millisecond tick
+  *            [15:0]  raw SysTick->VAL, counting down from SysTick->LOAD
+  *
+  *          Ids below TRACE_ID_MARK_BASE are handler enter/exit pairs, ids from
+  *          TRACE_ID_MARK_BASE up are single point events (queue operations,
+  *          MIDI traffic) recorded with TRACE_MARK().
+  *
+  *          The probe does not mask interrupts. USB, EXTI4_15, TIM1, DMA and
+  *          USART run at NVIC priority 0 and never preempt each other, but the
+  *          FLASH handler runs at priority 2 and main loop or PendSV probes
+  *          below it: a probe preempted by a higher priority probe may lose
+  *          one record.
+  *
+  *          With TRACE_ENABLED 0 the probes compile out and neither the ring
+  *          nor TRACE_Read() exist.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "app_conf.h"
+#include "ramfunc.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t Head;                    /*!< Total number of records written */
+  uint32_t      Buf[TRACE_RING_SIZE];    /*!< Record storage                  */
+} TRACE_RingTypeDef;
+
+/* Exported constants --------------------------------------------------------*/
+#define TRACE_ID_USB          0U
+#define TRACE_ID_EXTI4_15     1U
+#define TRACE_ID_TIM1         2U
+#define TRACE_ID_DMA          3U
+#define TRACE_ID_USART        4U
+#define TRACE_ID_FLASH        5U
+
+#define TRACE_ID_MARK_BASE    8U
+#define TRACE_ID_QUEUE_PUT    8U    /*!< Event routed to the port queues   */
+#define TRACE_ID_QUEUE_GET    9U    /*!< Port driver or IN drain dequeue   */
+#define TRACE_ID_QUEUE_DROP   10U   /*!< Full queue discarded an event     */
+#define TRACE_ID_MIDI_RX      11U
+#define TRACE_ID_MIDI_TX      12U
+
+#define TRACE_EXIT_FLAG       0x80000000U
+#define TRACE_ID_POS          27U
+#define TRACE_TICK_POS        16U
+#define TRACE_TICK_MASK       0x7FFU
+
+/* Exported variables --------------------------------------------------------*/
+#if (TRACE_ENABLED == 1)
+extern TRACE_RingTypeDef TRACE_Ring;
+#endif /* TRACE_ENABLED */
+extern __IO uint32_t uwTick;
+
+/* Exported macro ------------------------------------------------------------*/
+#if (TRACE_ENABLED == 1)
+#define TRACE_ENTER(__ID__)   TRACE_Record((uint32_t)(__ID__) << TRACE_ID_POS)
+#define TRACE_EXIT(__ID__)    TRACE_Record(((uint32_t)(__ID__) << TRACE_ID_POS) | TRACE_EXIT_FLAG)
+#define TRACE_MARK(__ID__)    TRACE_Record((uint32_t)(__ID__) << TRACE_ID_POS)
+#else
+#define TRACE_ENTER(__ID__)   ((void)0)
+#define TRACE_EXIT(__ID__)    ((void)0)
+#define TRACE_MARK(__ID__)    ((void)0)
+#endif /* TRACE_ENABLED */
+
+/* Exported functions ------------------------------------------------------- */
+#if (TRACE_ENABLED == 1)
+
+/**
+  * @brief  Append one record to the trace ring.
+  * @param  tag: source id and direction bits, already shifted in place
+  * @retval None
+  */
+__RAM_INLINE void TRACE_Record(uint32_t tag)
+{
+  uint32_t head = TRACE_Ring.Head;
+
+  TRACE_Ring.Buf[head & (TRACE_RING_SIZE - 1U)] =
+      tag | ((uwTick & TRACE_TICK_MASK) << TRACE_TICK_POS) | SysTick->VAL;
+  TRACE_Ring.Head = head + 1U;
+}
+
+uint32_t TRACE_Read(uint32_t *cursor, uint32_t *dst, uint32_t max, uint32_t *lost);
+
+#endif /* TRACE_ENABLED */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H */
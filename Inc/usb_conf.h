@@ -0,0 +1,51 @@
+/**
+  ******************************************************************************
+  * @file    usb_conf.h
+  * @brief   USB device identity, interface numbering and endpoints.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_CONF_H
+#define __USB_CONF_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* ########################## Identity ###################################### */
+#define USBD_VID                        0x1209U
+#define USBD_PID                        0x0001U
+#define USBD_BCD_DEVICE                 0x0100U
+#define USBD_MANUFACTURER_STRING        "FluorumLabs"
+#define USBD_PRODUCT_STRING             "F1042 MIDI Interface"
+
+/* ########################## Interfaces #################################### */
+#define USBD_ITF_AUDIO_CONTROL          0U
+#define USBD_ITF_MIDI_STREAMING         1U
+#define USBD_ITF_VENDOR                 2U
+#define USBD_ITF_COUNT                  3U
+
+/* ########################## Endpoints ##################################### */
+#define MIDI_EP_OUT                     0x01U
+#define MIDI_EP_IN                      0x82U
+#define MIDI_EP_SIZE                    64U
+
+#define VENDOR_EP_IN                    0x83U
+#define VENDOR_EP_SIZE                  64U
+
+/* ########################## Packet memory ################################# */
+/* Every endpoint in use, X(address, type, max packet). usb_pma.c places
+   one buffer per endpoint, see there for why none is double buffered. */
+#define USBD_EP_LIST(X)                                                        \
+  X(0x00U,          PCD_EP_TYPE_CTRL, USBD_EP0_SIZE)                           \
+  X(0x80U,          PCD_EP_TYPE_CTRL, USBD_EP0_SIZE)                           \
+  X(MIDI_EP_OUT,    PCD_EP_TYPE_BULK, MIDI_EP_SIZE)                            \
+  X(MIDI_EP_IN,     PCD_EP_TYPE_BULK, MIDI_EP_SIZE)                            \
+  X(VENDOR_EP_IN,   PCD_EP_TYPE_BULK, VENDOR_EP_SIZE)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_CONF_H */
@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    usb_device.h
+  * @brief   Minimal USB device core on top of the HAL PCD driver: chapter 9
+  *          requests on EP0 and dispatch of class/vendor traffic to the
+  *          registered functions.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_DEVICE_H
+#define __USB_DEVICE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_EP0_SIZE                   64U
+#define USBD_MAX_CLASSES                3U
+
+#define USBD_OK                         0U
+#define USBD_FAIL                       1U
+
+#define USBD_STATE_DEFAULT              0U
+#define USBD_STATE_ADDRESSED            1U
+#define USBD_STATE_CONFIGURED           2U
+#define USBD_STATE_SUSPENDED            3U
+
+#define USB_REQ_TYPE_MASK               0x60U
+#define USB_REQ_TYPE_STANDARD           0x00U
+#define USB_REQ_TYPE_CLASS              0x20U
+#define USB_REQ_TYPE_VENDOR             0x40U
+#define USB_REQ_RECIPIENT_MASK          0x1FU
+#define USB_REQ_RECIPIENT_DEVICE        0x00U
+#define USB_REQ_RECIPIENT_INTERFACE     0x01U
+#define USB_REQ_RECIPIENT_ENDPOINT      0x02U
+#define USB_REQ_DIR_IN                  0x80U
+
+#define USB_REQ_GET_STATUS              0x00U
+#define USB_REQ_CLEAR_FEATURE           0x01U
+#define USB_REQ_SET_FEATURE             0x03U
+#define USB_REQ_SET_ADDRESS             0x05U
+#define USB_REQ_GET_DESCRIPTOR          0x06U
+#define USB_REQ_GET_CONFIGURATION       0x08U
+#define USB_REQ_SET_CONFIGURATION       0x09U
+#define USB_REQ_GET_INTERFACE           0x0AU
+#define USB_REQ_SET_INTERFACE           0x0BU
+
+#define USB_FEATURE_EP_HALT             0x00U
+#define USB_FEATURE_REMOTE_WAKEUP       0x01U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  bmRequest;
+  uint8_t  bRequest;
+  uint16_t wValue;
+  uint16_t wIndex;
+  uint16_t wLength;
+} USBD_SetupReqTypedef;
+
+/**
+  * @brief  A USB function. Every hook is optional; each function ignores the
+  *         requests and endpoints it does not own.
+  */
+typedef struct
+{
+  void    (*Init)(PCD_HandleTypeDef *hpcd);       /*!< Configuration selected       */
+  void    (*DeInit)(PCD_HandleTypeDef *hpcd);     /*!< Reset or configuration 0     */
+  uint8_t (*Setup)(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+  void    (*EP0_RxReady)(PCD_HandleTypeDef *hpcd);/*!< Control OUT data received    */
+  void    (*DataIn)(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+  void    (*DataOut)(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+} USBD_ClassTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    USBD_Init(PCD_HandleTypeDef *hpcd);
+void    USBD_RegisterClass(const USBD_ClassTypeDef *cls);
+uint8_t USBD_GetState(void);
+uint8_t USBD_RemoteWakeupEnabled(void);
+
+uint8_t USBD_CtlSending(void);
+void    USBD_CtlSendData(PCD_HandleTypeDef *hpcd, const uint8_t *buf, uint16_t len);
+void    USBD_CtlPrepareRx(PCD_HandleTypeDef *hpcd, uint8_t *buf, uint16_t len);
+void    USBD_CtlSendStatus(PCD_HandleTypeDef *hpcd);
+void    USBD_CtlError(PCD_HandleTypeDef *hpcd);
+void    USBD_CtlRxPoll(PCD_HandleTypeDef *hpcd);
+
+/* Provided by usb_desc.c */
+const uint8_t *USBD_GetDescriptor(uint16_t wValue, uint16_t wIndex, uint16_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_DEVICE_H */
@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file    usb_pma.h
+  * @brief   Packet memory (PMA) allocator: places the BTABLE and the
+  *          endpoint buffers listed in USBD_EP_LIST inside the 1 KB PMA.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_PMA_H
+#define __USB_PMA_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+#include "usb_device.h"
+#include "midi_queue.h"
+#include "ramfunc.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_PMA_SIZE                   1024U
+#define USBD_PMA_BTABLE_ENTRY           8U     /*!< Bytes per endpoint register */
+#define USBD_PMA_MAX_EP                 8U
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief  Bytes reserved for one buffer. Buffers sit on halfword
+  *         boundaries; OUT buffers above 62 bytes are counted in 32 byte
+  *         blocks by the COUNTn_RX register and are rounded up to match.
+  */
+#define USBD_PMA_BUF_SIZE(__ADDR__, __SIZE__)                                  \
+  ((((__ADDR__) & 0x80U) == 0U) && ((__SIZE__) > 62U)                          \
+     ? (((__SIZE__) + 31U) & ~31U) : (((__SIZE__) + 1U) & ~1U))
+
+/** @brief  Pointer to a PMA buffer, as set by HAL_PCDEx_PMAConfig() */
+#define USBD_PMA_PTR(__ADDR__)          ((__IO uint16_t *)(USB_PMAADDR + (__ADDR__)))
+
+/* Exported functions ------------------------------------------------------- */
+void     USBD_PMA_Layout(PCD_HandleTypeDef *hpcd);
+uint16_t USBD_PMA_Free(void);
+uint32_t USBD_PMA_WriteQueue(__IO uint16_t *pma, MIDI_QueueTypeDef *q, uint32_t max);
+
+/*
+ * Copy helpers. The PMA only takes halfword accesses, so every 32-bit word
+ * costs two stores; unlike PCD_WritePMA()/PCD_ReadPMA() these never touch
+ * memory a byte at a time and never reassemble halfwords with shifts
+ * beyond the one per word.
+ */
+
+/**
+  * @brief  Read one 4-byte USB-MIDI event packet.
+  */
+__RAM_INLINE uint32_t USBD_PMA_ReadEvent(__IO const uint16_t *pma)
+{
+  return pma[0] | ((uint32_t)pma[1] << 16);
+}
+
+/**
+  * @brief  Write one 4-byte USB-MIDI event packet.
+  */
+__RAM_INLINE void USBD_PMA_WriteEvent(__IO uint16_t *pma, uint32_t evt)
+{
+  pma[0] = (uint16_t)evt;
+  pma[1] = (uint16_t)(evt >> 16);
+}
+
+/**
+  * @brief  Copy n words from word-aligned memory into the PMA, two words
+  *         per iteration.
+  * @retval PMA pointer past the last halfword written
+  */
+__RAM_INLINE __IO uint16_t *USBD_PMA_WriteWords(__IO uint16_t *pma, const uint32_t *src, uint32_t n)
+{
+  uint32_t a;
+  uint32_t b;
+
+  for (; n >= 2U; n -= 2U)
+  {
+    a = src[0];
+    b = src[1];
+    src += 2;
+    pma[0] = (uint16_t)a;
+    pma[1] = (uint16_t)(a >> 16);
+    pma[2] = (uint16_t)b;
+    pma[3] = (uint16_t)(b >> 16);
+    pma += 4;
+  }
+  if (n != 0U)
+  {
+    USBD_PMA_WriteEvent(pma, src[0]);
+    pma += 2;
+  }
+  return pma;
+}
+
+/**
+  * @brief  Copy n words from the PMA into word-aligned memory, two words
+  *         per iteration.
+  * @retval PMA pointer past the last halfword read
+  */
+__RAM_INLINE __IO uint16_t *USBD_PMA_ReadWords(uint32_t *dst, __IO uint16_t *pma, uint32_t n)
+{
+  for (; n >= 2U; n -= 2U)
+  {
+    dst[0] = pma[0] | ((uint32_t)pma[1] << 16);
+    dst[1] = pma[2] | ((uint32_t)pma[3] << 16);
+    dst += 2;
+    pma += 4;
+  }
+  if (n != 0U)
+  {
+    dst[0] = USBD_PMA_ReadEvent(pma);
+    pma += 2;
+  }
+  return pma;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_PMA_H */
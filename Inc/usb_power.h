@@ -0,0 +1,35 @@
+/**
+  ******************************************************************************
+  * @file    usb_power.h
+  * @brief   USB suspend handling: STOP mode while the bus is suspended and
+  *          HSI48/CRS recovery on resume.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_POWER_H
+#define __USB_POWER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_POWER_WAKE_US              5U     /*!< STOP wakeup, low-power regulator */
+#define USBD_POWER_RESUME_MS            10U    /*!< Remote wakeup K state, 1..15 ms  */
+#define USBD_POWER_HOLD_MS              100U   /*!< Stay awake after a local wakeup  */
+
+/* Exported functions ------------------------------------------------------- */
+void     USBD_Power_Init(PCD_HandleTypeDef *hpcd);
+void     USBD_Power_Poll(void);
+void     USBD_Power_StopEnter(void);
+uint32_t USBD_Power_StopExit(uint32_t wake_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_POWER_H */
@@ -0,0 +1,46 @@
+/**
+  ******************************************************************************
+  * @file    usbd_midi.h
+  * @brief   USB-MIDI 1.0 streaming function: bulk OUT events are handed to
+  *          USBD_MIDI_OutEvent(), events queued with USBD_MIDI_Send() are
+  *          packed into bulk IN transfers. The OUT endpoint stays in NAK
+  *          while USBD_MIDI_OutReady() reports the consumers full.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_MIDI_H
+#define __USBD_MIDI_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_MIDI_IN_QUEUE_SIZE         16U
+
+/* Exported macro ------------------------------------------------------------*/
+/* Event packet fields, packets are little-endian 32-bit words */
+#define USBD_MIDI_CABLE(__EVT__)        (((__EVT__) >> 4) & 0x0FU)
+#define USBD_MIDI_CIN(__EVT__)          ((__EVT__) & 0x0FU)
+
+/* Exported variables --------------------------------------------------------*/
+extern const USBD_ClassTypeDef USBD_MIDI;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t USBD_MIDI_Send(uint32_t evt);
+void     USBD_MIDI_Flush(void);
+void     USBD_MIDI_IRQHandler(void);
+void     USBD_MIDI_OutEvent(uint32_t evt);
+uint32_t USBD_MIDI_OutReady(void);
+uint32_t USBD_MIDI_OutPaused(void);
+void     USBD_MIDI_OutResume(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_MIDI_H */
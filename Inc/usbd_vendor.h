@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    usbd_vendor.h
+  * @brief   Vendor-specific USB function for telemetry and configuration,
+  *          kept out of the MIDI data path.
+  *
+  *          Small reads and writes are EP0 vendor requests addressed to the
+  *          device or to interface USBD_ITF_VENDOR. Traces and counters are
+  *          streamed on bulk endpoint VENDOR_EP_IN, one frame per transfer:
+  *            [0]    frame type (USBD_VENDOR_FRAME_xxx)
+  *            [1]    sequence number, increments per frame
+  *            [3:2]  payload length in bytes
+  *            [4..]  payload, same layout as the matching EP0 request
+  *
+  *          All multi-byte fields are little-endian.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_VENDOR_H
+#define __USBD_VENDOR_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_VENDOR_PROTOCOL            0x0006U
+
+/* Vendor requests */
+#define USBD_VENDOR_REQ_GET_INFO        0x01U   /*!< IN:  USBD_VendorInfoTypeDef     */
+#define USBD_VENDOR_REQ_GET_TELEMETRY   0x02U   /*!< IN:  TELEM_TypeDef snapshot;
+                                                     this and READ_TRACE STALL
+                                                     while a stream frame is
+                                                     being sent, retry        */
+#define USBD_VENDOR_REQ_RESET_TELEMETRY 0x03U   /*!< No data                         */
+#define USBD_VENDOR_REQ_READ_TRACE      0x04U   /*!< IN:  u32 lost + trace records   */
+#define USBD_VENDOR_REQ_GET_PARAM       0x05U   /*!< IN:  u32, wValue = param id     */
+#define USBD_VENDOR_REQ_SET_PARAM       0x06U   /*!< OUT: u32, wValue = param id     */
+#define USBD_VENDOR_REQ_ENTER_DFU       0x07U   /*!< No data, restarts into DFU      */
+#define USBD_VENDOR_REQ_ROUTE_BENCH     0x08U   /*!< No data, wValue = rule count    */
+#define USBD_VENDOR_REQ_GET_ROUTE_BENCH 0x09U   /*!< IN:  MIDI_RouteBenchTypeDef     */
+#define USBD_VENDOR_REQ_SET_ROUTES      0x0AU   /*!< OUT: MIDI_RouteRuleTypeDef[],
+                                                     wValue = key of the rules;
+                                                     MIDI_XformTypeDef[] for ids
+                                                     1.., wValue = MIDI_ROUTE_CFG_KEYS */
+#define USBD_VENDOR_REQ_APPLY_ROUTES    0x0BU   /*!< No data, rebuilds the routes */
+#define USBD_VENDOR_REQ_GET_ROUTE_STATUS 0x0CU  /*!< IN:  u8 route, u8 config log  */
+
+/* Parameters */
+#define USBD_VENDOR_PARAM_STREAM_MASK   0x00U   /*!< USBD_VENDOR_STREAM_xxx bits     */
+#define USBD_VENDOR_PARAM_STREAM_PERIOD 0x01U   /*!< Telemetry frame period in ms    */
+#define USBD_VENDOR_PARAM_COUNT         2U
+
+#define USBD_VENDOR_STREAM_TRACE        0x01U
+#define USBD_VENDOR_STREAM_TELEMETRY    0x02U
+
+/* Bulk stream frame types */
+#define USBD_VENDOR_FRAME_TRACE         0x01U
+#define USBD_VENDOR_FRAME_TELEMETRY     0x02U
+
+/* Most rules of a ROUTE_BENCH run */
+#define USBD_VENDOR_ROUTE_BENCH_MAX     1024U
+
+/* Trace records per EP0 read and per stream frame */
+#define USBD_VENDOR_TRACE_WORDS         13U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint16_t Protocol;                       /*!< USBD_VENDOR_PROTOCOL            */
+  uint16_t BcdDevice;                      /*!< Firmware version                */
+  uint8_t  PortCount;                      /*!< MIDI_PORT_COUNT                 */
+  uint8_t  TraceEnabled;                   /*!< TRACE_ENABLED                   */
+  uint16_t TraceRingSize;                  /*!< TRACE_RING_SIZE                 */
+  uint16_t TelemetrySize;                  /*!< sizeof(TELEM_TypeDef)           */
+  uint16_t LatencyBuckets;                 /*!< TELEM_LATENCY_BUCKETS           */
+  uint16_t PmaFree;                        /*!< Packet memory left unused       */
+} USBD_VendorInfoTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern const USBD_ClassTypeDef USBD_VENDOR;
+
+/* Exported functions ------------------------------------------------------- */
+void USBD_Vendor_Poll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_VENDOR_H */
@@ -0,0 +1,40 @@
+/**
+  ******************************************************************************
+  * @file    vectors.h
+  * @brief   Vector table in SRAM.
+  *
+  *          The Cortex-M0 has no VTOR, it always takes its vectors from
+  *          address 0. VECT_Relocate() copies the table this image was
+  *          linked with to the start of SRAM and has SYSCFG map SRAM at 0,
+  *          so an image linked behind a resident bootloader still gets its
+  *          own vectors, and a handler can be swapped by writing one word.
+  *          Interrupt entry no longer reads flash either.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VECTORS_H
+#define __VECTORS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f0xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define VECT_COUNT            48U        /*!< 16 core + 32 peripheral vectors */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*VECT_HandlerTypeDef)(void);
+
+/* Exported functions ------------------------------------------------------- */
+void                VECT_Relocate(void);
+VECT_HandlerTypeDef VECT_Set(IRQn_Type irq, VECT_HandlerTypeDef handler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VECTORS_H */
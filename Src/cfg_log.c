@@ -0,0 +1,393 @@
+/**
+  ******************************************************************************
+  * @file    cfg_log.c
+  * @brief   Configuration log in two flash pages.
+  *
+  *          Page layout, in halfwords:
+  *            [0] CFG_MAGIC, [1] sequence, [2] ~sequence, then records.
+  *          A page counts when the magic is there and the sequence matches
+  *          its complement; of two such pages the higher sequence is active.
+  *          The complement catches an interrupted erase, which only ever
+  *          sets bits and could otherwise raise an old sequence number.
+  *
+  *          Record checks are the CRC-32 of the header and value halfwords
+  *          (crc32.h), folded to 16 bits. Pages written before that carry
+  *          CFG_MAGIC_LEGACY and a rotate-and-XOR check; they are read and
+  *          appended to as they are, and the next compaction rewrites the
+  *          records with CRC checks.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "cfg_log.h"
+#include "nvm.h"
+#include "pt.h"
+#include "crc32.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CFG_PAGE_HWORDS       (FLASH_PAGE_SIZE / 2U)
+#define CFG_HDR_HWORDS        3U
+#define CFG_MAGIC             0xC0F2U
+#define CFG_MAGIC_LEGACY      0xC0F1U
+#define CFG_ERASED            0xFFFFU
+
+/* Header, value and check halfwords of a record */
+#define CFG_REC_HWORDS(__LEN__)   (1U + (((__LEN__) + 1U) / 2U) + 1U)
+
+#if (CFG_KEY_COUNT > 255) || (CFG_VALUE_MAX > 255)
+#error "CFG_KEY_COUNT and CFG_VALUE_MAX must fit the record header"
+#endif
+
+/* Compaction keeps the old value until the new one is written */
+#if ((CFG_KEY_COUNT + 1) * CFG_REC_HWORDS(CFG_VALUE_MAX)) > (CFG_PAGE_HWORDS - CFG_HDR_HWORDS)
+#error "CFG_KEY_COUNT records of CFG_VALUE_MAX bytes do not fit in a page"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+extern const uint16_t _scfg[];    /* Linker script: start of CONFIG */
+
+static const uint16_t *cfg_page;  /* Active page, NULL before the first write */
+static uint16_t cfg_seq;
+static uint16_t cfg_tail;         /* First free halfword of cfg_page */
+static uint8_t cfg_legacy;        /* cfg_page carries CFG_MAGIC_LEGACY */
+static uint16_t cfg_index[CFG_KEY_COUNT];   /* Newest record per key, 0 = none */
+
+/* Write job state, see CFG_Run() */
+static uint16_t cfg_rec[CFG_REC_HWORDS(CFG_VALUE_MAX)];   /* Record to append */
+static uint16_t cfg_rec_len;      /* In halfwords */
+static uint16_t cfg_rec_key;
+static uint16_t cfg_hdr[CFG_HDR_HWORDS];
+static const uint16_t *cfg_dst;
+static uint16_t cfg_off;
+static uint16_t cfg_key;
+static uint16_t cfg_check;        /* Check of the record being copied */
+static HAL_StatusTypeDef cfg_status = HAL_OK;
+
+static uint8_t CFG_Run(PT_JobTypeDef *job);
+static PT_JOB_DEFINE(cfg_job, CFG_Run, 200);
+
+/* Private functions ---------------------------------------------------------*/
+
+static const uint16_t *CFG_Page(uint32_t n)
+{
+  return &_scfg[n * CFG_PAGE_HWORDS];
+}
+
+static uint32_t CFG_PageValid(const uint16_t *page)
+{
+  uint16_t inv = (uint16_t)~page[2];
+
+  return ((page[0] == CFG_MAGIC) || (page[0] == CFG_MAGIC_LEGACY)) &&
+         (page[1] == inv);
+}
+
+/**
+  * @brief  Halfword i of a value, padded with 0xFF.
+  */
+static uint16_t CFG_Word(const uint8_t *data, uint32_t len, uint32_t i)
+{
+  uint32_t lo = data[2U * i];
+  uint32_t hi = ((2U * i + 1U) < len) ? data[2U * i + 1U] : 0xFFU;
+
+  return (uint16_t)(lo | (hi << 8));
+}
+
+/**
+  * @brief  Check halfword of a record. Never CFG_ERASED, so a record whose
+  *         last write did not happen can not pass.
+  * @param  legacy: check of a CFG_MAGIC_LEGACY page
+  * @param  rec: record, in flash or RAM
+  * @param  n: record length in halfwords, the check included
+  */
+static uint16_t CFG_Check(uint32_t legacy, const uint16_t *rec, uint32_t n)
+{
+  uint32_t c;
+  uint32_t i;
+
+  if (legacy != 0U)
+  {
+    c = 0x5AA5U ^ rec[0];
+    for (i = 1; i < n - 1U; i++)
+    {
+      c = (((c << 1) | (c >> 15)) & 0xFFFFU) ^ rec[i];
+    }
+  }
+  else
+  {
+    c = CRC32_Calc16(CRC32_INIT, rec, n - 1U);
+    c = (c ^ (c >> 16)) & 0xFFFFU;
+  }
+  return (c == CFG_ERASED) ? 0U : (uint16_t)c;
+}
+
+/**
+  * @brief  Index the active page in one pass. A header that can not be
+  *         valid ends the scan and marks the page full, so the next write
+  *         compacts it away.
+  */
+static void CFG_Scan(void)
+{
+  uint32_t off = CFG_HDR_HWORDS;
+  uint32_t hdr;
+  uint32_t key;
+  uint32_t len;
+  uint32_t n;
+
+  for (key = 0; key < CFG_KEY_COUNT; key++)
+  {
+    cfg_index[key] = 0;
+  }
+  cfg_legacy = (cfg_page[0] == CFG_MAGIC_LEGACY);
+
+  while (off < CFG_PAGE_HWORDS)
+  {
+    hdr = cfg_page[off];
+    if (hdr == CFG_ERASED)
+    {
+      break;
+    }
+    key = hdr >> 8;
+    len = hdr & 0xFFU;
+    n = CFG_REC_HWORDS(len);
+    if ((key >= CFG_KEY_COUNT) || (len > CFG_VALUE_MAX) || ((off + n) > CFG_PAGE_HWORDS))
+    {
+      off = CFG_PAGE_HWORDS;
+      break;
+    }
+    if (cfg_page[off + n - 1U] == CFG_Check(cfg_legacy, &cfg_page[off], n))
+    {
+      cfg_index[key] = (len != 0U) ? off : 0U;
+    }
+    off += n;
+  }
+  cfg_tail = off;
+}
+
+/**
+  * @brief  Whether every halfword of a page is erased.
+  */
+static uint32_t CFG_Blank(const uint16_t *page)
+{
+  uint32_t i;
+
+  for (i = 0; i < CFG_PAGE_HWORDS; i++)
+  {
+    if (page[i] != CFG_ERASED)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  Write job: compact into the other page when the record does not
+  *         fit, then append it. The old page stays valid until the new
+  *         header is complete, and the record's check halfword goes last.
+  *         Checks are computed here, for the page they end up in.
+  */
+static uint8_t CFG_Run(PT_JobTypeDef *job)
+{
+  const uint16_t *src;
+  uint32_t n;
+
+  PT_BEGIN(job);
+
+  if ((cfg_tail + cfg_rec_len) > CFG_PAGE_HWORDS)
+  {
+    cfg_dst = CFG_Page((cfg_page == CFG_Page(0)) ? 1U : 0U);
+    if ((CFG_Blank(cfg_dst) == 0U) && (NVM_Erase((uint32_t)cfg_dst) != HAL_OK))
+    {
+      cfg_status = HAL_ERROR;
+      PT_EXIT(job);
+    }
+
+    cfg_off = CFG_HDR_HWORDS;
+    for (cfg_key = 0; cfg_key < CFG_KEY_COUNT; cfg_key++)
+    {
+      if (cfg_index[cfg_key] != 0U)
+      {
+        /* Copied as it is, but with the check of the new page */
+        src = &cfg_page[cfg_index[cfg_key]];
+        n = CFG_REC_HWORDS(src[0] & 0xFFU);
+        cfg_check = CFG_Check(0, src, n);
+        NVM_Program((uint32_t)&cfg_dst[cfg_off], src, n - 1U);
+        cfg_off += n;
+        PT_WAIT_UNTIL(job, NVM_Busy() == 0U);
+        if (NVM_Status() == HAL_OK)
+        {
+          NVM_Program((uint32_t)&cfg_dst[cfg_off - 1U], &cfg_check, 1);
+        }
+        PT_WAIT_UNTIL(job, NVM_Busy() == 0U);
+        if (NVM_Status() != HAL_OK)
+        {
+          cfg_status = HAL_ERROR;
+          PT_EXIT(job);
+        }
+      }
+    }
+
+    cfg_hdr[0] = CFG_MAGIC;
+    cfg_hdr[1] = cfg_seq + 1U;
+    cfg_hdr[2] = (uint16_t)~cfg_hdr[1];
+    NVM_Program((uint32_t)&cfg_dst[1], &cfg_hdr[1], 2);
+    PT_WAIT_UNTIL(job, NVM_Busy() == 0U);
+    if (NVM_Status() == HAL_OK)
+    {
+      NVM_Program((uint32_t)&cfg_dst[0], &cfg_hdr[0], 1);
+    }
+    PT_WAIT_UNTIL(job, NVM_Busy() == 0U);
+    if (NVM_Status() != HAL_OK)
+    {
+      cfg_status = HAL_ERROR;
+      PT_EXIT(job);
+    }
+
+    cfg_page = cfg_dst;
+    cfg_seq = cfg_hdr[1];
+    CFG_Scan();
+  }
+
+  /* Whatever happens below, this space is used up */
+  cfg_rec[cfg_rec_len - 1U] = CFG_Check(cfg_legacy, cfg_rec, cfg_rec_len);
+  cfg_off = cfg_tail;
+  cfg_tail += cfg_rec_len;
+  NVM_Program((uint32_t)&cfg_page[cfg_off], cfg_rec, cfg_rec_len);
+  PT_WAIT_UNTIL(job, NVM_Busy() == 0U);
+  if (NVM_Status() != HAL_OK)
+  {
+    cfg_status = HAL_ERROR;
+    PT_EXIT(job);
+  }
+
+  cfg_index[cfg_rec_key] = (cfg_rec_len > 2U) ? cfg_off : 0U;
+  cfg_status = HAL_OK;
+  PT_END(job);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Find the active page and index it. Call once at boot.
+  * @retval None
+  */
+void CFG_Init(void)
+{
+  const uint16_t *p0 = CFG_Page(0);
+  const uint16_t *p1 = CFG_Page(1);
+  uint32_t key;
+
+  if (CFG_PageValid(p0) && (!CFG_PageValid(p1) || ((int16_t)(p0[1] - p1[1]) > 0)))
+  {
+    cfg_page = p0;
+  }
+  else if (CFG_PageValid(p1))
+  {
+    cfg_page = p1;
+  }
+  else
+  {
+    /* Blank or unreadable: the first write formats */
+    cfg_page = NULL;
+    cfg_seq = 0;
+    cfg_tail = CFG_PAGE_HWORDS;
+    for (key = 0; key < CFG_KEY_COUNT; key++)
+    {
+      cfg_index[key] = 0;
+    }
+    return;
+  }
+  cfg_seq = cfg_page[1];
+  CFG_Scan();
+}
+
+/**
+  * @brief  Current value of a key.
+  * @param  key: key, below CFG_KEY_COUNT
+  * @param  len: set to the value length in bytes when found, may be NULL
+  * @retval Value in flash, NULL when the key is not set
+  */
+const void *CFG_Get(uint32_t key, uint32_t *len)
+{
+  const uint16_t *rec;
+
+  if ((key >= CFG_KEY_COUNT) || (cfg_index[key] == 0U))
+  {
+    return NULL;
+  }
+  rec = &cfg_page[cfg_index[key]];
+  if (len != NULL)
+  {
+    *len = rec[0] & 0xFFU;
+  }
+  return &rec[1];
+}
+
+/**
+  * @brief  Store a value. The record is built at once and written in the
+  *         background; CFG_Get() keeps returning the previous value until
+  *         CFG_Status() reports the end. Writing the value a key already
+  *         has costs nothing. Main loop context only.
+  * @param  key: key, below CFG_KEY_COUNT
+  * @param  data: value
+  * @param  len: value length in bytes, at most CFG_VALUE_MAX; 0 deletes
+  * @retval HAL_OK once accepted, HAL_BUSY while the previous write runs,
+  *         HAL_ERROR on bad arguments
+  */
+HAL_StatusTypeDef CFG_Set(uint32_t key, const void *data, uint32_t len)
+{
+  const uint8_t *cur;
+  uint32_t cur_len = 0;
+  uint32_t n;
+  uint32_t i;
+
+  if ((key >= CFG_KEY_COUNT) || (len > CFG_VALUE_MAX))
+  {
+    return HAL_ERROR;
+  }
+  if (PT_Running(&cfg_job) != 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  cur = CFG_Get(key, &cur_len);
+  if (cur_len == len)
+  {
+    for (i = 0; (i < len) && (cur[i] == ((const uint8_t *)data)[i]); i++)
+    {
+    }
+    if (i == len)
+    {
+      return HAL_OK;
+    }
+  }
+
+  n = CFG_REC_HWORDS(len);
+  cfg_rec[0] = (uint16_t)((key << 8) | len);
+  for (i = 0; i < n - 2U; i++)
+  {
+    cfg_rec[1U + i] = CFG_Word(data, len, i);
+  }
+  cfg_rec_len = (uint16_t)n;
+  cfg_rec_key = (uint16_t)key;
+  cfg_status = HAL_BUSY;
+  PT_Start(&cfg_job);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Result of the last CFG_Set().
+  * @retval HAL_BUSY while it is written, then HAL_OK or HAL_ERROR
+  */
+HAL_StatusTypeDef CFG_Status(void)
+{
+  return cfg_status;
+}
+
+/**
+  * @brief  Remove a key.
+  * @retval See CFG_Set()
+  */
+HAL_StatusTypeDef CFG_Delete(uint32_t key)
+{
+  return CFG_Set(key, NULL, 0);
+}
@@ -0,0 +1,153 @@
+/**
+  ******************************************************************************
+  * @file    crc32.c
+  * @brief   CRC-32 service on the CRC unit, DMA fed for long runs.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "crc32.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CRC32_DMA                       DMA1_Channel1
+#define CRC32_DMA_IRQn                  DMA1_Channel1_IRQn
+#define CRC32_DMA_DONE                  (DMA_ISR_TCIF1 | DMA_ISR_TEIF1)
+#define CRC32_DMA_CLEAR                 DMA_IFCR_CGIF1
+#define CRC32_DMA_MAX                   0xFFFFU /* CNDTR is 16 bits */
+
+/* Private functions ---------------------------------------------------------*/
+
+#ifdef CRC32_SOFTWARE
+
+static uint32_t CRC32_Soft(uint32_t crc, uint32_t data, uint32_t bits)
+{
+  crc ^= data << (32U - bits);
+  while (bits-- != 0U)
+  {
+    crc = ((crc & 0x80000000U) != 0U) ? ((crc << 1) ^ CRC32_POLY) : (crc << 1);
+  }
+  return crc;
+}
+
+#else
+
+/**
+  * @brief  Feed n words to the unit by DMA and sleep until the channel is
+  *         done. The unit must already be seeded.
+  */
+static void CRC32_Dma(const uint32_t *p, uint32_t n)
+{
+  uint32_t scr = SCB->SCR;
+
+  SCB->SCR = scr | SCB_SCR_SEVONPEND_Msk;
+  CRC32_DMA->CPAR = (uint32_t)&CRC->DR;
+  CRC32_DMA->CMAR = (uint32_t)p;
+  CRC32_DMA->CNDTR = n;
+  CRC32_DMA->CCR = DMA_CCR_MEM2MEM | DMA_CCR_MSIZE_1 | DMA_CCR_PSIZE_1 |
+                   DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TEIE | DMA_CCR_TCIE | DMA_CCR_EN;
+
+  /* The end of the transfer pends the (disabled) channel interrupt, which
+     is an event for WFE even when it lands before the WFE */
+  while ((DMA1->ISR & CRC32_DMA_DONE) == 0U)
+  {
+    __WFE();
+  }
+
+  CRC32_DMA->CCR = 0;
+  DMA1->IFCR = CRC32_DMA_CLEAR;
+  NVIC_ClearPendingIRQ(CRC32_DMA_IRQn);
+  SCB->SCR = scr;
+}
+
+#endif /* CRC32_SOFTWARE */
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Clock the CRC unit and DMA1.
+  * @retval None
+  */
+void CRC32_Init(void)
+{
+#ifndef CRC32_SOFTWARE
+  __HAL_RCC_CRC_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+#endif
+}
+
+/**
+  * @brief  Put the CRC unit back in its reset state and stop the clocks,
+  *         for the bootloader before it starts the application. The unit
+  *         has no reset line of its own; channel 1 is already idle.
+  * @retval None
+  */
+void CRC32_DeInit(void)
+{
+#ifndef CRC32_SOFTWARE
+  CRC->INIT = CRC32_INIT;
+  CRC->CR = CRC_CR_RESET;
+  __HAL_RCC_CRC_CLK_DISABLE();
+  __HAL_RCC_DMA1_CLK_DISABLE();
+#endif
+}
+
+/**
+  * @brief  Continue a CRC over whole words.
+  * @param  crc: CRC32_INIT to start, else the previous result
+  * @param  p: word aligned data, in flash or SRAM
+  * @param  n: number of words
+  * @retval Updated CRC
+  */
+uint32_t CRC32_Calc(uint32_t crc, const uint32_t *p, uint32_t n)
+{
+#ifdef CRC32_SOFTWARE
+  while (n-- != 0U)
+  {
+    crc = CRC32_Soft(crc, *p++, 32U);
+  }
+  return crc;
+#else
+  uint32_t run;
+
+  CRC->INIT = crc;
+  CRC->CR = CRC_CR_RESET;
+  while (n >= CRC32_DMA_MIN)
+  {
+    run = (n > CRC32_DMA_MAX) ? CRC32_DMA_MAX : n;
+    CRC32_Dma(p, run);
+    p += run;
+    n -= run;
+  }
+  while (n-- != 0U)
+  {
+    CRC->DR = *p++;
+  }
+  return CRC->DR;
+#endif
+}
+
+/**
+  * @brief  Continue a CRC over halfwords, for data that is only halfword
+  *         aligned. Always fed by the core.
+  * @param  crc: CRC32_INIT to start, else the previous result
+  * @param  p: halfword aligned data
+  * @param  n: number of halfwords
+  * @retval Updated CRC
+  */
+uint32_t CRC32_Calc16(uint32_t crc, const uint16_t *p, uint32_t n)
+{
+#ifdef CRC32_SOFTWARE
+  while (n-- != 0U)
+  {
+    crc = CRC32_Soft(crc, *p++, 16U);
+  }
+  return crc;
+#else
+  CRC->INIT = crc;
+  CRC->CR = CRC_CR_RESET;
+  while (n-- != 0U)
+  {
+    *(__IO uint16_t *)(void *)&CRC->DR = *p++;
+  }
+  return CRC->DR;
+#endif
+}
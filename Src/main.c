@@ -34,7 +34,17 @@
 #include "stm32f0xx_hal.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "telemetry.h"
+#include "usb_device.h"
+#include "usb_power.h"
+#include "sched.h"
+#include "usbd_midi.h"
+#include "usbd_vendor.h"
+#include "midi_port.h"
+#include "cfg_log.h"
+#include "nvm.h"
+#include "crc32.h"
+#include "vectors.h"
 /* USER CODE END Includes */
 
 /* Private variables ---------------------------------------------------------*/
@@ -67,7 +77,7 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  VECT_Relocate();
   /* USER CODE END 1 */
 
   /* MCU Configuration----------------------------------------------------------*/
@@ -84,7 +94,17 @@ int main(void)
   MX_TIM1_Init();
 
   /* USER CODE BEGIN 2 */
-
+  TELEM_Reset();
+  CRC32_Init();
+  NVM_Init();
+  CFG_Init();
+  MIDI_Port_Init();
+
+  USBD_Init(&hpcd_USB_FS);
+  USBD_RegisterClass(&USBD_MIDI);
+  USBD_RegisterClass(&USBD_VENDOR);
+  USBD_Power_Init(&hpcd_USB_FS);
+  HAL_PCD_Start(&hpcd_USB_FS);
 
   // Turn RED LED On
   HAL_GPIO_WritePin(RED_GPIO_Port,RED_Pin,GPIO_PIN_SET);
@@ -98,6 +118,8 @@ int main(void)
   /* USER CODE END WHILE */
 
   /* USER CODE BEGIN 3 */
+    /* Tasks run from SCHED_TASK_LIST, see app_conf.h */
+    SCHED_Run();
 
   }
   /* USER CODE END 3 */
@@ -0,0 +1,286 @@
+/**
+  ******************************************************************************
+  * @file    midi_din.c
+  * @brief   DIN MIDI port on USART2 with DMA1 channel 4 (TX) and 5 (RX).
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "midi_din.h"
+#include "midi_stream.h"
+#include "usbd_midi.h"
+#include "usb_power.h"
+#include "sched.h"
+#include "telemetry.h"
+#include "ramfunc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define DIN_USART             USART2
+#define DIN_DMA_TX            DMA1_Channel4
+#define DIN_DMA_RX            DMA1_Channel5
+#define DIN_DMA_TX_TC         DMA_ISR_TCIF4
+#define DIN_DMA_TX_CLEAR      DMA_IFCR_CGIF4
+#define DIN_TX_PIN            GPIO_PIN_2
+#define DIN_RX_PIN            GPIO_PIN_3
+#define DIN_RX_EXTI           EXTI_IMR_MR3          /* PA3, EXTICR1 left at port A */
+#define DIN_BIT_US            (1000000U / MIDI_DIN_BAUDRATE)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t din_rx_buf[MIDI_DIN_RX_SIZE];
+static uint8_t din_tx_buf[MIDI_DIN_TX_SIZE];
+static uint32_t din_rx_tail;
+static MIDI_ParserTypeDef din_parser;
+static MIDI_WriterTypeDef din_writer;
+static uint32_t din_port;
+
+/* Private functions ---------------------------------------------------------*/
+
+static void MIDI_DIN_Init(uint32_t port)
+{
+  GPIO_InitTypeDef GPIO_InitStruct;
+
+  __HAL_RCC_USART2_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  GPIO_InitStruct.Pin = DIN_TX_PIN | DIN_RX_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  GPIO_InitStruct.Alternate = GPIO_AF1_USART2;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+  /* 8N1, overrun detection off so a late poll cannot stall reception */
+  DIN_USART->CR1 = 0;
+  DIN_USART->BRR = HAL_RCC_GetPCLK1Freq() / MIDI_DIN_BAUDRATE;
+  DIN_USART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_OVRDIS;
+
+  DIN_DMA_RX->CCR = 0;
+  DIN_DMA_RX->CPAR = (uint32_t)&DIN_USART->RDR;
+  DIN_DMA_RX->CMAR = (uint32_t)din_rx_buf;
+  DIN_DMA_RX->CNDTR = MIDI_DIN_RX_SIZE;
+  DIN_DMA_RX->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_EN;
+
+  DIN_DMA_TX->CCR = 0;
+  DIN_DMA_TX->CPAR = (uint32_t)&DIN_USART->TDR;
+  DIN_DMA_TX->CMAR = (uint32_t)din_tx_buf;
+
+  /* RXNE only wakes the scheduler, the DMA takes the byte */
+  DIN_USART->CR1 = USART_CR1_RXNEIE | USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;
+  HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(USART2_IRQn);
+  HAL_NVIC_SetPriority(DMA1_Channel4_5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_5_IRQn);
+
+  din_rx_tail = 0;
+  din_writer.Status = 0;
+  din_port = port;
+  MIDI_Parser_Init(&din_parser, port);
+}
+
+/**
+  * @brief  Feed one received byte to the parser.
+  */
+static void MIDI_DIN_Byte(uint32_t port, uint8_t byte)
+{
+  uint32_t evt;
+
+  switch (MIDI_Parse(&din_parser, byte, &evt))
+  {
+  case MIDI_PARSE_EVENT:
+    TRACE_MARK(TRACE_ID_MIDI_RX);
+    TELEM_MSG_IN(port, MIDI_CinLength[evt & 0x0FU]);
+    MIDI_Port_Input(port, evt);
+    break;
+  case MIDI_PARSE_ERROR:
+    TELEM_DROP(port, TELEM_DROP_PARSE);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+  * @brief  Hand received bytes to the parser and the complete events to USB.
+  */
+static void MIDI_DIN_Receive(uint32_t port)
+{
+  uint32_t head = (MIDI_DIN_RX_SIZE - DIN_DMA_RX->CNDTR) & (MIDI_DIN_RX_SIZE - 1U);
+  uint32_t level = (head - din_rx_tail) & (MIDI_DIN_RX_SIZE - 1U);
+
+  if ((DIN_USART->ISR & (USART_ISR_FE | USART_ISR_NE)) != 0U)
+  {
+    DIN_USART->ICR = USART_ICR_FECF | USART_ICR_NCF;
+    TELEM_DROP(port, TELEM_DROP_FRAMING);
+  }
+
+  if (level > TELEM.Port[port].InQueueHwm)
+  {
+    TELEM.Port[port].InQueueHwm = (uint16_t)level;
+  }
+
+  while (din_rx_tail != head)
+  {
+    MIDI_DIN_Byte(port, din_rx_buf[din_rx_tail]);
+    din_rx_tail = (din_rx_tail + 1U) & (MIDI_DIN_RX_SIZE - 1U);
+  }
+}
+
+/**
+  * @brief  Start the next TX batch once the previous one has left the DMA.
+  */
+static void MIDI_DIN_Transmit(uint32_t port)
+{
+  MIDI_QueueTypeDef *q = MIDI_PortOut[port];
+  uint32_t len = 0;
+  uint32_t n;
+  uint32_t evt;
+
+  if (((DIN_DMA_TX->CCR & DMA_CCR_EN) != 0U) && ((DMA1->ISR & DIN_DMA_TX_TC) == 0U))
+  {
+    return;
+  }
+
+  while ((len <= (MIDI_DIN_TX_SIZE - 3U)) && (MIDI_QueueGet(q, &evt) != 0U))
+  {
+    TRACE_MARK(TRACE_ID_QUEUE_GET);
+    n = MIDI_Write(&din_writer, evt, &din_tx_buf[len]);
+    len += n;
+    TRACE_MARK(TRACE_ID_MIDI_TX);
+    TELEM_MSG_OUT(port, n);
+  }
+
+  if (len != 0U)
+  {
+    TELEM_LatencyEnd(TELEM_PATH_USB_TO_PORT, q->Tail);
+    DIN_DMA_TX->CCR = 0;
+    DMA1->IFCR = DIN_DMA_TX_CLEAR;
+    DIN_DMA_TX->CNDTR = len;
+    DIN_DMA_TX->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE | DMA_CCR_EN;
+  }
+}
+
+static void MIDI_DIN_Poll(uint32_t port)
+{
+  MIDI_DIN_Receive(port);
+  MIDI_DIN_Transmit(port);
+}
+
+/**
+  * @brief  Spin until a number of core clock ticks have passed since a
+  *         SysTick reading. Good for less than one tick period (1 ms).
+  */
+static void MIDI_DIN_WaitTicks(uint32_t ref, uint32_t ticks)
+{
+  int32_t elapsed;
+
+  do
+  {
+    elapsed = (int32_t)(ref - SysTick->VAL);
+    if (elapsed < 0)
+    {
+      elapsed += (int32_t)(SysTick->LOAD + 1U);
+    }
+  } while ((uint32_t)elapsed < ticks);
+}
+
+/**
+  * @brief  Sample the byte whose start bit woke the core. The USART was
+  *         clocked off during the edge and would lock onto a data bit, so
+  *         the line is read bit by bit from the middle of D0 on.
+  * @param  wake_us: time since the start bit edge
+  * @retval 1 if a byte with a valid stop bit was read into *byte
+  */
+static uint32_t MIDI_DIN_Capture(uint32_t wake_us, uint8_t *byte)
+{
+  uint32_t ref = SysTick->VAL;
+  uint32_t tpu = SystemCoreClock / 1000000U;
+  uint32_t bit;
+  uint32_t val = 0;
+
+  if (wake_us >= (DIN_BIT_US + DIN_BIT_US / 2U))
+  {
+    return 0;
+  }
+  /* Bits 1..8 are data, LSB first, bit 9 is the stop bit */
+  for (bit = 1; bit <= 9U; bit++)
+  {
+    MIDI_DIN_WaitTicks(ref, (bit * DIN_BIT_US + DIN_BIT_US / 2U - wake_us) * tpu);
+    val |= (uint32_t)((GPIOA->IDR & DIN_RX_PIN) != 0U) << (bit - 1U);
+  }
+  *byte = (uint8_t)val;
+  return (val & 0x100U) != 0U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  USART2 interrupt: a byte arrived. The DMA usually has it out of
+  *         RDR before this runs; either way the handler leaves it alone.
+  * @retval None
+  */
+__RAM_FUNC void MIDI_DIN_USART_IRQHandler(void)
+{
+  SCHED_Post(SCHED_EVT_MIDI);
+}
+
+/**
+  * @brief  DMA channel 4/5 interrupt: the TX batch has left. The TC flag
+  *         stays set for MIDI_DIN_Transmit(), only the interrupt is turned
+  *         off.
+  * @retval None
+  */
+__RAM_FUNC void MIDI_DIN_DMA_IRQHandler(void)
+{
+  DIN_DMA_TX->CCR &= ~DMA_CCR_TCIE;
+  SCHED_Post(SCHED_EVT_MIDI);
+}
+
+/**
+  * @brief  Wake on a start bit while the USB bus is suspended.
+  */
+void USBD_Power_StopEnter(void)
+{
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+  DIN_USART->CR1 &= ~USART_CR1_RE;
+  EXTI->FTSR |= DIN_RX_EXTI;
+  EXTI->PR = DIN_RX_EXTI;
+  EXTI->IMR |= DIN_RX_EXTI;
+  NVIC_ClearPendingIRQ(EXTI2_3_IRQn);
+  NVIC_EnableIRQ(EXTI2_3_IRQn);
+}
+
+/**
+  * @brief  Recover the waking byte and ask for a remote wakeup. The EXTI
+  *         interrupt only serves as a wake source: it is disabled and
+  *         cleared here, before interrupts are unmasked.
+  */
+uint32_t USBD_Power_StopExit(uint32_t wake_us)
+{
+  uint32_t woken = (EXTI->PR & DIN_RX_EXTI) != 0U;
+  uint8_t byte;
+
+  if (woken != 0U)
+  {
+    if (MIDI_DIN_Capture(wake_us, &byte) != 0U)
+    {
+      MIDI_DIN_Byte(din_port, byte);
+    }
+    else
+    {
+      TELEM_DROP(din_port, TELEM_DROP_FRAMING);
+    }
+  }
+
+  NVIC_DisableIRQ(EXTI2_3_IRQn);
+  EXTI->IMR &= ~DIN_RX_EXTI;
+  EXTI->PR = DIN_RX_EXTI;
+  NVIC_ClearPendingIRQ(EXTI2_3_IRQn);
+  DIN_USART->CR1 |= USART_CR1_RE;
+  return woken;
+}
+
+/* Exported variables --------------------------------------------------------*/
+const MIDI_DriverTypeDef MIDI_DIN_Driver =
+{
+  MIDI_DIN_Init,
+  MIDI_DIN_Poll,
+};
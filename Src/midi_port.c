@@ -0,0 +1,272 @@
+/**
+  ******************************************************************************
+  * @file    midi_port.c
+  * @brief   MIDI ports, their routing and the internal port drivers.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "midi_port.h"
+#include "midi_din.h"
+#include "midi_stream.h"
+#include "usbd_midi.h"
+#include "telemetry.h"
+#include "sched.h"
+#include "ramfunc.h"
+#include "boot.h"
+#include "nvm.h"
+#include "sysex_update.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define MIDI_PORT_QUEUE(__ID__, __NAME__, __DRV__)                             \
+  MIDI_QUEUE_DEFINE(midi_out_##__ID__, MIDI_OUT_QUEUE_SIZE,                    \
+                    &TELEM.Port[MIDI_PORT_##__ID__].OutQueueHwm);
+#define MIDI_PORT_OUT(__ID__, __NAME__, __DRV__)                               \
+  [MIDI_PORT_##__ID__] = &midi_out_##__ID__,
+#define MIDI_PORT_DRIVER(__ID__, __NAME__, __DRV__)  &__DRV__,
+
+/* MIDI_PORT_COUNT must match the list */
+typedef char midi_port_count_check[(MIDI_PORT_LIST_COUNT == MIDI_PORT_COUNT) ? 1 : -1];
+
+#if (MIDI_OUT_QUEUE_HIGH > (MIDI_OUT_QUEUE_SIZE - 16)) || (MIDI_OUT_QUEUE_LOW > MIDI_OUT_QUEUE_HIGH)
+#error "MIDI_OUT_QUEUE_HIGH/LOW out of range"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+MIDI_PORT_LIST(MIDI_PORT_QUEUE)
+
+static const MIDI_DriverTypeDef *const midi_port_driver[MIDI_PORT_COUNT] =
+{
+  MIDI_PORT_LIST(MIDI_PORT_DRIVER)
+};
+
+/* Exported variables --------------------------------------------------------*/
+/* Not const: the USB interrupt reads it from RAM code, see ramfunc.h */
+MIDI_QueueTypeDef *MIDI_PortOut[MIDI_PORT_COUNT] =
+{
+  MIDI_PORT_LIST(MIDI_PORT_OUT)
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Fill level of the fullest port queue.
+  */
+__RAM_FUNC static uint32_t MIDI_Port_MaxLevel(void)
+{
+  uint32_t level = 0;
+  uint32_t port;
+
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    if (MIDI_QueueLevel(MIDI_PortOut[port]) > level)
+    {
+      level = MIDI_QueueLevel(MIDI_PortOut[port]);
+    }
+  }
+  return level;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Compile the routes and initialise every port driver.
+  * @retval None
+  */
+void MIDI_Port_Init(void)
+{
+  uint32_t port;
+
+  (void)MIDI_Route_Init();
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    if (midi_port_driver[port]->Init != NULL)
+    {
+      midi_port_driver[port]->Init(port);
+    }
+  }
+}
+
+/**
+  * @brief  Ports whose output comes back in as their input: those served by
+  *         the loopback and monitor drivers.
+  * @retval Bit n set for port n
+  */
+uint32_t MIDI_Port_EchoMask(void)
+{
+  uint32_t mask = 0;
+  uint32_t port;
+
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    if ((midi_port_driver[port] == &MIDI_Loopback_Driver) ||
+        (midi_port_driver[port] == &MIDI_Monitor_Driver))
+    {
+      mask |= 1UL << port;
+    }
+  }
+  return mask;
+}
+
+/**
+  * @brief  Run every port driver once, then push queued events to the host.
+  *         Call from the main loop.
+  * @retval None
+  */
+void MIDI_Port_Poll(void)
+{
+  uint32_t port;
+
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    midi_port_driver[port]->Poll(port);
+  }
+  USBD_MIDI_Flush();
+  TELEM_LatencyPoll();
+
+  if ((USBD_MIDI_OutPaused() != 0U) && (MIDI_Port_MaxLevel() <= MIDI_OUT_QUEUE_LOW))
+  {
+    USBD_MIDI_OutResume();
+  }
+}
+
+/**
+  * @brief  Route one event from the input of a port. Main loop.
+  * @param  port: port the event came in on
+  * @param  evt: USB-MIDI event packet
+  * @retval None
+  */
+void MIDI_Port_Input(uint32_t port, uint32_t evt)
+{
+  const MIDI_RouteTableTypeDef *t = MIDI_Route;
+  uint32_t src = MIDI_PORT_COUNT + port;
+  uint32_t mask = MIDI_Route_Lookup(t, src, evt);
+  uint32_t primask;
+  uint32_t out;
+  uint32_t dst;
+
+  for (dst = 0; mask != 0U; dst++, mask >>= 1)
+  {
+    if ((mask & 1U) == 0U)
+    {
+      continue;
+    }
+    out = MIDI_Route_Transform(t, src, dst, evt);
+    if (dst >= MIDI_PORT_COUNT)
+    {
+      USBD_MIDI_Send((out & ~0xF0U) | ((dst - MIDI_PORT_COUNT) << 4));
+      continue;
+    }
+
+    /* The USB interrupt feeds the same queue and drop counter */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (MIDI_QueuePut(MIDI_PortOut[dst], out) == 0U)
+    {
+      TELEM_DROP(dst, TELEM_DROP_QUEUE_FULL);
+      TRACE_MARK(TRACE_ID_QUEUE_DROP);
+    }
+    __set_PRIMASK(primask);
+    SCHED_Post(SCHED_EVT_MIDI);
+  }
+}
+
+/**
+  * @brief  Events from the host, called from the USB interrupt.
+  */
+__RAM_FUNC void USBD_MIDI_OutEvent(uint32_t evt)
+{
+  MIDI_Port_Route(evt);
+  SCHED_Post(SCHED_EVT_MIDI);
+}
+
+/**
+  * @brief  Flow control for the MIDI OUT endpoint, called from the USB
+  *         interrupt after every packet.
+  */
+__RAM_FUNC uint32_t USBD_MIDI_OutReady(void)
+{
+  return MIDI_Port_MaxLevel() <= MIDI_OUT_QUEUE_HIGH;
+}
+
+/* Internal port drivers -----------------------------------------------------*/
+
+/**
+  * @brief  Feed the events routed to a port back in as its input, which
+  *         the routes usually send to the host on the port's own cable.
+  *         Serves both the loopback and the monitor port. Only the events
+  *         queued on entry are taken, so what the echo routes back to an
+  *         echo port waits for the next poll; the route compiler rejects
+  *         rules that would make that go on forever.
+  */
+static void MIDI_Echo_Poll(uint32_t port)
+{
+  MIDI_QueueTypeDef *q = MIDI_PortOut[port];
+  uint32_t n = MIDI_QueueLevel(q);
+  uint32_t evt;
+
+  while ((n-- != 0U) && (MIDI_QueueGet(q, &evt) != 0U))
+  {
+    TRACE_MARK(TRACE_ID_QUEUE_GET);
+    TELEM_MSG_OUT(port, MIDI_CinLength[evt & 0x0FU]);
+    TELEM_MSG_IN(port, MIDI_CinLength[evt & 0x0FU]);
+    MIDI_Port_Input(port, evt);
+  }
+}
+
+const MIDI_DriverTypeDef MIDI_Loopback_Driver =
+{
+  NULL,
+  MIDI_Echo_Poll,
+};
+
+const MIDI_DriverTypeDef MIDI_Monitor_Driver =
+{
+  NULL,
+  MIDI_Echo_Poll,
+};
+
+/**
+  * @brief  System port: restart into the bootloader on the ENTER message
+  *         of the SysEx update (sysex_update.h), once the configuration
+  *         writer is idle. Everything else sent to the port is dropped.
+  */
+static void MIDI_System_Poll(uint32_t port)
+{
+  static const uint8_t enter[] =
+  {
+    0xF0, SYSEX_UPD_MANUFACTURER, SYSEX_UPD_DEVICE, SYSEX_UPD_ENTER, 0xF7
+  };
+  static uint8_t match;
+  MIDI_QueueTypeDef *q = MIDI_PortOut[port];
+  uint32_t evt;
+  uint32_t len;
+  uint32_t i;
+  uint8_t b;
+
+  while (MIDI_QueueGet(q, &evt) != 0U)
+  {
+    TRACE_MARK(TRACE_ID_QUEUE_GET);
+    len = MIDI_CinLength[evt & 0x0FU];
+    TELEM_MSG_OUT(port, len);
+    for (i = 1; i <= len; i++)
+    {
+      b = (uint8_t)(evt >> (8U * i));
+      if (b == 0xF0U)
+      {
+        match = 0;
+      }
+      match = ((match < sizeof(enter)) && (b == enter[match])) ? (uint8_t)(match + 1U) : 0xFFU;
+    }
+  }
+
+  if ((match == sizeof(enter)) && (NVM_Busy() == 0U))
+  {
+    BOOT_EnterDfu();
+  }
+}
+
+const MIDI_DriverTypeDef MIDI_System_Driver =
+{
+  NULL,
+  MIDI_System_Poll,
+};
@@ -0,0 +1,634 @@
+/**
+  ******************************************************************************
+  * @file    midi_route.c
+  * @brief   Routing rule compiler, table swap and benchmark.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "midi_route.h"
+#include "midi_port.h"
+#include "telemetry.h"
+#include "cfg_log.h"
+#include "pt.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MIDI_ROUTE_PORTS_MASK           ((1UL << MIDI_PORT_COUNT) - 1U)
+#define MIDI_ROUTE_BENCH_EVENTS         1024U
+
+#if (MIDI_ROUTE_ROWS < 2) || (MIDI_ROUTE_ROWS > 255)
+#error "MIDI_ROUTE_ROWS must be between 2 and 255"
+#endif
+
+#if (MIDI_ROUTE_CFG_XFORM_KEY + 1) > CFG_KEY_COUNT
+#error "MIDI_ROUTE_CFG_KEYS keys from MIDI_ROUTE_CFG_KEY, and one for the transforms, exceed CFG_KEY_COUNT"
+#endif
+
+#if (MIDI_XFORMS < 1) || ((MIDI_XFORMS * 12) > CFG_VALUE_MAX)
+#error "MIDI_XFORMS must be at least 1 and its parameters fit a configuration value"
+#endif
+
+/* Private macro -------------------------------------------------------------*/
+#define MIDI_ROUTE_RULE(__SRC__, __CLASSES__, __CHANNELS__, __DST__, __XFORM__) \
+  { (__SRC__), (__XFORM__), (__CHANNELS__), (__CLASSES__), (__DST__) },
+#define MIDI_ROUTE_XFORM(__ID__, ...)                                          \
+  [MIDI_XFORM_##__ID__] = { MIDI_XFORM_DEFAULTS, __VA_ARGS__ },
+#define MIDI_ROUTE_FILTER_IN(__PORT__, __IN_CLASSES__, __IN_CHANNELS__, __OUT_CLASSES__, __OUT_CHANNELS__) \
+  [MIDI_PORT_COUNT + (__PORT__)] = { (__IN_CLASSES__), (__IN_CHANNELS__) },
+#define MIDI_ROUTE_FILTER_OUT(__PORT__, __IN_CLASSES__, __IN_CHANNELS__, __OUT_CLASSES__, __OUT_CHANNELS__) \
+  [(__PORT__)] = { (__OUT_CLASSES__), (__OUT_CHANNELS__) },
+#define MIDI_ROUTE_FILTER_NONE                                                 \
+  [0 ... (2U * MIDI_PORT_COUNT - 1U)] = { MIDI_CLASS_ALL, MIDI_CHANNELS_ALL },
+
+/* Private variables ---------------------------------------------------------*/
+static const MIDI_RouteRuleTypeDef midi_route_rules[] =
+{
+  MIDI_ROUTE_LIST(MIDI_ROUTE_RULE)
+};
+
+/* By id, 0 unused */
+static const MIDI_XformTypeDef midi_route_xforms[MIDI_XFORM_LISTED] =
+{
+  [MIDI_XFORM_NONE] = { MIDI_XFORM_DEFAULTS },
+  MIDI_XFORM_LIST(MIDI_ROUTE_XFORM)
+};
+
+/* Filters of MIDI_FILTER_LIST, indexed like table sources and destination
+   bits: the host's cables pass everything */
+static const MIDI_RouteFilterTypeDef midi_route_in[2U * MIDI_PORT_COUNT] =
+{
+  MIDI_ROUTE_FILTER_NONE
+  MIDI_FILTER_LIST(MIDI_ROUTE_FILTER_IN)
+};
+
+static const MIDI_RouteFilterTypeDef midi_route_out[2U * MIDI_PORT_COUNT] =
+{
+  MIDI_ROUTE_FILTER_NONE
+  MIDI_FILTER_LIST(MIDI_ROUTE_FILTER_OUT)
+};
+
+/* Keeps the benchmark's lookups from being optimised away */
+static volatile uint32_t midi_route_sink;
+
+/* Not const: the USB interrupt reads them from RAM code, see ramfunc.h */
+static MIDI_RouteTableTypeDef midi_route_table[2];
+
+/* Build job state, see MIDI_Route_Run() */
+static MIDI_RouteSetTypeDef midi_route_set;
+static uint32_t midi_route_src;
+static HAL_StatusTypeDef midi_route_status = HAL_OK;
+
+static uint8_t MIDI_Route_Run(PT_JobTypeDef *job);
+static PT_JOB_DEFINE(midi_route_job, MIDI_Route_Run, 500);
+
+/* Exported variables --------------------------------------------------------*/
+const MIDI_RouteTableTypeDef *volatile MIDI_Route = &midi_route_table[0];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Table source of a rule source, MIDI_ROUTE_SRC_NONE for cables and
+  *         ports that do not exist.
+  */
+static uint32_t MIDI_Route_Source(uint32_t src)
+{
+  uint32_t n = src & 0x0FU;
+
+  if ((src & ~(MIDI_ROUTE_FROM_PORT_FLAG | 0x0FU)) != 0U)
+  {
+    return MIDI_ROUTE_SRC_NONE;
+  }
+  if (n >= MIDI_PORT_COUNT)
+  {
+    return MIDI_ROUTE_SRC_NONE;
+  }
+  return ((src & MIDI_ROUTE_FROM_PORT_FLAG) != 0U) ? (MIDI_PORT_COUNT + n) : n;
+}
+
+/**
+  * @brief  OR a destination mask into the columns of a row.
+  */
+static void MIDI_Route_Fill(MIDI_RouteMaskTypeDef *row, uint32_t cols, uint32_t mask)
+{
+  uint32_t col;
+
+  for (col = 0; cols != 0U; col++, cols >>= 1)
+  {
+    if ((cols & 1U) != 0U)
+    {
+      row[col] |= (MIDI_RouteMaskTypeDef)mask;
+    }
+  }
+}
+
+/**
+  * @brief  Mark the messages of some classes and channels in the grid of a
+  *         source as going to the destinations in mask.
+  */
+static void MIDI_Route_Mark(MIDI_RouteMaskTypeDef grid[16][16], uint32_t classes,
+                            uint32_t channels, uint32_t mask)
+{
+  uint32_t cin;
+  uint32_t sys;
+
+  /* Channel messages: the CIN is the status nibble, the column the
+     channel */
+  for (cin = 0x8U; cin <= 0xEU; cin++)
+  {
+    if ((classes & (1UL << cin)) != 0U)
+    {
+      MIDI_Route_Fill(grid[cin], channels, mask);
+    }
+  }
+
+  /* System common and real-time: the column is the status, where F7
+     ends a SysEx */
+  sys = (classes >> 16) & ~0x80U;
+  if ((classes & MIDI_CLASS_SYSEX) != 0U)
+  {
+    sys |= 0x80U;
+    /* SysEx start, continuation and ends carry data bytes */
+    MIDI_Route_Fill(grid[0x4], MIDI_CHANNELS_ALL, mask);
+    MIDI_Route_Fill(grid[0x6], MIDI_CHANNELS_ALL, mask);
+    MIDI_Route_Fill(grid[0x7], MIDI_CHANNELS_ALL, mask);
+  }
+  MIDI_Route_Fill(grid[0x2], sys, mask);
+  MIDI_Route_Fill(grid[0x3], sys, mask);
+  MIDI_Route_Fill(grid[0x5], sys, mask);
+  MIDI_Route_Fill(grid[0xF], sys, mask);
+}
+
+/**
+  * @brief  Rule i of the configured rule set.
+  */
+static void MIDI_Route_Configured(uint32_t i, MIDI_RouteRuleTypeDef *rule)
+{
+  *rule = midi_route_rules[i];
+}
+
+/**
+  * @brief  Transform id i of MIDI_XFORM_LIST.
+  */
+static void MIDI_Route_ConfiguredXform(uint32_t i, MIDI_XformTypeDef *x)
+{
+  *x = midi_route_xforms[i];
+}
+
+static const MIDI_RouteSetTypeDef midi_route_configured =
+{
+  MIDI_Route_Configured, sizeof(midi_route_rules) / sizeof(midi_route_rules[0]),
+  MIDI_Route_ConfiguredXform, MIDI_XFORM_LISTED - 1U
+};
+
+/**
+  * @brief  Rule i of those stored in the configuration log. Each key holds
+  *         up to MIDI_ROUTE_CFG_RULES of them; missing ones route nowhere.
+  */
+static void MIDI_Route_Stored(uint32_t i, MIDI_RouteRuleTypeDef *rule)
+{
+  const uint8_t *v;
+  uint32_t len = 0;
+  uint32_t off = (i % MIDI_ROUTE_CFG_RULES) * sizeof(*rule);
+
+  v = CFG_Get(MIDI_ROUTE_CFG_KEY + i / MIDI_ROUTE_CFG_RULES, &len);
+  if ((v == NULL) || ((off + sizeof(*rule)) > len))
+  {
+    memset(rule, 0, sizeof(*rule));
+    return;
+  }
+  /* Values are only halfword aligned */
+  memcpy(rule, &v[off], sizeof(*rule));
+}
+
+/**
+  * @brief  Transform id i of those stored in the configuration log.
+  */
+static void MIDI_Route_StoredXform(uint32_t i, MIDI_XformTypeDef *x)
+{
+  const uint8_t *v = CFG_Get(MIDI_ROUTE_CFG_XFORM_KEY, NULL);
+
+  /* Values are only halfword aligned */
+  memcpy(x, &v[(i - 1U) * sizeof(*x)], sizeof(*x));
+}
+
+/**
+  * @brief  Pick the rule set to compile: the stored rules if there are any,
+  *         else MIDI_ROUTE_LIST and MIDI_XFORM_LIST.
+  */
+static void MIDI_Route_Select(void)
+{
+  uint32_t len = 0;
+  uint32_t key;
+
+  midi_route_set = midi_route_configured;
+  for (key = 0; key < MIDI_ROUTE_CFG_KEYS; key++)
+  {
+    if (CFG_Get(MIDI_ROUTE_CFG_KEY + key, NULL) != NULL)
+    {
+      midi_route_set.Rule = MIDI_Route_Stored;
+      midi_route_set.Rules = MIDI_ROUTE_CFG_MAX;
+      midi_route_set.Xform = MIDI_Route_StoredXform;
+      (void)CFG_Get(MIDI_ROUTE_CFG_XFORM_KEY, &len);
+      midi_route_set.Xforms = len / sizeof(MIDI_XformTypeDef);
+    }
+  }
+}
+
+/**
+  * @brief  The table not in use.
+  */
+static MIDI_RouteTableTypeDef *MIDI_Route_Spare(void)
+{
+  return (MIDI_Route == &midi_route_table[0]) ? &midi_route_table[1] : &midi_route_table[0];
+}
+
+/**
+  * @brief  Bit of a table in the transform table pool.
+  */
+static uint32_t MIDI_Route_Owner(const MIDI_RouteTableTypeDef *t)
+{
+  return (t == &midi_route_table[0]) ? 1U : 2U;
+}
+
+/**
+  * @brief  Empty a table that is out of use: every source to row 0, which
+  *         routes nowhere, and no transforms.
+  */
+static void MIDI_Route_Clear(MIDI_RouteTableTypeDef *t)
+{
+  uint32_t i;
+
+  MIDI_Xform_Release(MIDI_Route_Owner(t));
+  memset(t, 0, sizeof(*t));
+  t->Rows = 1;
+  for (i = 0; i < MIDI_CABLES; i++)
+  {
+    t->Cable[i] = (uint8_t)((i < MIDI_PORT_COUNT) ? i : MIDI_ROUTE_SRC_NONE);
+  }
+}
+
+/**
+  * @brief  Compile the rules of one source. Each source is built in a
+  *         scratch grid of code index number by column, whose rows are
+  *         then looked up in, or added to, the shared rows of *t. A rule
+  *         only marks, per destination, the classes and channels that
+  *         both the source's input filter and the destination's output
+  *         filter pass.
+  * @retval HAL_OK, HAL_ERROR when out of rows or a rule names a transform
+  *         the set does not have
+  */
+static HAL_StatusTypeDef MIDI_Route_Build(MIDI_RouteTableTypeDef *t, uint32_t src,
+                                          const MIDI_RouteSetTypeDef *set)
+{
+  MIDI_RouteMaskTypeDef grid[16][16];
+  MIDI_RouteRuleTypeDef rule;
+  uint32_t cin;
+  uint32_t row;
+  uint32_t mask;
+  uint32_t dst;
+  uint32_t i;
+
+  memset(grid, 0, sizeof(grid));
+  for (i = 0; i < set->Rules; i++)
+  {
+    set->Rule(i, &rule);
+    if (MIDI_Route_Source(rule.Src) != src)
+    {
+      continue;
+    }
+    mask = rule.Dst & MIDI_ROUTE_PORTS_MASK;
+    if (src >= MIDI_PORT_COUNT)
+    {
+      mask |= ((rule.Dst >> 16) & MIDI_ROUTE_PORTS_MASK) << MIDI_PORT_COUNT;
+    }
+    if (mask == 0U)
+    {
+      continue;
+    }
+    if (rule.Xform > set->Xforms)
+    {
+      return HAL_ERROR;
+    }
+    for (dst = 0; dst < (2U * MIDI_PORT_COUNT); dst++)
+    {
+      if ((mask & (1UL << dst)) == 0U)
+      {
+        continue;
+      }
+      if (rule.Xform != MIDI_XFORM_NONE)
+      {
+        t->Xform[src][dst] = rule.Xform;
+      }
+      MIDI_Route_Mark(grid, rule.Classes & midi_route_in[src].Classes & midi_route_out[dst].Classes,
+                      rule.Channels & midi_route_in[src].Channels & midi_route_out[dst].Channels,
+                      1UL << dst);
+    }
+  }
+
+  for (cin = 0; cin < 16U; cin++)
+  {
+    for (row = 0; (row < t->Rows) && (memcmp(t->Row[row], grid[cin], sizeof(grid[cin])) != 0); row++)
+    {
+    }
+    if (row == t->Rows)
+    {
+      if (row == MIDI_ROUTE_ROWS)
+      {
+        return HAL_ERROR;
+      }
+      memcpy(t->Row[row], grid[cin], sizeof(grid[cin]));
+      t->Rows++;
+    }
+    t->Index[src][cin] = (uint8_t)row;
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Whether the echo ports of a compiled table feed back into
+  *         themselves, directly or through each other: an event would then
+  *         go round for ever and keep the MIDI task posted. Any row of an
+  *         echo port that reaches an echo port counts as a link, whatever
+  *         its class, channel or transform.
+  */
+static uint32_t MIDI_Route_Loops(const MIDI_RouteTableTypeDef *t)
+{
+  uint32_t echo = MIDI_Port_EchoMask();
+  uint32_t reach[MIDI_PORT_COUNT];
+  uint32_t port;
+  uint32_t cin;
+  uint32_t col;
+  uint32_t via;
+
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    reach[port] = 0;
+    if ((echo & (1UL << port)) == 0U)
+    {
+      continue;
+    }
+    for (cin = 0; cin < 16U; cin++)
+    {
+      for (col = 0; col < 16U; col++)
+      {
+        reach[port] |= t->Row[t->Index[MIDI_PORT_COUNT + port][cin]][col];
+      }
+    }
+    reach[port] &= echo;
+  }
+
+  /* Transitive closure, one intermediate port at a time */
+  for (via = 0; via < MIDI_PORT_COUNT; via++)
+  {
+    for (port = 0; port < MIDI_PORT_COUNT; port++)
+    {
+      if ((reach[port] & (1UL << via)) != 0U)
+      {
+        reach[port] |= reach[via];
+      }
+    }
+  }
+
+  for (port = 0; port < MIDI_PORT_COUNT; port++)
+  {
+    if ((reach[port] & (1UL << port)) != 0U)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Compile the transforms of a rule set into a table.
+  * @retval HAL_OK, HAL_ERROR when there are more than MIDI_XFORMS or the
+  *         transform table pool is full
+  */
+static HAL_StatusTypeDef MIDI_Route_Xforms(MIDI_RouteTableTypeDef *t, const MIDI_RouteSetTypeDef *set)
+{
+  MIDI_XformTypeDef x;
+  uint32_t i;
+
+  if (set->Xforms > MIDI_XFORMS)
+  {
+    return HAL_ERROR;
+  }
+  for (i = 1; i <= set->Xforms; i++)
+  {
+    set->Xform(i, &x);
+    if (MIDI_Xform_Compile(&t->Xf[i], &x, MIDI_Route_Owner(t)) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Compile a rule set in one go. Costs one pass over the rules per
+  *         source; routing afterwards does not depend on the rule count.
+  *         Rules from the host to the host are left out, see midi_route.h.
+  * @param  t: table to fill, must not be in use
+  * @param  set: rules and transforms
+  * @retval HAL_OK, HAL_ERROR when the rules do not fit or loop echo ports
+  *         into themselves; *t then routes nothing
+  */
+static HAL_StatusTypeDef MIDI_Route_Compile(MIDI_RouteTableTypeDef *t, const MIDI_RouteSetTypeDef *set)
+{
+  uint32_t src;
+
+  MIDI_Route_Clear(t);
+  if (MIDI_Route_Xforms(t, set) != HAL_OK)
+  {
+    MIDI_Route_Clear(t);
+    return HAL_ERROR;
+  }
+  for (src = 0; src < MIDI_ROUTE_SRC_NONE; src++)
+  {
+    if (MIDI_Route_Build(t, src, set) != HAL_OK)
+    {
+      MIDI_Route_Clear(t);
+      return HAL_ERROR;
+    }
+  }
+  if (MIDI_Route_Loops(t) != 0U)
+  {
+    MIDI_Route_Clear(t);
+    return HAL_ERROR;
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Build job: compile the selected rules into the spare table a
+  *         source per step, then publish it. A failed build leaves the
+  *         table in use alone.
+  */
+static uint8_t MIDI_Route_Run(PT_JobTypeDef *job)
+{
+  MIDI_RouteTableTypeDef *t = MIDI_Route_Spare();
+
+  PT_BEGIN(job);
+
+  /* Stored rules still being written are read once they are through */
+  PT_WAIT_UNTIL(job, CFG_Status() != HAL_BUSY);
+  MIDI_Route_Select();
+  MIDI_Route_Clear(t);
+  if (MIDI_Route_Xforms(t, &midi_route_set) != HAL_OK)
+  {
+    MIDI_Route_Clear(t);
+    midi_route_status = HAL_ERROR;
+    PT_EXIT(job);
+  }
+  PT_YIELD(job);
+  for (midi_route_src = 0; midi_route_src < MIDI_ROUTE_SRC_NONE; midi_route_src++)
+  {
+    if (MIDI_Route_Build(t, midi_route_src, &midi_route_set) != HAL_OK)
+    {
+      MIDI_Route_Clear(t);
+      midi_route_status = HAL_ERROR;
+      PT_EXIT(job);
+    }
+    PT_YIELD(job);
+  }
+  if (MIDI_Route_Loops(t) != 0U)
+  {
+    MIDI_Route_Clear(t);
+    midi_route_status = HAL_ERROR;
+    PT_EXIT(job);
+  }
+
+  MIDI_Route = t;
+  /* The quiescent point: lookups that loaded the old table have returned
+     before this job steps again, see midi_route.h */
+  PT_YIELD(job);
+  midi_route_status = HAL_OK;
+
+  PT_END(job);
+}
+
+/**
+  * @brief  Rule i of the benchmark: a source, a channel class or all of
+  *         them, a channel range and a destination set, each drawn from a
+  *         multiplicative hash of i, as a hand-written rule set varies them.
+  *         Row use grows with the rule count until a source's classes and
+  *         ranges need more than MIDI_ROUTE_ROWS distinct rows, from where
+  *         the compile fails: the rule count at which that happens is the
+  *         row limit that route-bench reports. Port sources leave the echo
+  *         ports out, so that no rule set is refused as a loop.
+  */
+static void MIDI_Route_BenchRule(uint32_t i, MIDI_RouteRuleTypeDef *rule)
+{
+  uint32_t x = (i + 1U) * 2654435761U;
+  uint32_t src = (x >> 16) % (2U * MIDI_PORT_COUNT);
+  uint32_t lo = (x >> 8) & 0x0FU;
+  uint32_t hi = lo + ((x >> 12) & 0x0FU);
+
+  rule->Src = (uint8_t)((src < MIDI_PORT_COUNT) ? src : MIDI_FROM_PORT(src - MIDI_PORT_COUNT));
+  rule->Xform = MIDI_XFORM_NONE;
+  rule->Classes = ((x & 7U) == 0U) ? MIDI_CLASS_ALL : (MIDI_CLASS_NOTE_OFF << ((x >> 1) % 7U));
+  rule->Channels = MIDI_CHANNELS(lo, (hi > 15U) ? 15U : hi);
+  rule->Dst = MIDI_TO_PORT((x >> 20) % MIDI_PORT_COUNT) | MIDI_TO_HOST((x >> 24) % MIDI_PORT_COUNT);
+  if (src >= MIDI_PORT_COUNT)
+  {
+    rule->Dst &= ~MIDI_Port_EchoMask();
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Compile the rule set into the first table and put it in use.
+  *         Stored rules that do not compile give way to MIDI_ROUTE_LIST.
+  *         Call before USB starts, after CFG_Init().
+  * @retval Result of compiling the stored rules, or MIDI_ROUTE_LIST
+  */
+HAL_StatusTypeDef MIDI_Route_Init(void)
+{
+  HAL_StatusTypeDef status;
+
+  MIDI_Xform_Init();
+  MIDI_Route_Select();
+  status = MIDI_Route_Compile(&midi_route_table[0], &midi_route_set);
+  if ((status != HAL_OK) && (midi_route_set.Rule != MIDI_Route_Configured))
+  {
+    (void)MIDI_Route_Compile(&midi_route_table[0], &midi_route_configured);
+  }
+  MIDI_Route = &midi_route_table[0];
+  midi_route_status = status;
+  return status;
+}
+
+/**
+  * @brief  Rebuild the tables from the rule set in the background, after
+  *         the stored rules have changed. A build already running starts
+  *         over. Main loop context only.
+  * @retval None
+  */
+void MIDI_Route_Apply(void)
+{
+  midi_route_status = HAL_BUSY;
+  PT_Start(&midi_route_job);
+}
+
+/**
+  * @brief  Result of the last MIDI_Route_Apply().
+  * @retval HAL_BUSY until the new table is in use, then HAL_OK; HAL_ERROR
+  *         when the rules do not fit, the old table staying in use
+  */
+HAL_StatusTypeDef MIDI_Route_Status(void)
+{
+  return midi_route_status;
+}
+
+/**
+  * @brief  Time the compiler on n generated rules and the routing of a
+  *         packet through the result. Both run on the spare table, so
+  *         MIDI traffic carries on meanwhile, and its interrupts count in
+  *         the timings. Main loop only.
+  * @param  n: number of rules
+  * @param  result: filled with the timings
+  * @retval None
+  */
+void MIDI_Route_Bench(uint32_t n, MIDI_RouteBenchTypeDef *result)
+{
+  static const MIDI_RouteSetTypeDef bench = { MIDI_Route_BenchRule, 0, NULL, 0 };
+  MIDI_RouteSetTypeDef set = bench;
+  MIDI_RouteTableTypeDef *t = MIDI_Route_Spare();
+  uint32_t dests = 0;
+  uint32_t mask;
+  uint32_t evt;
+  uint32_t cin;
+  uint32_t t0;
+  uint32_t i;
+
+  result->CompileUs = 0;
+  result->LookupNs = 0;
+  result->Rows = 0;
+  result->Status = HAL_BUSY;
+  if (PT_Running(&midi_route_job) == 0U)
+  {
+    t0 = TELEM_NowUs();
+    set.Rules = n;
+    result->Status = (uint8_t)MIDI_Route_Compile(t, &set);
+    result->CompileUs = TELEM_NowUs() - t0;
+    result->Rows = (result->Status == HAL_OK) ? t->Rows : MIDI_ROUTE_ROWS;
+
+    t0 = TELEM_NowUs();
+    for (i = 0; i < MIDI_ROUTE_BENCH_EVENTS; i++)
+    {
+      cin = 0x8U + (i % 7U);
+      evt = cin | ((i % MIDI_PORT_COUNT) << 4) | (((cin << 4) | ((i >> 3) & 0x0FU)) << 8);
+      for (mask = MIDI_Route_Lookup(t, t->Cable[(evt >> 4) & 0x0FU], evt); mask != 0U; mask >>= 1)
+      {
+        dests += mask & 1U;
+      }
+    }
+    result->LookupNs = ((TELEM_NowUs() - t0) * 1000U) / MIDI_ROUTE_BENCH_EVENTS;
+    midi_route_sink = dests;
+  }
+
+  /* Rules goes last, the USB interrupt may read the result at any time */
+  __DMB();
+  result->Rules = (uint16_t)n;
+}
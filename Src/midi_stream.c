@@ -0,0 +1,216 @@
+/**
+  ******************************************************************************
+  * @file    midi_stream.c
+  * @brief   MIDI 1.0 byte stream <-> USB-MIDI event packet conversion.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "midi_stream.h"
+
+/* Exported variables --------------------------------------------------------*/
+/* MIDI bytes carried by each code index number */
+const uint8_t MIDI_CinLength[16] =
+{
+  0, 0, 2, 3, 3, 1, 2, 3, 3, 3, 3, 3, 2, 2, 3, 1
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static inline uint32_t MIDI_Pack(const MIDI_ParserTypeDef *p, uint32_t cin)
+{
+  return cin | ((uint32_t)p->Cable << 4) | ((uint32_t)p->Buf[0] << 8) |
+         ((uint32_t)p->Buf[1] << 16) | ((uint32_t)p->Buf[2] << 24);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Reset a parser.
+  * @param  p: parser state
+  * @param  cable: cable number stamped into the packets it produces
+  * @retval None
+  */
+void MIDI_Parser_Init(MIDI_ParserTypeDef *p, uint32_t cable)
+{
+  p->Cable = (uint8_t)(cable & 0x0FU);
+  p->Status = 0;
+  p->Need = 0;
+  p->Idx = 0;
+}
+
+/**
+  * @brief  Feed one received byte.
+  * @param  p: parser state
+  * @param  byte: byte from the wire
+  * @param  evt: receives the packet when MIDI_PARSE_EVENT is returned
+  * @retval MIDI_PARSE_xxx
+  */
+uint32_t MIDI_Parse(MIDI_ParserTypeDef *p, uint8_t byte, uint32_t *evt)
+{
+  uint32_t result = MIDI_PARSE_NONE;
+
+  /* Real-time messages may appear anywhere, even inside SysEx */
+  if (byte >= 0xF8U)
+  {
+    *evt = 0x0FU | ((uint32_t)p->Cable << 4) | ((uint32_t)byte << 8);
+    return MIDI_PARSE_EVENT;
+  }
+
+  if (byte >= 0x80U)
+  {
+    /* A status byte ends any message in progress */
+    if (byte == 0xF7U)
+    {
+      if (p->Status != 0xF0U)
+      {
+        p->Status = 0;
+        p->Idx = 0;
+        return MIDI_PARSE_ERROR;
+      }
+      /* CIN 5, 6 or 7: SysEx ends with 1, 2 or 3 bytes */
+      result = 0x05U + p->Idx;
+      p->Buf[p->Idx++] = byte;
+      while (p->Idx < 3U)
+      {
+        p->Buf[p->Idx++] = 0;
+      }
+      *evt = MIDI_Pack(p, result);
+      p->Status = 0;
+      p->Idx = 0;
+      return MIDI_PARSE_EVENT;
+    }
+
+    /* An interrupted message or SysEx is lost */
+    if ((p->Idx != 0U) || (p->Status == 0xF0U))
+    {
+      result = MIDI_PARSE_ERROR;
+    }
+
+    if (byte == 0xF6U)
+    {
+      /* Tune request, single byte system common */
+      p->Buf[0] = byte;
+      p->Buf[1] = 0;
+      p->Buf[2] = 0;
+      *evt = MIDI_Pack(p, 0x05U);
+      p->Status = 0;
+      p->Idx = 0;
+      return MIDI_PARSE_EVENT;
+    }
+
+    if ((byte == 0xF4U) || (byte == 0xF5U))
+    {
+      /* Undefined system common */
+      p->Status = 0;
+      p->Idx = 0;
+      return MIDI_PARSE_ERROR;
+    }
+
+    p->Status = byte;
+    p->Buf[0] = byte;
+    p->Idx = 1;
+    if (byte == 0xF0U)
+    {
+      p->Need = 3;
+    }
+    else if ((byte == 0xF1U) || (byte == 0xF3U) || ((byte & 0xE0U) == 0xC0U))
+    {
+      p->Need = 2;
+    }
+    else
+    {
+      p->Need = 3;
+    }
+    return result;
+  }
+
+  /* Data byte */
+  if (p->Status == 0U)
+  {
+    return MIDI_PARSE_ERROR;
+  }
+
+  if (p->Idx == 0U)
+  {
+    if (p->Status == 0xF0U)
+    {
+      p->Buf[p->Idx++] = byte;
+      return MIDI_PARSE_NONE;
+    }
+    /* Running status */
+    p->Buf[0] = p->Status;
+    p->Idx = 1;
+  }
+
+  p->Buf[p->Idx++] = byte;
+  if (p->Idx < p->Need)
+  {
+    return MIDI_PARSE_NONE;
+  }
+
+  if (p->Need == 2U)
+  {
+    p->Buf[2] = 0;
+  }
+  p->Idx = 0;
+
+  if (p->Status == 0xF0U)
+  {
+    /* SysEx start or continue, three bytes */
+    *evt = MIDI_Pack(p, 0x04U);
+  }
+  else if (p->Status >= 0xF0U)
+  {
+    /* Two or three byte system common, cancels running status */
+    *evt = MIDI_Pack(p, p->Need);
+    p->Status = 0;
+  }
+  else
+  {
+    *evt = MIDI_Pack(p, p->Status >> 4);
+  }
+  return MIDI_PARSE_EVENT;
+}
+
+/**
+  * @brief  Serialise one packet for the wire, using running status for
+  *         channel messages.
+  * @param  w: writer state
+  * @param  evt: USB-MIDI event packet
+  * @param  dst: at least 3 bytes
+  * @retval Number of bytes written to dst
+  */
+uint32_t MIDI_Write(MIDI_WriterTypeDef *w, uint32_t evt, uint8_t *dst)
+{
+  uint32_t len = MIDI_CinLength[evt & 0x0FU];
+  uint8_t status = (uint8_t)(evt >> 8);
+  uint32_t i;
+  uint32_t n = 0;
+
+  if (len == 0U)
+  {
+    return 0;
+  }
+
+  if ((status >= 0x80U) && (status < 0xF0U))
+  {
+    if (status == w->Status)
+    {
+      /* Skip the status byte */
+      evt >>= 8;
+      len--;
+    }
+    w->Status = status;
+  }
+  else if (status < 0xF8U)
+  {
+    /* SysEx data and system common cancel running status */
+    w->Status = 0;
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    dst[n++] = (uint8_t)(evt >> (8U + 8U * i));
+  }
+  return n;
+}
@@ -0,0 +1,191 @@
+/**
+  ******************************************************************************
+  * @file    midi_xform.c
+  * @brief   Transform table generation and the shared table pool.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "midi_xform.h"
+
+/* Private define ------------------------------------------------------------*/
+#if (MIDI_XFORM_TABLES < 0) || (MIDI_XFORM_LUTS > 255)
+#error "MIDI_XFORM_TABLES must be at least 0 and leave MIDI_XFORM_LUTS at most 255"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t midi_xform_owner[MIDI_XFORM_LUTS];   /* Routing tables per pool table */
+
+/* Exported variables --------------------------------------------------------*/
+/* Pool table 0 is the identity */
+uint8_t MIDI_XformLut[MIDI_XFORM_LUTS][128];
+
+/* Role of bytes 1 to 3 by code index number */
+uint8_t MIDI_XformRole[3][16] =
+{
+  {
+    [0x8 ... 0xE] = MIDI_XFORM_ROLE_STATUS,
+  },
+  {
+    [0x8] = MIDI_XFORM_ROLE_NOTE,
+    [0x9] = MIDI_XFORM_ROLE_NOTE,
+    [0xA] = MIDI_XFORM_ROLE_NOTE,
+    [0xB] = MIDI_XFORM_ROLE_CC_NUMBER,
+  },
+  {
+    [0x8] = MIDI_XFORM_ROLE_VELOCITY,
+    [0x9] = MIDI_XFORM_ROLE_VELOCITY,
+    [0xB] = MIDI_XFORM_ROLE_CC_VALUE,
+  },
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static int32_t MIDI_Xform_Clamp(int32_t v, int32_t lo, int32_t hi)
+{
+  return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+/**
+  * @brief  Entry i of the table of one role of a transform.
+  * @param  i: the byte without bit 7
+  */
+static uint8_t MIDI_Xform_Entry(const MIDI_XformTypeDef *x, uint32_t role, int32_t i)
+{
+  int32_t v;
+
+  switch (role)
+  {
+  case MIDI_XFORM_ROLE_STATUS:
+    /* 0x00..0x6F are channel statuses, the rest system ones */
+    v = ((x->Channel == MIDI_XFORM_KEEP) || (i >= 0x70)) ? i : ((i & 0x70) | (x->Channel & 0x0F));
+    break;
+
+  case MIDI_XFORM_ROLE_NOTE:
+    v = MIDI_Xform_Clamp(i + x->Transpose, x->NoteLo, x->NoteHi);
+    break;
+
+  case MIDI_XFORM_ROLE_VELOCITY:
+    /* A parabola through 1 and 127, bent up or down by VelCurve, then
+       stretched onto VelLo..VelHi; 0 is a note off and stays */
+    v = i + (x->VelCurve * i * (127 - i)) / (127 * 8);
+    v = MIDI_Xform_Clamp(v, 1, 127);
+    v = x->VelLo + ((v - 1) * ((int32_t)x->VelHi - x->VelLo)) / 126;
+    v = (i == 0) ? 0 : MIDI_Xform_Clamp(v, 1, 127);
+    break;
+
+  case MIDI_XFORM_ROLE_CC_NUMBER:
+    v = (i == x->CcFrom) ? (x->CcTo & 0x7F) : i;
+    break;
+
+  case MIDI_XFORM_ROLE_CC_VALUE:
+    v = x->CcLo + (i * ((int32_t)x->CcHi - x->CcLo)) / 127;
+    v = MIDI_Xform_Clamp(v, 0, 127);
+    break;
+
+  default:
+    v = i;
+    break;
+  }
+  return (uint8_t)v;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Fill the identity table and free the rest of the pool.
+  * @retval None
+  */
+void MIDI_Xform_Init(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < 128U; i++)
+  {
+    MIDI_XformLut[0][i] = (uint8_t)i;
+  }
+  memset(midi_xform_owner, 0, sizeof(midi_xform_owner));
+}
+
+/**
+  * @brief  Give back the pool tables of a routing table that is out of use.
+  * @param  owner: bit of the routing table
+  * @retval None
+  */
+void MIDI_Xform_Release(uint32_t owner)
+{
+  uint32_t i;
+
+  for (i = 0; i < MIDI_XFORM_LUTS; i++)
+  {
+    midi_xform_owner[i] &= (uint8_t)~owner;
+  }
+}
+
+/**
+  * @brief  Whether pool table n holds the table of a role of a transform.
+  */
+static uint32_t MIDI_Xform_Holds(uint32_t n, const MIDI_XformTypeDef *x, uint32_t role)
+{
+  int32_t i;
+
+  for (i = 0; i < 128; i++)
+  {
+    if (MIDI_XformLut[n][i] != MIDI_Xform_Entry(x, role, i))
+    {
+      return 0U;
+    }
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Compile a transform for a routing table that is out of use. Each
+  *         role takes a pool table with the same contents when there is
+  *         one, else a free one. Entries are worked out as they are
+  *         compared rather than into a buffer, which would cost the main
+  *         loop 128 bytes of stack.
+  * @param  out: compiled transform
+  * @param  x: parameters
+  * @param  owner: bit of the routing table
+  * @retval HAL_OK, HAL_ERROR when the pool is full
+  */
+HAL_StatusTypeDef MIDI_Xform_Compile(MIDI_XformLutsTypeDef *out, const MIDI_XformTypeDef *x,
+                                     uint32_t owner)
+{
+  uint32_t role;
+  uint32_t i;
+  int32_t k;
+
+  out->Lut[MIDI_XFORM_ROLE_SAME] = 0;
+  for (role = MIDI_XFORM_ROLE_SAME + 1U; role < MIDI_XFORM_ROLES; role++)
+  {
+    for (i = 0; i < MIDI_XFORM_LUTS; i++)
+    {
+      if (((i == 0U) || (midi_xform_owner[i] != 0U)) && (MIDI_Xform_Holds(i, x, role) != 0U))
+      {
+        break;
+      }
+    }
+    if (i == MIDI_XFORM_LUTS)
+    {
+      for (i = 1; (i < MIDI_XFORM_LUTS) && (midi_xform_owner[i] != 0U); i++)
+      {
+      }
+      if (i == MIDI_XFORM_LUTS)
+      {
+        return HAL_ERROR;
+      }
+      for (k = 0; k < 128; k++)
+      {
+        MIDI_XformLut[i][k] = MIDI_Xform_Entry(x, role, k);
+      }
+    }
+    if (i != 0U)
+    {
+      midi_xform_owner[i] |= (uint8_t)owner;
+    }
+    out->Lut[role] = (uint8_t)i;
+  }
+  return HAL_OK;
+}
@@ -0,0 +1,233 @@
+/**
+  ******************************************************************************
+  * @file    nvm.c
+  * @brief   Background flash writer on the flash end of operation
+  *          interrupt, at register level.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "nvm.h"
+#include "ramfunc.h"
+#include "sched.h"
+#include "vectors.h"
+#include "usbd_midi.h"
+
+/* Private define ------------------------------------------------------------*/
+#define NVM_SR_ERRORS         (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)
+
+/* USB events only the HAL serves; CTR is left over for endpoints other than
+   the MIDI ones */
+#define NVM_USB_HAL_EVENTS    (USB_ISTR_CTR | USB_ISTR_PMAOVR | USB_ISTR_ERR |  \
+                               USB_ISTR_WKUP | USB_ISTR_SUSP | USB_ISTR_RESET)
+
+/* Private variables ---------------------------------------------------------*/
+static __IO uint8_t nvm_busy;
+static __IO HAL_StatusTypeDef nvm_status = HAL_OK;
+static uint32_t nvm_addr;               /* Next halfword to program */
+static const uint16_t *nvm_src;
+static uint32_t nvm_left;
+static uint8_t nvm_usb_masked;
+
+extern __IO uint32_t uwTick;
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Start programming the next halfword, NVM_IRQHandler() sees the
+  *         end. Flash unlocked, end of operation interrupt enabled.
+  */
+static void NVM_Next(void)
+{
+  SET_BIT(FLASH->CR, FLASH_CR_PG);
+  *(__IO uint16_t *)nvm_addr = *nvm_src;
+  nvm_addr += 2U;
+  nvm_src++;
+  nvm_left--;
+}
+
+/**
+  * @brief  USB handler while a page erases: serve the MIDI endpoints from
+  *         RAM and drop start of frame events, which the HAL only clears.
+  *         Anything else masks the interrupt until the flash is back and
+  *         the HAL handles it.
+  */
+__RAM_FUNC static void NVM_UsbIRQHandler(void)
+{
+  uint32_t istr;
+
+  USBD_MIDI_IRQHandler();
+  istr = USB->ISTR & USB->CNTR;
+  if ((istr & (USB_ISTR_SOF | USB_ISTR_ESOF)) != 0U)
+  {
+    /* Write 0 to clear, 1 leaves a flag alone */
+    USB->ISTR = (uint16_t)~(USB_ISTR_SOF | USB_ISTR_ESOF);
+  }
+  if ((istr & NVM_USB_HAL_EVENTS) != 0U)
+  {
+    /* NVIC_DisableIRQ(), which is not always inlined */
+    NVIC->ICER[0] = 1UL << (uint32_t)USB_IRQn;
+    nvm_usb_masked = 1;
+  }
+}
+
+/**
+  * @brief  SysTick handler while a page erases: keep the HAL tick only.
+  */
+__RAM_FUNC static void NVM_TickHandler(void)
+{
+  uwTick++;
+}
+
+/**
+  * @brief  Start a page erase and sleep until NVM_IRQHandler() ends it.
+  *         Flash unlocked.
+  * @param  addr: page address
+  * @retval None
+  */
+__RAM_FUNC static void NVM_EraseWait(uint32_t addr)
+{
+  SET_BIT(FLASH->CR, FLASH_CR_PER | FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+  FLASH->AR = addr;
+  SET_BIT(FLASH->CR, FLASH_CR_STRT);
+
+  /* Sleep with interrupts masked so the end of operation can not slip in
+     between the test and the WFI, then let the handlers run */
+  __disable_irq();
+  while (nvm_busy != 0U)
+  {
+    __WFI();
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Enable the flash interrupt. Below the USB and DIN interrupts, so
+  *         that they preempt the writer, and above PendSV: with
+  *         SCHED_SLEEP_ON_EXIT the jobs that erase run in PendSV, and
+  *         NVM_Erase() would otherwise wait for an end of operation that
+  *         can never come in.
+  * @retval None
+  */
+void NVM_Init(void)
+{
+  HAL_NVIC_SetPriority(FLASH_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(FLASH_IRQn);
+}
+
+/**
+  * @brief  Erase one flash page and wait for the end. The erase is started
+  *         and waited for from SRAM, so the wait does not stall on the busy
+  *         flash. Meanwhile the USB and SysTick vectors point at lean RAM
+  *         handlers; the DIN handlers already run from RAM. Main loop
+  *         context with interrupts enabled only.
+  * @param  addr: page address
+  * @retval HAL_OK, HAL_BUSY if an operation is running, HAL_ERROR
+  */
+HAL_StatusTypeDef NVM_Erase(uint32_t addr)
+{
+  VECT_HandlerTypeDef usb;
+  VECT_HandlerTypeDef tick;
+
+  if (nvm_busy != 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  nvm_left = 0;
+  nvm_status = HAL_OK;
+  nvm_busy = 1;
+
+  nvm_usb_masked = 0;
+  usb = VECT_Set(USB_IRQn, NVM_UsbIRQHandler);
+  tick = VECT_Set(SysTick_IRQn, NVM_TickHandler);
+
+  HAL_FLASH_Unlock();
+  NVM_EraseWait(addr);
+
+  VECT_Set(USB_IRQn, usb);
+  VECT_Set(SysTick_IRQn, tick);
+  if (nvm_usb_masked != 0U)
+  {
+    NVIC_EnableIRQ(USB_IRQn);
+  }
+  return nvm_status;
+}
+
+/**
+  * @brief  Start programming halfwords. src must stay valid until the
+  *         operation ends. Main loop context only.
+  * @param  addr: flash address, halfword aligned and erased
+  * @param  src: data
+  * @param  n: number of halfwords
+  * @retval HAL_OK once started, HAL_BUSY if an operation is running
+  */
+HAL_StatusTypeDef NVM_Program(uint32_t addr, const uint16_t *src, uint32_t n)
+{
+  if (nvm_busy != 0U)
+  {
+    return HAL_BUSY;
+  }
+  nvm_status = HAL_OK;
+  if (n == 0U)
+  {
+    return HAL_OK;
+  }
+
+  nvm_addr = addr;
+  nvm_src = src;
+  nvm_left = n;
+  nvm_busy = 1;
+
+  HAL_FLASH_Unlock();
+  SET_BIT(FLASH->CR, FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+  NVM_Next();
+  return HAL_OK;
+}
+
+/**
+  * @brief  Whether an operation is running.
+  */
+uint32_t NVM_Busy(void)
+{
+  return nvm_busy;
+}
+
+/**
+  * @brief  Result of the last operation, valid once NVM_Busy() is 0.
+  */
+HAL_StatusTypeDef NVM_Status(void)
+{
+  return nvm_status;
+}
+
+/**
+  * @brief  Flash interrupt: a page erase or a halfword is done. Start the
+  *         next halfword, or close the operation.
+  * @retval None
+  */
+void NVM_IRQHandler(void)
+{
+  uint32_t sr = FLASH->SR;
+
+  /* Write 1 to clear */
+  FLASH->SR = FLASH_SR_EOP | NVM_SR_ERRORS;
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PG | FLASH_CR_PER);
+  if ((sr & NVM_SR_ERRORS) != 0U)
+  {
+    nvm_status = HAL_ERROR;
+  }
+  else if (nvm_left != 0U)
+  {
+    NVM_Next();
+    return;
+  }
+
+  CLEAR_BIT(FLASH->CR, FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+  HAL_FLASH_Lock();
+  nvm_busy = 0;
+  SCHED_Post(SCHED_EVT_JOBS);
+}
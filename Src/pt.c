@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    pt.c
+  * @brief   Protothread job list, stepped from the scheduler.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "pt.h"
+#include "sched.h"
+#include "telemetry.h"
+
+/* Private variables ---------------------------------------------------------*/
+static PT_JobTypeDef *pt_jobs;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Start a job from its beginning. Main loop context only; a job
+  *         that is already running is restarted.
+  * @param  job: job, see PT_JOB_DEFINE()
+  * @retval None
+  */
+void PT_Start(PT_JobTypeDef *job)
+{
+  job->Lc = 0;
+  if (PT_Running(job) == 0U)
+  {
+    job->Next = pt_jobs;
+    pt_jobs = job;
+  }
+  SCHED_Post(SCHED_EVT_JOBS);
+}
+
+/**
+  * @brief  Whether a job has been started and has not ended yet.
+  */
+uint32_t PT_Running(const PT_JobTypeDef *job)
+{
+  const PT_JobTypeDef *j;
+
+  for (j = pt_jobs; j != NULL; j = j->Next)
+  {
+    if (j == job)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Give every job its slice. Jobs that still have work ready when
+  *         their slice runs out get the scheduler to come back after the
+  *         higher priority tasks; waiting jobs are retried on the next tick.
+  * @retval None
+  */
+void PT_Poll(void)
+{
+  PT_JobTypeDef **link = &pt_jobs;
+  PT_JobTypeDef *job;
+  uint32_t start;
+  uint32_t t0;
+  uint32_t t1;
+  uint32_t ret;
+  uint32_t more = 0;
+
+  while ((job = *link) != NULL)
+  {
+    start = TELEM_NowUs();
+    do
+    {
+      t0 = TELEM_NowUs();
+      ret = job->Run(job);
+      t1 = TELEM_NowUs();
+
+      if ((t1 - t0) > job->WorstUs)
+      {
+        job->WorstUs = (uint16_t)(((t1 - t0) > 0xFFFFU) ? 0xFFFFU : (t1 - t0));
+      }
+      if ((t1 - t0) > job->BudgetUs)
+      {
+        job->Overruns++;
+        TELEM.JobOverruns++;
+      }
+    } while ((ret == PT_YIELDED) && ((t1 - start) < job->BudgetUs));
+
+    if (ret == PT_ENDED)
+    {
+      *link = job->Next;
+      continue;
+    }
+    more |= (ret == PT_YIELDED);
+    link = &job->Next;
+  }
+
+  if (more != 0U)
+  {
+    SCHED_Post(SCHED_EVT_JOBS);
+  }
+}
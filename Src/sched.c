@@ -0,0 +1,181 @@
+/**
+  ******************************************************************************
+  * @file    sched.c
+  * @brief   Event flag scheduler.
+  *
+  *          Interrupts post SCHED_EVT_xxx bits with SCHED_Post(). The
+  *          dispatcher takes the lowest posted bit, that is the highest
+  *          priority task, clears it and runs the task, then starts over,
+  *          so a task posted meanwhile by an interrupt overtakes the lower
+  *          ones. With nothing posted the core sleeps in WFI; the SysTick
+  *          interrupt bounds every sleep to 1 ms.
+  *
+  *          Idle time is accumulated over SCHED_WINDOW_US and published as
+  *          TELEM.IdlePermille. In the main loop build it is the time spent
+  *          in WFI, interrupts included as busy time; in the sleep-on-exit
+  *          build it is the window minus the time spent in the tasks.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "sched.h"
+#include "telemetry.h"
+#include "midi_port.h"
+#include "usbd_vendor.h"
+#include "usb_power.h"
+#include "pt.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define SCHED_TASK_FN(__ID__, __FN__)     __FN__,
+
+/* Private variables ---------------------------------------------------------*/
+static void (*const sched_task[SCHED_TASK_COUNT])(void) =
+{
+  SCHED_TASK_LIST(SCHED_TASK_FN)
+};
+
+static uint32_t sched_window_start;
+static uint32_t sched_idle_us;
+static uint32_t sched_busy_us;
+static uint32_t sched_wakes;
+
+/* Exported variables --------------------------------------------------------*/
+__IO uint32_t SCHED_Pending;
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Run posted tasks in priority order until none is left.
+  */
+static void SCHED_Dispatch(void)
+{
+  uint32_t primask;
+  uint32_t pending;
+  uint32_t task;
+
+  for (;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    pending = SCHED_Pending;
+    for (task = 0; task < SCHED_TASK_COUNT; task++)
+    {
+      if ((pending & (1U << task)) != 0U)
+      {
+        break;
+      }
+    }
+    if (task == SCHED_TASK_COUNT)
+    {
+      __set_PRIMASK(primask);
+      return;
+    }
+    SCHED_Pending = pending & ~(1U << task);
+    __set_PRIMASK(primask);
+
+    sched_task[task]();
+  }
+}
+
+/**
+  * @brief  Close the accounting window once it is full.
+  */
+static void SCHED_Account(uint32_t now)
+{
+  uint32_t window = now - sched_window_start;
+
+  if (window < SCHED_WINDOW_US)
+  {
+    return;
+  }
+#if (SCHED_SLEEP_ON_EXIT == 1)
+  sched_idle_us = (sched_busy_us < window) ? (window - sched_busy_us) : 0U;
+  sched_busy_us = 0;
+#endif
+  if (sched_idle_us > window)
+  {
+    sched_idle_us = window;
+  }
+  TELEM.IdlePermille = (uint16_t)(((uint64_t)sched_idle_us * 1000U) / window);
+  TELEM.WakeRate = (uint16_t)((sched_wakes > 0xFFFFU) ? 0xFFFFU : sched_wakes);
+  sched_window_start = now;
+  sched_idle_us = 0;
+  sched_wakes = 0;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+#if (SCHED_SLEEP_ON_EXIT == 1)
+
+/**
+  * @brief  Dispatch from PendSV, the lowest priority exception, so every
+  *         other handler still preempts the tasks.
+  * @retval None
+  */
+void SCHED_PendSV(void)
+{
+  uint32_t t0 = TELEM_NowUs();
+  uint32_t t1;
+
+  SCHED_Dispatch();
+  t1 = TELEM_NowUs();
+  sched_busy_us += t1 - t0;
+  sched_wakes++;
+  SCHED_Account(t1);
+}
+
+/**
+  * @brief  Start the scheduler. Does not return.
+  * @retval None
+  */
+void SCHED_Run(void)
+{
+  sched_window_start = TELEM_NowUs();
+  HAL_NVIC_SetPriority(PendSV_IRQn, 3, 0);
+  SCHED_Post(SCHED_EVT_ALL);
+  HAL_PWR_EnableSleepOnExit();
+
+  for (;;)
+  {
+    __WFI();
+  }
+}
+
+#else
+
+void SCHED_PendSV(void)
+{
+}
+
+/**
+  * @brief  Start the scheduler. Does not return.
+  * @retval None
+  */
+void SCHED_Run(void)
+{
+  uint32_t t0;
+  uint32_t t1;
+
+  sched_window_start = TELEM_NowUs();
+  SCHED_Post(SCHED_EVT_ALL);
+
+  for (;;)
+  {
+    SCHED_Dispatch();
+
+    /* Masked, so a post between the check and WFI still ends the sleep,
+       and the waking handler runs only after the time stamp */
+    __disable_irq();
+    if (SCHED_Pending == 0U)
+    {
+      t0 = TELEM_NowUs();
+      __WFI();
+      t1 = TELEM_NowUs();
+      sched_idle_us += t1 - t0;
+      sched_wakes++;
+      SCHED_Account(t1);
+    }
+    __enable_irq();
+  }
+}
+
+#endif /* SCHED_SLEEP_ON_EXIT */
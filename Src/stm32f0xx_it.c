@@ -36,10 +36,17 @@
 #include "stm32f0xx_it.h"
 
 /* USER CODE BEGIN 0 */
-
+#include "trace.h"
+#include "telemetry.h"
+#include "usbd_midi.h"
+#include "midi_din.h"
+#include "sched.h"
+#include "nvm.h"
+#include "ramfunc.h"
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
+extern PCD_HandleTypeDef hpcd_USB_FS;
 extern TIM_HandleTypeDef htim1;
 
 /******************************************************************************/
@@ -94,7 +101,7 @@ void SVC_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+  SCHED_PendSV();
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
@@ -112,7 +119,9 @@ void SysTick_Handler(void)
   HAL_IncTick();
   HAL_SYSTICK_IRQHandler();
   /* USER CODE BEGIN SysTick_IRQn 1 */
-
+  /* Periodic work, and a backstop for DIN bytes whose RXNE the DMA
+     cleared before the NVIC saw it */
+  SCHED_Post(SCHED_EVT_MIDI | SCHED_EVT_VENDOR | SCHED_EVT_POWER | SCHED_EVT_JOBS);
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -129,11 +138,11 @@ void SysTick_Handler(void)
 void EXTI4_15_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI4_15_IRQn 0 */
-
+  TRACE_ENTER(TRACE_ID_EXTI4_15);
   /* USER CODE END EXTI4_15_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_8);
   /* USER CODE BEGIN EXTI4_15_IRQn 1 */
-
+  TRACE_EXIT(TRACE_ID_EXTI4_15);
   /* USER CODE END EXTI4_15_IRQn 1 */
 }
 
@@ -143,15 +152,63 @@ void EXTI4_15_IRQHandler(void)
 void TIM1_BRK_UP_TRG_COM_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM1_BRK_UP_TRG_COM_IRQn 0 */
-
+  TRACE_ENTER(TRACE_ID_TIM1);
   /* USER CODE END TIM1_BRK_UP_TRG_COM_IRQn 0 */
   HAL_TIM_IRQHandler(&htim1);
   /* USER CODE BEGIN TIM1_BRK_UP_TRG_COM_IRQn 1 */
-
+  TRACE_EXIT(TRACE_ID_TIM1);
   /* USER CODE END TIM1_BRK_UP_TRG_COM_IRQn 1 */
 }
 
+/**
+* @brief This function handles USB global interrupt / USB wake-up interrupt through EXTI line 18.
+*/
+void USB_IRQHandler(void)
+{
+  /* USER CODE BEGIN USB_IRQn 0 */
+  TRACE_ENTER(TRACE_ID_USB);
+  /* The HAL clears PMAOVR and ERR without a callback, count them first */
+  TELEM_UsbIstr(hpcd_USB_FS.Instance->ISTR);
+  /* MIDI endpoints first, EP0 and bus events stay with the HAL */
+  USBD_MIDI_IRQHandler();
+  /* USER CODE END USB_IRQn 0 */
+  HAL_PCD_IRQHandler(&hpcd_USB_FS);
+  /* USER CODE BEGIN USB_IRQn 1 */
+  TRACE_EXIT(TRACE_ID_USB);
+  /* USER CODE END USB_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
 
+/**
+* @brief This function handles DMA1 channel 4 and 5 interrupts.
+*/
+__RAM_FUNC void DMA1_Channel4_5_IRQHandler(void)
+{
+  TRACE_ENTER(TRACE_ID_DMA);
+  MIDI_DIN_DMA_IRQHandler();
+  TRACE_EXIT(TRACE_ID_DMA);
+}
+
+/**
+* @brief This function handles USART2 global interrupt.
+*/
+__RAM_FUNC void USART2_IRQHandler(void)
+{
+  TRACE_ENTER(TRACE_ID_USART);
+  MIDI_DIN_USART_IRQHandler();
+  TRACE_EXIT(TRACE_ID_USART);
+}
+
+/**
+* @brief This function handles Flash global interrupt.
+*/
+void FLASH_IRQHandler(void)
+{
+  TRACE_ENTER(TRACE_ID_FLASH);
+  NVM_IRQHandler();
+  TRACE_EXIT(TRACE_ID_FLASH);
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
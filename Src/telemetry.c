@@ -0,0 +1,120 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.c
+  * @brief   Throughput, drop and latency counters.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "telemetry.h"
+
+/* Exported variables --------------------------------------------------------*/
+TELEM_TypeDef TELEM;
+TELEM_SampleTypeDef TELEM_Sample[TELEM_PATHS];
+
+/* External variables --------------------------------------------------------*/
+extern __IO uint32_t uwTick;
+
+/* Private variables ---------------------------------------------------------*/
+/* SysTick cycles to microseconds, 16.16 fixed point */
+static uint32_t telem_us_scale;
+
+/**
+  * @brief  Clear all counters and latch the SysTick to microsecond scale.
+  *         Call after the system clock is configured.
+  * @retval None
+  */
+void TELEM_Reset(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(&TELEM, 0, sizeof(TELEM));
+  __set_PRIMASK(primask);
+
+  telem_us_scale = (uint32_t)((1000000ULL << 16) / SystemCoreClock);
+}
+
+/**
+  * @brief  Free-running microsecond time stamp built from the HAL tick and
+  *         SysTick->VAL. Wraps after about 71 minutes. In RAM for the
+  *         latency samples taken by the USB handlers.
+  * @retval Microseconds since reset
+  */
+__RAM_FUNC uint32_t TELEM_NowUs(void)
+{
+  uint32_t ms = uwTick;
+  uint32_t val = SysTick->VAL;
+
+  /* A reload that the tick handler has not serviced yet belongs to the next
+     millisecond; only trust it when VAL has just restarted from LOAD. */
+  if (((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U) && (val > (SysTick->LOAD >> 1)))
+  {
+    ms++;
+  }
+
+  return (ms * 1000U) + (((SysTick->LOAD - val) * telem_us_scale) >> 16);
+}
+
+/**
+  * @brief  Add one sample to a latency histogram.
+  * @param  path: TELEM_PATH_xxx
+  * @param  us: latency in microseconds
+  * @retval None
+  */
+static void TELEM_Latency(uint32_t path, uint32_t us)
+{
+  uint32_t bucket = 0;
+
+  /* bucket = floor(log2(us)) + 1, without a CLZ instruction on the M0 */
+  if (us != 0U)
+  {
+    bucket = 1;
+    if (us >= (1U << 16)) { bucket += 16; us >>= 16; }
+    if (us >= (1U << 8))  { bucket += 8;  us >>= 8; }
+    if (us >= (1U << 4))  { bucket += 4;  us >>= 4; }
+    if (us >= (1U << 2))  { bucket += 2;  us >>= 2; }
+    if (us >= (1U << 1))  { bucket += 1; }
+  }
+  if (bucket >= TELEM_LATENCY_BUCKETS)
+  {
+    bucket = TELEM_LATENCY_BUCKETS - 1U;
+  }
+
+  TELEM.Latency[path][bucket]++;
+}
+
+/**
+  * @brief  Bin the finished latency samples and let the next enqueue start
+  *         a new one. Call from the MIDI task.
+  * @retval None
+  */
+void TELEM_LatencyPoll(void)
+{
+  TELEM_SampleTypeDef *s;
+  uint32_t path;
+
+  for (path = 0; path < TELEM_PATHS; path++)
+  {
+    s = &TELEM_Sample[path];
+    if (s->State == TELEM_SAMPLE_DONE)
+    {
+      TELEM_Latency(path, s->EndUs - s->StartUs);
+      s->State = TELEM_SAMPLE_IDLE;
+    }
+  }
+}
+
+/**
+  * @brief  Take a consistent copy of all counters.
+  * @param  dst: destination block
+  * @retval None
+  */
+void TELEM_Snapshot(TELEM_TypeDef *dst)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memcpy(dst, &TELEM, sizeof(TELEM));
+  __set_PRIMASK(primask);
+}
@@ -0,0 +1,75 @@
+/**
+  ******************************************************************************
+  * @file    trace.c
+  * @brief   ISR enter/exit trace ring.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "trace.h"
+
+#if (TRACE_ENABLED == 1)
+
+/* Exported variables --------------------------------------------------------*/
+TRACE_RingTypeDef TRACE_Ring;
+
+/**
+  * @brief  Copy the records written since *cursor without stopping the writers.
+  *         Records overwritten by the probes while copying are discarded and
+  *         reported as lost.
+  * @param  cursor: reader position, updated on return; start at 0
+  * @param  dst: destination buffer
+  * @param  max: capacity of dst in records
+  * @param  lost: number of records skipped because the ring wrapped
+  * @retval Number of records copied to dst
+  */
+uint32_t TRACE_Read(uint32_t *cursor, uint32_t *dst, uint32_t max, uint32_t *lost)
+{
+  uint32_t head = TRACE_Ring.Head;
+  uint32_t pos = *cursor;
+  uint32_t skipped = 0;
+  uint32_t count;
+  uint32_t i;
+
+  if ((head - pos) > TRACE_RING_SIZE)
+  {
+    skipped = head - pos - TRACE_RING_SIZE;
+    pos = head - TRACE_RING_SIZE;
+  }
+
+  count = head - pos;
+  if (count > max)
+  {
+    count = max;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    dst[i] = TRACE_Ring.Buf[(pos + i) & (TRACE_RING_SIZE - 1U)];
+  }
+
+  /* Drop the head of the copy if the probes lapped us meanwhile */
+  head = TRACE_Ring.Head;
+  if ((head - pos) > TRACE_RING_SIZE)
+  {
+    uint32_t stale = head - pos - TRACE_RING_SIZE;
+
+    if (stale > count)
+    {
+      stale = count;
+    }
+    for (i = stale; i < count; i++)
+    {
+      dst[i - stale] = dst[i];
+    }
+    count -= stale;
+    skipped += stale;
+    pos += stale;
+  }
+
+  *cursor = pos + count;
+  *lost = skipped;
+
+  return count;
+}
+
+#endif /* TRACE_ENABLED */
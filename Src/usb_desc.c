@@ -0,0 +1,388 @@
+/**
+  ******************************************************************************
+  * @file    usb_desc.c
+  * @brief   USB descriptors: a USB-MIDI function (audio control + MIDI
+  *          streaming interfaces) and a vendor-specific interface for
+  *          configuration and telemetry.
+  *
+  *          The configuration descriptor is a packed struct with one jack
+  *          group per entry of MIDI_PORT_LIST, so every length, total and
+  *          jack id is a compile-time constant and the whole set lives in
+  *          flash. Only the serial number string is built at run time.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include "usb_device.h"
+#include "usb_conf.h"
+#include "midi_port.h"
+
+/* Private define ------------------------------------------------------------*/
+#define USB_DESC_TYPE_DEVICE            0x01U
+#define USB_DESC_TYPE_CONFIGURATION     0x02U
+#define USB_DESC_TYPE_STRING            0x03U
+#define USB_DESC_TYPE_INTERFACE         0x04U
+#define USB_DESC_TYPE_ENDPOINT          0x05U
+#define USB_DESC_TYPE_CS_INTERFACE      0x24U
+#define USB_DESC_TYPE_CS_ENDPOINT       0x25U
+
+#define USB_CLASS_AUDIO                 0x01U
+#define USB_CLASS_VENDOR                0xFFU
+#define AUDIO_SUBCLASS_CONTROL          0x01U
+#define AUDIO_SUBCLASS_MIDI_STREAMING   0x03U
+
+#define MS_HEADER                       0x01U
+#define MS_MIDI_IN_JACK                 0x02U
+#define MS_MIDI_OUT_JACK                0x03U
+#define MS_GENERAL                      0x01U
+#define MS_JACK_EMBEDDED                0x01U
+#define MS_JACK_EXTERNAL                0x02U
+
+#define USBD_IDX_LANGID_STR             0x00U
+#define USBD_IDX_MFC_STR                0x01U
+#define USBD_IDX_PRODUCT_STR            0x02U
+#define USBD_IDX_SERIAL_STR             0x03U
+#define USBD_IDX_VENDOR_ITF_STR         0x04U
+#define USBD_IDX_PORT_STR               0x05U   /* One string per port from here */
+
+#define USBD_VENDOR_ITF_STRING          "F1042 Telemetry"
+#define USBD_LANGID                     0x0409U
+
+/* Four jacks per port: the embedded pair faces the host, the external pair
+   the connector. Jack ids start at 1. */
+#define USBD_JACK_EMB_IN(__PORT__)      (uint8_t)(4U * (__PORT__) + 1U)
+#define USBD_JACK_EXT_IN(__PORT__)      (uint8_t)(4U * (__PORT__) + 2U)
+#define USBD_JACK_EMB_OUT(__PORT__)     (uint8_t)(4U * (__PORT__) + 3U)
+#define USBD_JACK_EXT_OUT(__PORT__)     (uint8_t)(4U * (__PORT__) + 4U)
+
+/* Private types -------------------------------------------------------------*/
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint16_t wTotalLength;
+  uint8_t  bNumInterfaces;
+  uint8_t  bConfigurationValue;
+  uint8_t  iConfiguration;
+  uint8_t  bmAttributes;
+  uint8_t  bMaxPower;
+} USB_ConfigDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bInterfaceNumber;
+  uint8_t  bAlternateSetting;
+  uint8_t  bNumEndpoints;
+  uint8_t  bInterfaceClass;
+  uint8_t  bInterfaceSubClass;
+  uint8_t  bInterfaceProtocol;
+  uint8_t  iInterface;
+} USB_InterfaceDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bEndpointAddress;
+  uint8_t  bmAttributes;
+  uint16_t wMaxPacketSize;
+  uint8_t  bInterval;
+} USB_EndpointDescTypeDef;
+
+/* Audio class endpoints carry two extra bytes */
+typedef struct __packed
+{
+  USB_EndpointDescTypeDef Std;
+  uint8_t  bRefresh;
+  uint8_t  bSynchAddress;
+} AUDIO_EndpointDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint16_t bcdADC;
+  uint16_t wTotalLength;
+  uint8_t  bInCollection;
+  uint8_t  baInterfaceNr;
+} AUDIO_ACHeaderDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint16_t bcdMSC;
+  uint16_t wTotalLength;
+} MS_HeaderDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bJackType;
+  uint8_t  bJackID;
+  uint8_t  iJack;
+} MS_InJackDescTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bJackType;
+  uint8_t  bJackID;
+  uint8_t  bNrInputPins;
+  uint8_t  baSourceID;
+  uint8_t  baSourcePin;
+  uint8_t  iJack;
+} MS_OutJackDescTypeDef;
+
+typedef struct __packed
+{
+  MS_InJackDescTypeDef  EmbIn;
+  MS_InJackDescTypeDef  ExtIn;
+  MS_OutJackDescTypeDef EmbOut;
+  MS_OutJackDescTypeDef ExtOut;
+} MS_PortJacksTypeDef;
+
+typedef struct __packed
+{
+  uint8_t  bLength;
+  uint8_t  bDescriptorType;
+  uint8_t  bDescriptorSubtype;
+  uint8_t  bNumEmbMIDIJack;
+  uint8_t  baAssocJackID[MIDI_PORT_COUNT];
+} MS_EndpointDescTypeDef;
+
+typedef struct __packed
+{
+  USB_ConfigDescTypeDef     Config;
+
+  USB_InterfaceDescTypeDef  AcItf;
+  AUDIO_ACHeaderDescTypeDef AcHeader;
+
+  USB_InterfaceDescTypeDef  MsItf;
+  MS_HeaderDescTypeDef      MsHeader;
+  MS_PortJacksTypeDef       Port[MIDI_PORT_COUNT];
+  AUDIO_EndpointDescTypeDef OutEp;
+  MS_EndpointDescTypeDef    OutEpMs;
+  AUDIO_EndpointDescTypeDef InEp;
+  MS_EndpointDescTypeDef    InEpMs;
+
+  USB_InterfaceDescTypeDef  VendorItf;
+  USB_EndpointDescTypeDef   VendorEp;
+} USBD_ConfigDescSetTypeDef;
+
+/* Private macro -------------------------------------------------------------*/
+/**
+  * @brief  Define a const string descriptor from an ASCII literal. The
+  *         literal is widened to UTF-16 by the compiler.
+  */
+#define USBD_STRING_DESC(__NAME__, __STR__)                                    \
+  static const struct __packed                                                 \
+  {                                                                            \
+    uint8_t  bLength;                                                          \
+    uint8_t  bDescriptorType;                                                  \
+    uint16_t bString[sizeof(u"" __STR__) / 2U - 1U];                           \
+  } __NAME__ = { sizeof(u"" __STR__), USB_DESC_TYPE_STRING, u"" __STR__ }
+
+/* Port list expansions */
+#define USBD_PORT_STRING(__ID__, __STR__, __DRV__)   USBD_STRING_DESC(usbd_port_str_##__ID__, __STR__);
+#define USBD_PORT_STRING_REF(__ID__, __STR__, __DRV__) (const uint8_t *)&usbd_port_str_##__ID__,
+#define USBD_PORT_EMB_IN(__ID__, __STR__, __DRV__)   USBD_JACK_EMB_IN(MIDI_PORT_##__ID__),
+#define USBD_PORT_EMB_OUT(__ID__, __STR__, __DRV__)  USBD_JACK_EMB_OUT(MIDI_PORT_##__ID__),
+#define USBD_PORT_JACKS(__ID__, __STR__, __DRV__)                              \
+  {                                                                            \
+    /* Embedded IN jack: host to port */                                       \
+    { sizeof(MS_InJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_IN_JACK, \
+      MS_JACK_EMBEDDED, USBD_JACK_EMB_IN(MIDI_PORT_##__ID__),                  \
+      USBD_IDX_PORT_STR + MIDI_PORT_##__ID__ },                                \
+    /* External IN jack: port connector input */                              \
+    { sizeof(MS_InJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_IN_JACK, \
+      MS_JACK_EXTERNAL, USBD_JACK_EXT_IN(MIDI_PORT_##__ID__), 0x00 },          \
+    /* Embedded OUT jack: port to host */                                      \
+    { sizeof(MS_OutJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_OUT_JACK, \
+      MS_JACK_EMBEDDED, USBD_JACK_EMB_OUT(MIDI_PORT_##__ID__), 0x01,           \
+      USBD_JACK_EXT_IN(MIDI_PORT_##__ID__), 0x01,                              \
+      USBD_IDX_PORT_STR + MIDI_PORT_##__ID__ },                                \
+    /* External OUT jack: port connector output */                            \
+    { sizeof(MS_OutJackDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_MIDI_OUT_JACK, \
+      MS_JACK_EXTERNAL, USBD_JACK_EXT_OUT(MIDI_PORT_##__ID__), 0x01,           \
+      USBD_JACK_EMB_IN(MIDI_PORT_##__ID__), 0x01, 0x00 }                       \
+  },
+
+#define LOBYTE(x)                       ((uint8_t)((x) & 0x00FFU))
+#define HIBYTE(x)                       ((uint8_t)(((x) & 0xFF00U) >> 8))
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t usbd_device_desc[18] =
+{
+  0x12,                                 /* bLength */
+  USB_DESC_TYPE_DEVICE,                 /* bDescriptorType */
+  0x00, 0x02,                           /* bcdUSB 2.00 */
+  0x00,                                 /* bDeviceClass: per interface */
+  0x00,                                 /* bDeviceSubClass */
+  0x00,                                 /* bDeviceProtocol */
+  USBD_EP0_SIZE,                        /* bMaxPacketSize0 */
+  LOBYTE(USBD_VID), HIBYTE(USBD_VID),
+  LOBYTE(USBD_PID), HIBYTE(USBD_PID),
+  LOBYTE(USBD_BCD_DEVICE), HIBYTE(USBD_BCD_DEVICE),
+  USBD_IDX_MFC_STR,
+  USBD_IDX_PRODUCT_STR,
+  USBD_IDX_SERIAL_STR,
+  0x01                                  /* bNumConfigurations */
+};
+
+static const USBD_ConfigDescSetTypeDef usbd_config_desc =
+{
+  /* Configuration: bus powered, remote wakeup, 100 mA */
+  { sizeof(USB_ConfigDescTypeDef), USB_DESC_TYPE_CONFIGURATION,
+    sizeof(USBD_ConfigDescSetTypeDef), USBD_ITF_COUNT, 0x01, 0x00, 0xA0, 0x32 },
+
+  /* Audio control interface and header: one streaming interface */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_AUDIO_CONTROL,
+    0x00, 0x00, USB_CLASS_AUDIO, AUDIO_SUBCLASS_CONTROL, 0x00, 0x00 },
+  { sizeof(AUDIO_ACHeaderDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_HEADER,
+    0x0100, sizeof(AUDIO_ACHeaderDescTypeDef), 0x01, USBD_ITF_MIDI_STREAMING },
+
+  /* MIDI streaming interface, header total covers jacks and endpoints */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_MIDI_STREAMING,
+    0x00, 0x02, USB_CLASS_AUDIO, AUDIO_SUBCLASS_MIDI_STREAMING, 0x00, 0x00 },
+  { sizeof(MS_HeaderDescTypeDef), USB_DESC_TYPE_CS_INTERFACE, MS_HEADER, 0x0100,
+    offsetof(USBD_ConfigDescSetTypeDef, VendorItf) - offsetof(USBD_ConfigDescSetTypeDef, MsHeader) },
+  { MIDI_PORT_LIST(USBD_PORT_JACKS) },
+
+  /* Bulk OUT, feeding every embedded IN jack */
+  { { sizeof(AUDIO_EndpointDescTypeDef), USB_DESC_TYPE_ENDPOINT, MIDI_EP_OUT, 0x02,
+      MIDI_EP_SIZE, 0x00 }, 0x00, 0x00 },
+  { sizeof(MS_EndpointDescTypeDef), USB_DESC_TYPE_CS_ENDPOINT, MS_GENERAL,
+    MIDI_PORT_COUNT, { MIDI_PORT_LIST(USBD_PORT_EMB_IN) } },
+
+  /* Bulk IN, fed by every embedded OUT jack */
+  { { sizeof(AUDIO_EndpointDescTypeDef), USB_DESC_TYPE_ENDPOINT, MIDI_EP_IN, 0x02,
+      MIDI_EP_SIZE, 0x00 }, 0x00, 0x00 },
+  { sizeof(MS_EndpointDescTypeDef), USB_DESC_TYPE_CS_ENDPOINT, MS_GENERAL,
+    MIDI_PORT_COUNT, { MIDI_PORT_LIST(USBD_PORT_EMB_OUT) } },
+
+  /* Vendor interface, bulk IN for streamed trace and telemetry */
+  { sizeof(USB_InterfaceDescTypeDef), USB_DESC_TYPE_INTERFACE, USBD_ITF_VENDOR,
+    0x00, 0x01, USB_CLASS_VENDOR, 0x00, 0x00, USBD_IDX_VENDOR_ITF_STR },
+  { sizeof(USB_EndpointDescTypeDef), USB_DESC_TYPE_ENDPOINT, VENDOR_EP_IN, 0x02,
+    VENDOR_EP_SIZE, 0x00 }
+};
+
+static const uint8_t usbd_langid_desc[4] =
+{
+  0x04, USB_DESC_TYPE_STRING, LOBYTE(USBD_LANGID), HIBYTE(USBD_LANGID)
+};
+
+USBD_STRING_DESC(usbd_mfc_str, USBD_MANUFACTURER_STRING);
+USBD_STRING_DESC(usbd_product_str, USBD_PRODUCT_STRING);
+USBD_STRING_DESC(usbd_vendor_itf_str, USBD_VENDOR_ITF_STRING);
+MIDI_PORT_LIST(USBD_PORT_STRING)
+
+static const uint8_t *const usbd_port_str[MIDI_PORT_COUNT] =
+{
+  MIDI_PORT_LIST(USBD_PORT_STRING_REF)
+};
+
+/* Serial number string, built once from the unique device ID */
+static uint8_t usbd_serial_desc[2 + 2 * 12];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Build the serial number string from the 96-bit unique device ID.
+  */
+static const uint8_t *USBD_GetSerial(void)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  uint32_t hi = *(__IO uint32_t *)(UID_BASE) + *(__IO uint32_t *)(UID_BASE + 8U);
+  uint32_t lo = *(__IO uint32_t *)(UID_BASE + 4U);
+  int32_t i;
+
+  if (usbd_serial_desc[0] != 0U)
+  {
+    return usbd_serial_desc;
+  }
+
+  for (i = 7; i >= 0; i--)
+  {
+    usbd_serial_desc[2 + 2 * i] = (uint8_t)hex[hi & 0x0FU];
+    hi >>= 4;
+  }
+  for (i = 11; i >= 8; i--)
+  {
+    usbd_serial_desc[2 + 2 * i] = (uint8_t)hex[lo & 0x0FU];
+    lo >>= 4;
+  }
+  usbd_serial_desc[1] = USB_DESC_TYPE_STRING;
+  usbd_serial_desc[0] = sizeof(usbd_serial_desc);
+
+  return usbd_serial_desc;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Look up a descriptor for GET_DESCRIPTOR.
+  * @param  wValue: descriptor type (high byte) and index (low byte)
+  * @param  wIndex: language id for strings
+  * @param  len: descriptor length
+  * @retval Descriptor, or NULL to stall the request
+  */
+const uint8_t *USBD_GetDescriptor(uint16_t wValue, uint16_t wIndex, uint16_t *len)
+{
+  const uint8_t *desc;
+  uint8_t idx = wValue & 0xFFU;
+
+  UNUSED(wIndex);
+
+  switch (wValue >> 8)
+  {
+  case USB_DESC_TYPE_DEVICE:
+    *len = sizeof(usbd_device_desc);
+    return usbd_device_desc;
+
+  case USB_DESC_TYPE_CONFIGURATION:
+    *len = sizeof(usbd_config_desc);
+    return (const uint8_t *)&usbd_config_desc;
+
+  case USB_DESC_TYPE_STRING:
+    switch (idx)
+    {
+    case USBD_IDX_LANGID_STR:
+      desc = usbd_langid_desc;
+      break;
+    case USBD_IDX_MFC_STR:
+      desc = (const uint8_t *)&usbd_mfc_str;
+      break;
+    case USBD_IDX_PRODUCT_STR:
+      desc = (const uint8_t *)&usbd_product_str;
+      break;
+    case USBD_IDX_SERIAL_STR:
+      desc = USBD_GetSerial();
+      break;
+    case USBD_IDX_VENDOR_ITF_STR:
+      desc = (const uint8_t *)&usbd_vendor_itf_str;
+      break;
+    default:
+      if ((idx < USBD_IDX_PORT_STR) || (idx >= (USBD_IDX_PORT_STR + MIDI_PORT_COUNT)))
+      {
+        return NULL;
+      }
+      desc = usbd_port_str[idx - USBD_IDX_PORT_STR];
+      break;
+    }
+    *len = desc[0];
+    return desc;
+
+  default:
+    return NULL;
+  }
+}
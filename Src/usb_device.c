@@ -0,0 +1,589 @@
+/**
+  ******************************************************************************
+  * @file    usb_device.c
+  * @brief   Minimal USB device core on top of the HAL PCD driver.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usb_device.h"
+#include "usb_conf.h"
+#include "usb_pma.h"
+
+/* Private define ------------------------------------------------------------*/
+#define EP0_IDLE          0U
+#define EP0_DATA_IN       1U
+#define EP0_DATA_OUT      2U
+#define EP0_STATUS_IN     3U
+#define EP0_STATUS_OUT    4U
+
+/* Private variables ---------------------------------------------------------*/
+static const USBD_ClassTypeDef *usbd_class[USBD_MAX_CLASSES];
+static const USBD_ClassTypeDef *usbd_ep0_owner;   /* Function serving the current request */
+static uint8_t usbd_class_count;
+
+static struct
+{
+  uint8_t  state;
+  uint8_t  resume_state;         /* State to return to after suspend */
+  uint8_t  config;
+  uint8_t  remote_wakeup;
+  uint8_t  ep0_state;
+  const uint8_t *tx_ptr;         /* Remaining control IN data        */
+  uint16_t tx_rem;
+  uint8_t  tx_zlp;               /* Terminate with a zero length packet */
+  uint16_t rx_rem;               /* Control OUT bytes still expected */
+  uint16_t req_len;              /* wLength of the current request   */
+  uint8_t  status[2];
+} usbd;
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBD_StdDevReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+static void USBD_StdItfReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+static void USBD_StdEPReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+static void USBD_SetConfig(PCD_HandleTypeDef *hpcd, uint8_t config);
+static uint8_t USBD_ClassSetup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+
+/**
+  * @brief  Reset the device core. Functions must be registered afterwards.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void USBD_Init(PCD_HandleTypeDef *hpcd)
+{
+  usbd_class_count = 0;
+  usbd.state = USBD_STATE_DEFAULT;
+  usbd.config = 0;
+  usbd.remote_wakeup = 0;
+  usbd.ep0_state = EP0_IDLE;
+
+  USBD_PMA_Layout(hpcd);
+}
+
+/**
+  * @brief  Add a function to the device.
+  * @param  cls: function hooks, must stay valid
+  * @retval None
+  */
+void USBD_RegisterClass(const USBD_ClassTypeDef *cls)
+{
+  if (usbd_class_count < USBD_MAX_CLASSES)
+  {
+    usbd_class[usbd_class_count++] = cls;
+  }
+}
+
+/**
+  * @brief  Current device state (USBD_STATE_xxx).
+  */
+uint8_t USBD_GetState(void)
+{
+  return usbd.state;
+}
+
+/**
+  * @brief  Whether the host has enabled remote wakeup.
+  */
+uint8_t USBD_RemoteWakeupEnabled(void)
+{
+  return usbd.remote_wakeup;
+}
+
+/**
+  * @brief  Whether a control IN data stage is still reading its buffer.
+  */
+uint8_t USBD_CtlSending(void)
+{
+  return usbd.ep0_state == EP0_DATA_IN;
+}
+
+/**
+  * @brief  Start the data stage of a control IN transfer.
+  * @param  hpcd: PCD handle
+  * @param  buf: data, must stay valid until the transfer completes
+  * @param  len: data length, clipped to wLength here
+  * @retval None
+  */
+void USBD_CtlSendData(PCD_HandleTypeDef *hpcd, const uint8_t *buf, uint16_t len)
+{
+  uint16_t chunk;
+
+  if (len > usbd.req_len)
+  {
+    len = usbd.req_len;
+  }
+  /* A short answer that ends on a packet boundary needs a ZLP */
+  usbd.tx_zlp = (len != 0U) && (len < usbd.req_len) && ((len & (USBD_EP0_SIZE - 1U)) == 0U);
+
+  chunk = (len > USBD_EP0_SIZE) ? USBD_EP0_SIZE : len;
+
+  usbd.ep0_state = EP0_DATA_IN;
+  usbd.tx_ptr = buf + chunk;
+  usbd.tx_rem = len - chunk;
+  HAL_PCD_EP_Transmit(hpcd, 0x80, (uint8_t *)buf, chunk);
+}
+
+/**
+  * @brief  Start the data stage of a control OUT transfer.
+  *         EP0_RxReady of the owning function runs once len bytes arrived.
+  * @param  hpcd: PCD handle
+  * @param  buf: destination, at least len bytes
+  * @param  len: wLength of the request
+  * @retval None
+  */
+void USBD_CtlPrepareRx(PCD_HandleTypeDef *hpcd, uint8_t *buf, uint16_t len)
+{
+  usbd.ep0_state = EP0_DATA_OUT;
+  usbd.rx_rem = len;
+  HAL_PCD_EP_Receive(hpcd, 0x00, buf, len);
+}
+
+/**
+  * @brief  Acknowledge a control transfer with a zero length IN packet.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void USBD_CtlSendStatus(PCD_HandleTypeDef *hpcd)
+{
+  usbd.ep0_state = EP0_STATUS_IN;
+  HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+}
+
+/**
+  * @brief  Reject the current control transfer.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void USBD_CtlError(PCD_HandleTypeDef *hpcd)
+{
+  usbd.ep0_state = EP0_IDLE;
+  HAL_PCD_EP_SetStall(hpcd, 0x80);
+  HAL_PCD_EP_SetStall(hpcd, 0x00);
+}
+
+/**
+  * @brief  Take a control OUT data packet straight from packet memory, for
+  *         code that runs from SRAM while the flash is busy and the HAL
+  *         can not. Only full packets the stage goes on after are taken;
+  *         the last one, SETUP packets and any other event stay pending
+  *         for the HAL. USB interrupt masked.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+__RAM_FUNC void USBD_CtlRxPoll(PCD_HandleTypeDef *hpcd)
+{
+  USB_TypeDef *usb = hpcd->Instance;
+  PCD_EPTypeDef *ep = &hpcd->OUT_ep[0];
+  __IO uint16_t *pma;
+  uint32_t count;
+  uint32_t i;
+  uint16_t w;
+
+  if ((usbd.ep0_state != EP0_DATA_OUT) ||
+      ((PCD_GET_ENDPOINT(usb, PCD_ENDP0) & (USB_EP_CTR_RX | USB_EP_SETUP)) != USB_EP_CTR_RX))
+  {
+    return;
+  }
+  count = PCD_GET_EP_RX_CNT(usb, PCD_ENDP0);
+  if ((count < ep->maxpacket) || (count >= usbd.rx_rem))
+  {
+    return;
+  }
+
+  PCD_CLEAR_RX_EP_CTR(usb, PCD_ENDP0);
+  pma = USBD_PMA_PTR(ep->pmaadress);
+  for (i = 0; i < count; i += 2U)
+  {
+    w = *pma++;
+    ep->xfer_buff[i] = (uint8_t)w;
+    ep->xfer_buff[i + 1U] = (uint8_t)(w >> 8);
+  }
+  ep->xfer_buff += count;
+  ep->xfer_count = count;
+  usbd.rx_rem -= (uint16_t)count;
+
+  /* COUNT0_RX keeps its block size, only the status needs setting */
+  PCD_SET_EP_RX_STATUS(usb, PCD_ENDP0, USB_EP_RX_VALID);
+}
+
+/* HAL PCD callbacks ---------------------------------------------------------*/
+
+/**
+  * @brief  Bus reset: back to the default state with only EP0 open.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+  USBD_SetConfig(hpcd, 0);
+  usbd.state = USBD_STATE_DEFAULT;
+  usbd.remote_wakeup = 0;
+  usbd.ep0_state = EP0_IDLE;
+
+  HAL_PCD_EP_Open(hpcd, 0x00, USBD_EP0_SIZE, PCD_EP_TYPE_CTRL);
+  HAL_PCD_EP_Open(hpcd, 0x80, USBD_EP0_SIZE, PCD_EP_TYPE_CTRL);
+}
+
+/**
+  * @brief  SETUP packet received on EP0.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+  const uint8_t *raw = (const uint8_t *)hpcd->Setup;
+  USBD_SetupReqTypedef req;
+
+  req.bmRequest = raw[0];
+  req.bRequest  = raw[1];
+  req.wValue    = (uint16_t)(raw[2] | (raw[3] << 8));
+  req.wIndex    = (uint16_t)(raw[4] | (raw[5] << 8));
+  req.wLength   = (uint16_t)(raw[6] | (raw[7] << 8));
+
+  usbd.ep0_state = EP0_IDLE;
+  usbd.req_len = req.wLength;
+
+  if ((req.bmRequest & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_STANDARD)
+  {
+    if (USBD_ClassSetup(hpcd, &req) != USBD_OK)
+    {
+      USBD_CtlError(hpcd);
+    }
+    return;
+  }
+
+  switch (req.bmRequest & USB_REQ_RECIPIENT_MASK)
+  {
+  case USB_REQ_RECIPIENT_DEVICE:
+    USBD_StdDevReq(hpcd, &req);
+    break;
+  case USB_REQ_RECIPIENT_INTERFACE:
+    USBD_StdItfReq(hpcd, &req);
+    break;
+  case USB_REQ_RECIPIENT_ENDPOINT:
+    USBD_StdEPReq(hpcd, &req);
+    break;
+  default:
+    USBD_CtlError(hpcd);
+    break;
+  }
+}
+
+/**
+  * @brief  IN transfer completed.
+  * @param  hpcd: PCD handle
+  * @param  epnum: endpoint number
+  * @retval None
+  */
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  uint32_t i;
+
+  if (epnum != 0U)
+  {
+    for (i = 0; i < usbd_class_count; i++)
+    {
+      if (usbd_class[i]->DataIn != NULL)
+      {
+        usbd_class[i]->DataIn(hpcd, epnum);
+      }
+    }
+    return;
+  }
+
+  if (usbd.ep0_state == EP0_DATA_IN)
+  {
+    if (usbd.tx_rem != 0U)
+    {
+      uint16_t chunk = (usbd.tx_rem > USBD_EP0_SIZE) ? USBD_EP0_SIZE : usbd.tx_rem;
+
+      HAL_PCD_EP_Transmit(hpcd, 0x80, (uint8_t *)usbd.tx_ptr, chunk);
+      usbd.tx_ptr += chunk;
+      usbd.tx_rem -= chunk;
+    }
+    else if (usbd.tx_zlp != 0U)
+    {
+      usbd.tx_zlp = 0;
+      HAL_PCD_EP_Transmit(hpcd, 0x80, NULL, 0);
+    }
+    else
+    {
+      usbd.ep0_state = EP0_STATUS_OUT;
+      HAL_PCD_EP_Receive(hpcd, 0x00, NULL, 0);
+    }
+  }
+  else
+  {
+    usbd.ep0_state = EP0_IDLE;
+  }
+}
+
+/**
+  * @brief  OUT transfer completed.
+  * @param  hpcd: PCD handle
+  * @param  epnum: endpoint number
+  * @retval None
+  */
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  uint32_t i;
+
+  if (epnum != 0U)
+  {
+    for (i = 0; i < usbd_class_count; i++)
+    {
+      if (usbd_class[i]->DataOut != NULL)
+      {
+        usbd_class[i]->DataOut(hpcd, epnum);
+      }
+    }
+    return;
+  }
+
+  if (usbd.ep0_state == EP0_DATA_OUT)
+  {
+    uint16_t count = hpcd->OUT_ep[0].xfer_count;
+
+    usbd.rx_rem = (count >= usbd.rx_rem) ? 0U : (uint16_t)(usbd.rx_rem - count);
+    if (usbd.rx_rem == 0U)
+    {
+      if ((usbd_ep0_owner != NULL) && (usbd_ep0_owner->EP0_RxReady != NULL))
+      {
+        usbd_ep0_owner->EP0_RxReady(hpcd);
+      }
+      USBD_CtlSendStatus(hpcd);
+    }
+  }
+  else
+  {
+    usbd.ep0_state = EP0_IDLE;
+  }
+}
+
+/**
+  * @brief  Bus idle for 3 ms. The macrocell is already in low-power mode;
+  *         usb_power.c stops the core from the main loop.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  if (usbd.state != USBD_STATE_SUSPENDED)
+  {
+    usbd.resume_state = usbd.state;
+    usbd.state = USBD_STATE_SUSPENDED;
+  }
+}
+
+/**
+  * @brief  Resume signalling or remote wakeup seen on the bus.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void HAL_PCD_ResumeCallback(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  if (usbd.state == USBD_STATE_SUSPENDED)
+  {
+    usbd.state = usbd.resume_state;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint8_t USBD_ClassSetup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  uint32_t i;
+
+  for (i = 0; i < usbd_class_count; i++)
+  {
+    usbd_ep0_owner = usbd_class[i];
+    if ((usbd_class[i]->Setup != NULL) && (usbd_class[i]->Setup(hpcd, req) == USBD_OK))
+    {
+      return USBD_OK;
+    }
+  }
+  usbd_ep0_owner = NULL;
+  return USBD_FAIL;
+}
+
+static void USBD_SetConfig(PCD_HandleTypeDef *hpcd, uint8_t config)
+{
+  uint32_t i;
+
+  if (usbd.config != 0U)
+  {
+    for (i = 0; i < usbd_class_count; i++)
+    {
+      if (usbd_class[i]->DeInit != NULL)
+      {
+        usbd_class[i]->DeInit(hpcd);
+      }
+    }
+  }
+
+  usbd.config = config;
+
+  if (config != 0U)
+  {
+    for (i = 0; i < usbd_class_count; i++)
+    {
+      if (usbd_class[i]->Init != NULL)
+      {
+        usbd_class[i]->Init(hpcd);
+      }
+    }
+    usbd.state = USBD_STATE_CONFIGURED;
+  }
+  else if (usbd.state == USBD_STATE_CONFIGURED)
+  {
+    usbd.state = USBD_STATE_ADDRESSED;
+  }
+}
+
+static void USBD_StdDevReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  const uint8_t *desc;
+  uint16_t len;
+
+  switch (req->bRequest)
+  {
+  case USB_REQ_GET_DESCRIPTOR:
+    desc = USBD_GetDescriptor(req->wValue, req->wIndex, &len);
+    if (desc == NULL)
+    {
+      USBD_CtlError(hpcd);
+      break;
+    }
+    USBD_CtlSendData(hpcd, desc, len);
+    break;
+
+  case USB_REQ_SET_ADDRESS:
+    /* The HAL applies the address once the status stage has completed */
+    HAL_PCD_SetAddress(hpcd, (uint8_t)(req->wValue & 0x7FU));
+    usbd.state = (req->wValue != 0U) ? USBD_STATE_ADDRESSED : USBD_STATE_DEFAULT;
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  case USB_REQ_SET_CONFIGURATION:
+    if (req->wValue > 1U)
+    {
+      USBD_CtlError(hpcd);
+      break;
+    }
+    USBD_SetConfig(hpcd, (uint8_t)req->wValue);
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  case USB_REQ_GET_CONFIGURATION:
+    USBD_CtlSendData(hpcd, &usbd.config, 1);
+    break;
+
+  case USB_REQ_GET_STATUS:
+    usbd.status[0] = (uint8_t)(usbd.remote_wakeup << 1);
+    usbd.status[1] = 0;
+    USBD_CtlSendData(hpcd, usbd.status, 2);
+    break;
+
+  case USB_REQ_SET_FEATURE:
+  case USB_REQ_CLEAR_FEATURE:
+    if (req->wValue != USB_FEATURE_REMOTE_WAKEUP)
+    {
+      USBD_CtlError(hpcd);
+      break;
+    }
+    usbd.remote_wakeup = (req->bRequest == USB_REQ_SET_FEATURE);
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  default:
+    USBD_CtlError(hpcd);
+    break;
+  }
+}
+
+static void USBD_StdItfReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  if ((usbd.state != USBD_STATE_CONFIGURED) || ((req->wIndex & 0xFFU) >= USBD_ITF_COUNT))
+  {
+    USBD_CtlError(hpcd);
+    return;
+  }
+
+  switch (req->bRequest)
+  {
+  case USB_REQ_GET_STATUS:
+    usbd.status[0] = 0;
+    usbd.status[1] = 0;
+    USBD_CtlSendData(hpcd, usbd.status, 2);
+    break;
+
+  case USB_REQ_GET_INTERFACE:
+    /* Every interface has a single alternate setting */
+    usbd.status[0] = 0;
+    USBD_CtlSendData(hpcd, usbd.status, 1);
+    break;
+
+  case USB_REQ_SET_INTERFACE:
+    if (req->wValue != 0U)
+    {
+      USBD_CtlError(hpcd);
+      break;
+    }
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  default:
+    /* e.g. interface specific descriptors */
+    if (USBD_ClassSetup(hpcd, req) != USBD_OK)
+    {
+      USBD_CtlError(hpcd);
+    }
+    break;
+  }
+}
+
+static void USBD_StdEPReq(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  uint8_t ep_addr = (uint8_t)(req->wIndex & 0xFFU);
+  PCD_EPTypeDef *ep;
+
+  if ((ep_addr & 0x7FU) >= hpcd->Init.dev_endpoints)
+  {
+    USBD_CtlError(hpcd);
+    return;
+  }
+  ep = ((ep_addr & 0x80U) != 0U) ? &hpcd->IN_ep[ep_addr & 0x7FU]
+                                 : &hpcd->OUT_ep[ep_addr & 0x7FU];
+
+  switch (req->bRequest)
+  {
+  case USB_REQ_GET_STATUS:
+    usbd.status[0] = ep->is_stall;
+    usbd.status[1] = 0;
+    USBD_CtlSendData(hpcd, usbd.status, 2);
+    break;
+
+  case USB_REQ_SET_FEATURE:
+    if ((req->wValue == USB_FEATURE_EP_HALT) && ((ep_addr & 0x7FU) != 0U))
+    {
+      HAL_PCD_EP_SetStall(hpcd, ep_addr);
+    }
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  case USB_REQ_CLEAR_FEATURE:
+    if ((req->wValue == USB_FEATURE_EP_HALT) && ((ep_addr & 0x7FU) != 0U))
+    {
+      HAL_PCD_EP_ClrStall(hpcd, ep_addr);
+    }
+    USBD_CtlSendStatus(hpcd);
+    break;
+
+  default:
+    USBD_CtlError(hpcd);
+    break;
+  }
+}
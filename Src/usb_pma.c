@@ -0,0 +1,115 @@
+/**
+  ******************************************************************************
+  * @file    usb_pma.c
+  * @brief   Packet memory (PMA) allocator.
+  *
+  *          Every endpoint of USBD_EP_LIST gets one buffer, packed after the
+  *          BTABLE, which is sized for the highest endpoint number in use.
+  *          There is no double buffering: the HAL double buffered IN
+  *          completion rewrites and re-frees the buffer it has just sent,
+  *          and the MIDI endpoints still reach the HAL when their CTR comes
+  *          in while it serves EP0.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usb_pma.h"
+#include "usb_conf.h"
+#include "ramfunc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define USBD_PMA_EP_SIZE(__ADDR__, __TYPE__, __SIZE__)                         \
+  + USBD_PMA_BUF_SIZE(__ADDR__, __SIZE__)
+#define USBD_PMA_EP_ENTRY(__ADDR__, __TYPE__, __SIZE__)                        \
+  { (__ADDR__), USBD_PMA_BUF_SIZE(__ADDR__, __SIZE__) },
+
+/* The layout with a full BTABLE must always fit */
+#if ((USBD_PMA_MAX_EP * USBD_PMA_BTABLE_ENTRY) USBD_EP_LIST(USBD_PMA_EP_SIZE)) > USBD_PMA_SIZE
+#error "USBD_EP_LIST does not fit in the packet memory"
+#endif
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  Addr;                  /*!< Endpoint address                    */
+  uint16_t Size;                  /*!< Bytes per buffer                    */
+} USBD_PMA_EpTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const USBD_PMA_EpTypeDef usbd_pma_ep[] =
+{
+  USBD_EP_LIST(USBD_PMA_EP_ENTRY)
+};
+
+#define USBD_PMA_EP_COUNT   (sizeof(usbd_pma_ep) / sizeof(usbd_pma_ep[0]))
+
+static uint16_t usbd_pma_free;
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Compute the PMA layout and hand it to the PCD driver. Call once
+  *         after HAL_PCD_Init(), before any endpoint is opened.
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void USBD_PMA_Layout(PCD_HandleTypeDef *hpcd)
+{
+  uint32_t regs = 0;
+  uint32_t addr;
+  uint32_t i;
+
+  for (i = 0; i < USBD_PMA_EP_COUNT; i++)
+  {
+    if ((usbd_pma_ep[i].Addr & 0x7FU) >= regs)
+    {
+      regs = (usbd_pma_ep[i].Addr & 0x7FU) + 1U;
+    }
+  }
+
+  addr = regs * USBD_PMA_BTABLE_ENTRY;
+  for (i = 0; i < USBD_PMA_EP_COUNT; i++)
+  {
+    HAL_PCDEx_PMAConfig(hpcd, usbd_pma_ep[i].Addr, PCD_SNG_BUF, addr);
+    addr += usbd_pma_ep[i].Size;
+  }
+  usbd_pma_free = (uint16_t)(USBD_PMA_SIZE - addr);
+}
+
+/**
+  * @brief  Move up to max words from a queue straight into a PMA buffer,
+  *         in at most two runs around the ring wrap (consumer side).
+  * @param  pma: destination, see USBD_PMA_PTR()
+  * @param  q: source queue
+  * @param  max: words that fit in the buffer
+  * @retval Number of words moved
+  */
+__RAM_FUNC uint32_t USBD_PMA_WriteQueue(__IO uint16_t *pma, MIDI_QueueTypeDef *q, uint32_t max)
+{
+  uint16_t tail = q->Tail;
+  uint32_t n = (uint16_t)(q->Head - tail);
+  uint32_t idx = tail & q->Mask;
+  uint32_t run;
+
+  if (n > max)
+  {
+    n = max;
+  }
+  run = (uint32_t)q->Mask + 1U - idx;
+  if (run > n)
+  {
+    run = n;
+  }
+  pma = USBD_PMA_WriteWords(pma, &q->Buf[idx], run);
+  USBD_PMA_WriteWords(pma, q->Buf, n - run);
+
+  q->Tail = tail + n;
+  return n;
+}
+
+/**
+  * @brief  Packet memory left unused by the layout, in bytes.
+  */
+uint16_t USBD_PMA_Free(void)
+{
+  return usbd_pma_free;
+}
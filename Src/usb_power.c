@@ -0,0 +1,178 @@
+/**
+  ******************************************************************************
+  * @file    usb_power.c
+  * @brief   USB suspend handling.
+  *
+  *          The USB interrupt only records the suspend; the main loop then
+  *          stops the core with the USB wakeup line (EXTI 18) armed. STOP
+  *          turns HSI48 off and wakes on the 8 MHz HSI, so HSI48 is brought
+  *          back and reselected before interrupts are unmasked and the USB
+  *          interrupt sees the resume. CRS keeps its trim across STOP and
+  *          re-locks on the first SOF after resume.
+  *
+  *          Other wake sources hook in through USBD_Power_StopEnter() and
+  *          USBD_Power_StopExit(). A local wakeup signals resume to the
+  *          host if it enabled remote wakeup, and keeps the core running
+  *          for USBD_POWER_HOLD_MS so the traffic that follows is not cut
+  *          off by the next STOP.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usb_power.h"
+#include "usb_device.h"
+#include "telemetry.h"
+
+/* Private define ------------------------------------------------------------*/
+#define USBD_POWER_WAKE_MHZ   (HSI_VALUE / 1000000U)   /* Core clock out of STOP */
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef *power_pcd;
+static uint32_t power_hold_tick;
+static uint8_t power_hold;
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Run from HSI48 again after STOP.
+  * @retval SysTick ticks at the wake clock spent waiting for HSI48
+  */
+static uint32_t USBD_Power_ClockRestore(void)
+{
+  uint32_t load = SysTick->LOAD + 1U;
+  uint32_t t0 = SysTick->VAL;
+  uint32_t t1;
+
+  RCC->CR2 |= RCC_CR2_HSI48ON;
+  while ((RCC->CR2 & RCC_CR2_HSI48RDY) == 0U)
+  {
+  }
+  t1 = SysTick->VAL;
+
+  RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_HSI48;
+  while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI48)
+  {
+  }
+
+  /* SysTick counts down */
+  return (t0 - t1 + load) % load;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Trim HSI48 to the host SOF and arm the USB wakeup line. Call
+  *         before HAL_PCD_Start().
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+void USBD_Power_Init(PCD_HandleTypeDef *hpcd)
+{
+  RCC_CRSInitTypeDef crs;
+
+  power_pcd = hpcd;
+  power_hold = 0;
+
+  __HAL_RCC_PWR_CLK_ENABLE();
+  __HAL_RCC_CRS_CLK_ENABLE();
+
+  crs.Prescaler = RCC_CRS_SYNC_DIV1;
+  crs.Source = RCC_CRS_SYNC_SOURCE_USB;
+  crs.Polarity = RCC_CRS_SYNC_POLARITY_RISING;
+  crs.ReloadValue = __HAL_RCC_CRS_RELOADVALUE_CALCULATE(48000000U, 1000U);
+  crs.ErrorLimitValue = RCC_CRS_ERRORLIMIT_DEFAULT;
+  crs.HSI48CalibrationValue = RCC_CRS_HSI48CALIBRATION_DEFAULT;
+  HAL_RCCEx_CRSConfig(&crs);
+
+  /* Line 18 is a direct line: no edge selection, no pending bit */
+  __HAL_USB_WAKEUP_EXTI_ENABLE_IT();
+}
+
+/**
+  * @brief  Stop the core while the bus is suspended. Call from the main
+  *         loop; returns once the device is awake, or straight away when
+  *         the bus is not suspended.
+  * @retval None
+  */
+void USBD_Power_Poll(void)
+{
+  uint32_t primask;
+  uint32_t ticks;
+  uint32_t us;
+  uint32_t local;
+
+  if (USBD_GetState() != USBD_STATE_SUSPENDED)
+  {
+    power_hold = 0;
+    return;
+  }
+  if ((power_hold != 0U) && ((HAL_GetTick() - power_hold_tick) < USBD_POWER_HOLD_MS))
+  {
+    return;
+  }
+  power_hold = 0;
+
+  /* Masked, so a resume that lands before WFI still wakes it, and the USB
+     interrupt only runs once the clocks are back */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (USBD_GetState() != USBD_STATE_SUSPENDED)
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+
+  TELEM.Suspends++;
+  HAL_SuspendTick();
+  USBD_Power_StopEnter();
+  HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+  ticks = USBD_Power_ClockRestore();
+  HAL_ResumeTick();
+
+  us = (ticks + USBD_POWER_WAKE_MHZ - 1U) / USBD_POWER_WAKE_MHZ;
+  if (us > TELEM.ResumeUsMax)
+  {
+    TELEM.ResumeUsMax = (uint16_t)us;
+  }
+  local = USBD_Power_StopExit(USBD_POWER_WAKE_US + us);
+  __set_PRIMASK(primask);
+
+  if (local == 0U)
+  {
+    return;
+  }
+  power_hold = 1;
+  power_hold_tick = HAL_GetTick();
+
+  if ((USBD_RemoteWakeupEnabled() != 0U) && (USBD_GetState() == USBD_STATE_SUSPENDED))
+  {
+    TELEM.RemoteWakeups++;
+    HAL_PCD_ActivateRemoteWakeup(power_pcd);
+    HAL_Delay(USBD_POWER_RESUME_MS);
+    HAL_PCD_DeActivateRemoteWakeup(power_pcd);
+    /* The host may answer with resume signalling of its own; either way
+       the bus is running again */
+    HAL_PCD_ResumeCallback(power_pcd);
+  }
+}
+
+/**
+  * @brief  Arm extra wake sources, called with interrupts masked right
+  *         before STOP.
+  * @retval None
+  */
+__weak void USBD_Power_StopEnter(void)
+{
+}
+
+/**
+  * @brief  Disarm the extra wake sources, called with interrupts masked
+  *         once HSI48 runs again.
+  * @param  wake_us: time since the wakeup event, roughly
+  * @retval 1 if a local event woke the core and the host should be woken
+  *         too, 0 otherwise
+  */
+__weak uint32_t USBD_Power_StopExit(uint32_t wake_us)
+{
+  UNUSED(wake_us);
+  return 0;
+}
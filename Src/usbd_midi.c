@@ -0,0 +1,302 @@
+/**
+  ******************************************************************************
+  * @file    usbd_midi.c
+  * @brief   USB-MIDI 1.0 streaming function.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_midi.h"
+#include "usb_conf.h"
+#include "usb_pma.h"
+#include "midi_queue.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "ramfunc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MIDI_EP_OUT_NUM       (MIDI_EP_OUT & 0x7FU)
+#define MIDI_EP_IN_NUM        (MIDI_EP_IN & 0x7FU)
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef *midi_pcd;
+static uint32_t midi_rx_buf[MIDI_EP_SIZE / 4U];   /* HAL path only */
+static __IO uint16_t *midi_rx_pma;
+static __IO uint16_t *midi_tx_pma;
+static __IO uint8_t midi_tx_busy;
+static __IO uint8_t midi_ready;
+static __IO uint8_t midi_rx_paused;       /* OUT endpoint left in NAK */
+
+MIDI_QUEUE_DEFINE(midi_in_queue, USBD_MIDI_IN_QUEUE_SIZE, &TELEM.UsbInQueueHwm);
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBD_MIDI_Init(PCD_HandleTypeDef *hpcd);
+static void USBD_MIDI_DeInit(PCD_HandleTypeDef *hpcd);
+static void USBD_MIDI_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+static void USBD_MIDI_DataOut(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+
+/* Exported variables --------------------------------------------------------*/
+const USBD_ClassTypeDef USBD_MIDI =
+{
+  USBD_MIDI_Init,
+  USBD_MIDI_DeInit,
+  NULL,
+  NULL,
+  USBD_MIDI_DataIn,
+  USBD_MIDI_DataOut,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static void USBD_MIDI_Init(PCD_HandleTypeDef *hpcd)
+{
+  midi_pcd = hpcd;
+
+  HAL_PCD_EP_Open(hpcd, MIDI_EP_OUT, MIDI_EP_SIZE, PCD_EP_TYPE_BULK);
+  HAL_PCD_EP_Open(hpcd, MIDI_EP_IN, MIDI_EP_SIZE, PCD_EP_TYPE_BULK);
+  midi_rx_pma = USBD_PMA_PTR(hpcd->OUT_ep[MIDI_EP_OUT_NUM].pmaadress);
+  midi_tx_pma = USBD_PMA_PTR(hpcd->IN_ep[MIDI_EP_IN_NUM].pmaadress);
+  hpcd->IN_ep[MIDI_EP_IN_NUM].xfer_buff = (uint8_t *)midi_rx_buf;
+
+  midi_tx_busy = 0;
+  midi_rx_paused = 0;
+  midi_ready = 1;
+  HAL_PCD_EP_Receive(hpcd, MIDI_EP_OUT, (uint8_t *)midi_rx_buf, MIDI_EP_SIZE);
+  USBD_MIDI_Flush();
+}
+
+static void USBD_MIDI_DeInit(PCD_HandleTypeDef *hpcd)
+{
+  midi_ready = 0;
+  HAL_PCD_EP_Close(hpcd, MIDI_EP_OUT);
+  HAL_PCD_EP_Close(hpcd, MIDI_EP_IN);
+}
+
+/*
+ * DataIn and DataOut only run for events the HAL picked up itself: a MIDI
+ * CTR that arrives while HAL_PCD_IRQHandler() is serving EP0. Everything
+ * else goes through USBD_MIDI_IRQHandler().
+ */
+static void USBD_MIDI_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  if (epnum == MIDI_EP_IN_NUM)
+  {
+    /* The HAL copies its stale transfer buffer into the idle PMA buffer
+       before this callback; keep it pointing at valid memory */
+    hpcd->IN_ep[MIDI_EP_IN_NUM].xfer_buff = (uint8_t *)midi_rx_buf;
+    midi_tx_busy = 0;
+    USBD_MIDI_Flush();
+  }
+}
+
+static void USBD_MIDI_DataOut(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  uint32_t count;
+  uint32_t i;
+
+  if (epnum != MIDI_EP_OUT_NUM)
+  {
+    return;
+  }
+
+  count = HAL_PCD_EP_GetRxCount(hpcd, MIDI_EP_OUT) / 4U;
+  for (i = 0; i < count; i++)
+  {
+    /* CIN 0 is reserved and used by some hosts as padding */
+    if (USBD_MIDI_CIN(midi_rx_buf[i]) != 0U)
+    {
+      USBD_MIDI_OutEvent(midi_rx_buf[i]);
+    }
+  }
+
+  /* The endpoint NAKs until re-armed, which holds the host back */
+  if (USBD_MIDI_OutReady() != 0U)
+  {
+    HAL_PCD_EP_Receive(hpcd, MIDI_EP_OUT, (uint8_t *)midi_rx_buf, MIDI_EP_SIZE);
+  }
+  else
+  {
+    midi_rx_paused = 1;
+    TELEM.UsbOutPauses++;
+  }
+}
+
+/**
+  * @brief  Route one OUT packet straight from packet memory and re-arm.
+  *         The HAL endpoint state is left alone: it still describes the
+  *         last HAL_PCD_EP_Receive() into midi_rx_buf, which is what the
+  *         HAL path expects should it take the next packet.
+  */
+__RAM_FUNC static void USBD_MIDI_Receive(USB_TypeDef *usb)
+{
+  __IO uint16_t *pma = midi_rx_pma;
+  uint32_t count;
+  uint32_t evt;
+
+  PCD_CLEAR_RX_EP_CTR(usb, MIDI_EP_OUT_NUM);
+  count = PCD_GET_EP_RX_CNT(usb, MIDI_EP_OUT_NUM) / 4U;
+  while (count-- != 0U)
+  {
+    evt = USBD_PMA_ReadEvent(pma);
+    pma += 2;
+    /* CIN 0 is reserved and used by some hosts as padding */
+    if (USBD_MIDI_CIN(evt) != 0U)
+    {
+      USBD_MIDI_OutEvent(evt);
+    }
+  }
+
+  /* COUNTn_RX keeps its block size, only the status needs setting */
+  if (USBD_MIDI_OutReady() != 0U)
+  {
+    PCD_SET_EP_RX_STATUS(usb, MIDI_EP_OUT_NUM, USB_EP_RX_VALID);
+  }
+  else
+  {
+    midi_rx_paused = 1;
+    TELEM.UsbOutPauses++;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Queue one event packet for the host. Single producer.
+  * @param  evt: USB-MIDI event packet with the cable number already set
+  * @retval 1 if queued, 0 if dropped
+  */
+uint32_t USBD_MIDI_Send(uint32_t evt)
+{
+  uint16_t pos = midi_in_queue.Head;
+
+  /* USBD_MIDI_Flush() may drain the event from the USB interrupt */
+  TELEM_LatencyStart(TELEM_PATH_PORT_TO_USB, pos);
+  if (MIDI_QueuePut(&midi_in_queue, evt) == 0U)
+  {
+    TELEM_LatencyCancel(TELEM_PATH_PORT_TO_USB, pos);
+    if (USBD_MIDI_CABLE(evt) < MIDI_PORT_COUNT)
+    {
+      TELEM_DROP(USBD_MIDI_CABLE(evt), TELEM_DROP_QUEUE_FULL);
+    }
+    TRACE_MARK(TRACE_ID_QUEUE_DROP);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+  * @brief  Start a bulk IN transfer if the endpoint is idle and events wait.
+  *         Safe to call from any context.
+  * @retval None
+  */
+__RAM_FUNC void USBD_MIDI_Flush(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t n;
+
+  __disable_irq();
+  if ((midi_ready == 0U) || (midi_tx_busy != 0U))
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+  n = USBD_PMA_WriteQueue(midi_tx_pma, &midi_in_queue, MIDI_EP_SIZE / 4U);
+  if (n != 0U)
+  {
+    TELEM_LatencyEnd(TELEM_PATH_PORT_TO_USB, midi_in_queue.Tail);
+    /* One record per packet, the drain takes the events as a block */
+    TRACE_MARK(TRACE_ID_QUEUE_GET);
+    midi_tx_busy = 1;
+    PCD_SET_EP_TX_CNT(midi_pcd->Instance, MIDI_EP_IN_NUM, n * 4U);
+    PCD_SET_EP_TX_STATUS(midi_pcd->Instance, MIDI_EP_IN_NUM, USB_EP_TX_VALID);
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Serve pending CTR events of the MIDI endpoints without going
+  *         through the HAL. Call from USB_IRQHandler() before
+  *         HAL_PCD_IRQHandler(); stops at the first event for another
+  *         endpoint and leaves it, and everything after it, to the HAL.
+  * @retval None
+  */
+__RAM_FUNC void USBD_MIDI_IRQHandler(void)
+{
+  USB_TypeDef *usb;
+  uint32_t istr;
+
+  if (midi_ready == 0U)
+  {
+    return;
+  }
+  usb = midi_pcd->Instance;
+
+  for (;;)
+  {
+    istr = usb->ISTR;
+    if ((istr & USB_ISTR_CTR) == 0U)
+    {
+      return;
+    }
+    switch (istr & USB_ISTR_EP_ID)
+    {
+    case MIDI_EP_OUT_NUM:
+      USBD_MIDI_Receive(usb);
+      break;
+    case MIDI_EP_IN_NUM:
+      PCD_CLEAR_TX_EP_CTR(usb, MIDI_EP_IN_NUM);
+      midi_tx_busy = 0;
+      USBD_MIDI_Flush();
+      break;
+    default:
+      return;
+    }
+  }
+}
+
+/**
+  * @brief  Whether the OUT endpoint is held in NAK by flow control.
+  */
+uint32_t USBD_MIDI_OutPaused(void)
+{
+  return midi_rx_paused;
+}
+
+/**
+  * @brief  Re-arm the OUT endpoint after USBD_MIDI_OutReady() refused a
+  *         packet. Safe to call from any context.
+  * @retval None
+  */
+void USBD_MIDI_OutResume(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if ((midi_ready != 0U) && (midi_rx_paused != 0U))
+  {
+    midi_rx_paused = 0;
+    HAL_PCD_EP_Receive(midi_pcd, MIDI_EP_OUT, (uint8_t *)midi_rx_buf, MIDI_EP_SIZE);
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Asked from the USB interrupt after every OUT packet: whether the
+  *         consumers can take another full packet. Returning 0 leaves the
+  *         endpoint in NAK until USBD_MIDI_OutResume().
+  * @retval 1 to re-arm the endpoint, 0 to pause
+  */
+__weak uint32_t USBD_MIDI_OutReady(void)
+{
+  return 1;
+}
+
+/**
+  * @brief  One event packet received from the host, called from the USB
+  *         interrupt.
+  * @param  evt: USB-MIDI event packet
+  * @retval None
+  */
+__weak void USBD_MIDI_OutEvent(uint32_t evt)
+{
+  UNUSED(evt);
+}
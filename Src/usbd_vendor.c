@@ -0,0 +1,451 @@
+/**
+  ******************************************************************************
+  * @file    usbd_vendor.c
+  * @brief   Vendor-specific USB function for telemetry and configuration.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_vendor.h"
+#include "usb_conf.h"
+#include "usb_pma.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "boot.h"
+#include "nvm.h"
+#include "midi_route.h"
+#include "cfg_log.h"
+
+/* Private define ------------------------------------------------------------*/
+#define VENDOR_DFU_DELAY                20U     /* ms for the status stage to complete */
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Lost;
+  uint32_t Rec[USBD_VENDOR_TRACE_WORDS];
+} VENDOR_TraceTypeDef;
+
+typedef struct
+{
+  uint8_t  Type;
+  uint8_t  Seq;
+  uint16_t Len;
+  union
+  {
+    TELEM_TypeDef       Telem;
+    VENDOR_TraceTypeDef Trace;
+  } u;
+  uint32_t Pad;                            /*!< Keeps frames off packet multiples */
+} VENDOR_FrameTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static PCD_HandleTypeDef *vendor_pcd;
+static __IO uint8_t vendor_ready;
+static __IO uint8_t vendor_tx_busy;
+static uint8_t vendor_seq;
+static uint32_t vendor_last_tick;
+
+static uint32_t vendor_param[USBD_VENDOR_PARAM_COUNT] = { 0, 100 };
+static uint16_t vendor_set_id;             /*!< Param id of a pending SET_PARAM  */
+static uint8_t vendor_rx_req;              /*!< Request of a pending data stage  */
+static __IO uint8_t vendor_dfu;            /*!< ENTER_DFU acknowledged           */
+static uint32_t vendor_dfu_tick;
+static __IO uint16_t vendor_bench_rules;   /*!< Rules of a pending ROUTE_BENCH   */
+static MIDI_RouteBenchTypeDef vendor_bench;
+static __IO uint8_t vendor_routes;         /*!< SET_ROUTES data or APPLY pending */
+static uint16_t vendor_routes_key;
+static uint16_t vendor_routes_len;
+
+#if (TRACE_ENABLED == 1)
+static uint32_t vendor_ep0_cursor;         /*!< Trace position of EP0 readers    */
+static uint32_t vendor_stream_cursor;      /*!< Trace position of the bulk stream */
+#endif /* TRACE_ENABLED */
+
+/* EP0 data stage buffer for the short replies, one request at a time */
+static union
+{
+  USBD_VendorInfoTypeDef Info;
+  uint32_t               Param;
+  MIDI_RouteBenchTypeDef Bench;
+  uint8_t                Status[2];
+} vendor_ctl;
+
+/* SET_ROUTES data stage buffer, apart from vendor_ctl: the value waits
+   there for the main loop while other requests go on */
+static union
+{
+  MIDI_RouteRuleTypeDef  Rules[MIDI_ROUTE_CFG_RULES];
+  MIDI_XformTypeDef      Xforms[MIDI_XFORMS];
+} vendor_routes_data;
+
+/* Bulk stream frame, also the EP0 buffer of GET_TELEMETRY and READ_TRACE.
+   The stream owns it from the vendor_tx_busy claim to the end of the
+   transfer, those requests STALL meanwhile; the stream only claims it
+   while no control IN data stage reads it. */
+static VENDOR_FrameTypeDef vendor_frame;
+
+/* Private function prototypes -----------------------------------------------*/
+static void USBD_Vendor_Init(PCD_HandleTypeDef *hpcd);
+static void USBD_Vendor_DeInit(PCD_HandleTypeDef *hpcd);
+static uint8_t USBD_Vendor_Setup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req);
+static void USBD_Vendor_EP0_RxReady(PCD_HandleTypeDef *hpcd);
+static void USBD_Vendor_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum);
+
+/* Exported variables --------------------------------------------------------*/
+const USBD_ClassTypeDef USBD_VENDOR =
+{
+  USBD_Vendor_Init,
+  USBD_Vendor_DeInit,
+  USBD_Vendor_Setup,
+  USBD_Vendor_EP0_RxReady,
+  USBD_Vendor_DataIn,
+  NULL,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static void USBD_Vendor_Init(PCD_HandleTypeDef *hpcd)
+{
+  vendor_pcd = hpcd;
+
+  HAL_PCD_EP_Open(hpcd, VENDOR_EP_IN, VENDOR_EP_SIZE, PCD_EP_TYPE_BULK);
+
+#if (TRACE_ENABLED == 1)
+  vendor_stream_cursor = TRACE_Ring.Head;
+#endif /* TRACE_ENABLED */
+  vendor_tx_busy = 0;
+  vendor_ready = 1;
+}
+
+static void USBD_Vendor_DeInit(PCD_HandleTypeDef *hpcd)
+{
+  vendor_ready = 0;
+  HAL_PCD_EP_Close(hpcd, VENDOR_EP_IN);
+}
+
+static uint8_t USBD_Vendor_Setup(PCD_HandleTypeDef *hpcd, const USBD_SetupReqTypedef *req)
+{
+  uint8_t recipient = req->bmRequest & USB_REQ_RECIPIENT_MASK;
+  uint8_t dir_in = (req->bmRequest & USB_REQ_DIR_IN) != 0U;
+  uint32_t max;
+
+  if ((req->bmRequest & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_VENDOR)
+  {
+    return USBD_FAIL;
+  }
+  if ((recipient != USB_REQ_RECIPIENT_DEVICE) &&
+      ((recipient != USB_REQ_RECIPIENT_INTERFACE) || ((req->wIndex & 0xFFU) != USBD_ITF_VENDOR)))
+  {
+    return USBD_FAIL;
+  }
+
+  switch (req->bRequest)
+  {
+  case USBD_VENDOR_REQ_GET_INFO:
+    if (!dir_in)
+    {
+      return USBD_FAIL;
+    }
+    vendor_ctl.Info.Protocol = USBD_VENDOR_PROTOCOL;
+    vendor_ctl.Info.BcdDevice = USBD_BCD_DEVICE;
+    vendor_ctl.Info.PortCount = MIDI_PORT_COUNT;
+    vendor_ctl.Info.TraceEnabled = TRACE_ENABLED;
+    vendor_ctl.Info.TraceRingSize = TRACE_RING_SIZE;
+    vendor_ctl.Info.TelemetrySize = sizeof(TELEM_TypeDef);
+    vendor_ctl.Info.LatencyBuckets = TELEM_LATENCY_BUCKETS;
+    vendor_ctl.Info.PmaFree = USBD_PMA_Free();
+    USBD_CtlSendData(hpcd, (const uint8_t *)&vendor_ctl.Info, sizeof(vendor_ctl.Info));
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_GET_TELEMETRY:
+    if (!dir_in || (vendor_tx_busy != 0U))
+    {
+      return USBD_FAIL;
+    }
+    TELEM_Snapshot(&vendor_frame.u.Telem);
+    USBD_CtlSendData(hpcd, (const uint8_t *)&vendor_frame.u.Telem, sizeof(vendor_frame.u.Telem));
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_RESET_TELEMETRY:
+    if (req->wLength != 0U)
+    {
+      return USBD_FAIL;
+    }
+    TELEM_Reset();
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_READ_TRACE:
+    if (!dir_in || (req->wLength < 4U) || (vendor_tx_busy != 0U))
+    {
+      return USBD_FAIL;
+    }
+    max = (req->wLength - 4U) / 4U;
+    if (max > USBD_VENDOR_TRACE_WORDS)
+    {
+      max = USBD_VENDOR_TRACE_WORDS;
+    }
+#if (TRACE_ENABLED == 1)
+    max = TRACE_Read(&vendor_ep0_cursor, vendor_frame.u.Trace.Rec, max, &vendor_frame.u.Trace.Lost);
+#else
+    /* No ring: an empty dump, midictl warns from GET_INFO */
+    vendor_frame.u.Trace.Lost = 0;
+    max = 0;
+#endif /* TRACE_ENABLED */
+    USBD_CtlSendData(hpcd, (const uint8_t *)&vendor_frame.u.Trace, (uint16_t)(4U + max * 4U));
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_GET_PARAM:
+    if (!dir_in || (req->wValue >= USBD_VENDOR_PARAM_COUNT))
+    {
+      return USBD_FAIL;
+    }
+    vendor_ctl.Param = vendor_param[req->wValue];
+    USBD_CtlSendData(hpcd, (const uint8_t *)&vendor_ctl.Param, 4);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_SET_PARAM:
+    if (dir_in || (req->wValue >= USBD_VENDOR_PARAM_COUNT) || (req->wLength != 4U))
+    {
+      return USBD_FAIL;
+    }
+    vendor_set_id = req->wValue;
+    vendor_rx_req = req->bRequest;
+    USBD_CtlPrepareRx(hpcd, (uint8_t *)&vendor_ctl.Param, 4);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_ENTER_DFU:
+    if (req->wLength != 0U)
+    {
+      return USBD_FAIL;
+    }
+    vendor_dfu_tick = HAL_GetTick();
+    vendor_dfu = 1;
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_ROUTE_BENCH:
+    /* Far too long for the interrupt, the main loop runs it */
+    if ((req->wLength != 0U) || (req->wValue == 0U) ||
+        (req->wValue > USBD_VENDOR_ROUTE_BENCH_MAX))
+    {
+      return USBD_FAIL;
+    }
+    vendor_bench.Rules = 0;
+    vendor_bench_rules = req->wValue;
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_GET_ROUTE_BENCH:
+    if (!dir_in)
+    {
+      return USBD_FAIL;
+    }
+    vendor_ctl.Bench = vendor_bench;
+    USBD_CtlSendData(hpcd, (const uint8_t *)&vendor_ctl.Bench, sizeof(vendor_ctl.Bench));
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_SET_ROUTES:
+    /* Refused until the main loop has taken the previous one */
+    if (dir_in || (vendor_routes != 0U) || (req->wValue > MIDI_ROUTE_CFG_KEYS) ||
+        ((req->wValue < MIDI_ROUTE_CFG_KEYS) &&
+         ((req->wLength > sizeof(vendor_routes_data.Rules)) ||
+          ((req->wLength % sizeof(MIDI_RouteRuleTypeDef)) != 0U))) ||
+        ((req->wValue == MIDI_ROUTE_CFG_KEYS) &&
+         ((req->wLength > sizeof(vendor_routes_data.Xforms)) ||
+          ((req->wLength % sizeof(MIDI_XformTypeDef)) != 0U))))
+    {
+      return USBD_FAIL;
+    }
+    vendor_routes_key = req->wValue;
+    vendor_routes_len = req->wLength;
+    if (req->wLength == 0U)
+    {
+      vendor_routes = USBD_VENDOR_REQ_SET_ROUTES;
+      USBD_CtlSendStatus(hpcd);
+    }
+    else
+    {
+      vendor_rx_req = req->bRequest;
+      USBD_CtlPrepareRx(hpcd, (uint8_t *)&vendor_routes_data, req->wLength);
+    }
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_APPLY_ROUTES:
+    if ((req->wLength != 0U) || (vendor_routes != 0U))
+    {
+      return USBD_FAIL;
+    }
+    vendor_routes = USBD_VENDOR_REQ_APPLY_ROUTES;
+    USBD_CtlSendStatus(hpcd);
+    return USBD_OK;
+
+  case USBD_VENDOR_REQ_GET_ROUTE_STATUS:
+    if (!dir_in)
+    {
+      return USBD_FAIL;
+    }
+    vendor_ctl.Status[0] = (vendor_routes == USBD_VENDOR_REQ_APPLY_ROUTES) ?
+                           (uint8_t)HAL_BUSY : (uint8_t)MIDI_Route_Status();
+    vendor_ctl.Status[1] = (vendor_routes == USBD_VENDOR_REQ_SET_ROUTES) ?
+                           (uint8_t)HAL_BUSY : (uint8_t)CFG_Status();
+    USBD_CtlSendData(hpcd, vendor_ctl.Status, sizeof(vendor_ctl.Status));
+    return USBD_OK;
+
+  default:
+    return USBD_FAIL;
+  }
+}
+
+static void USBD_Vendor_EP0_RxReady(PCD_HandleTypeDef *hpcd)
+{
+  UNUSED(hpcd);
+
+  if (vendor_rx_req == USBD_VENDOR_REQ_SET_ROUTES)
+  {
+    /* Stored by the main loop */
+    vendor_routes = USBD_VENDOR_REQ_SET_ROUTES;
+    return;
+  }
+  vendor_param[vendor_set_id] = vendor_ctl.Param;
+}
+
+static void USBD_Vendor_DataIn(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  UNUSED(hpcd);
+
+  if (epnum == (VENDOR_EP_IN & 0x7FU))
+  {
+    vendor_tx_busy = 0;
+  }
+}
+
+/**
+  * @brief  Fill vendor_frame with the next stream frame, if one is due.
+  * @retval Transfer length in bytes, 0 if nothing to send
+  */
+static uint32_t USBD_Vendor_NextFrame(void)
+{
+  uint32_t mask = vendor_param[USBD_VENDOR_PARAM_STREAM_MASK];
+  uint32_t period = vendor_param[USBD_VENDOR_PARAM_STREAM_PERIOD];
+  uint32_t len = 0;
+
+  if (((mask & USBD_VENDOR_STREAM_TELEMETRY) != 0U) && (period != 0U) &&
+      ((HAL_GetTick() - vendor_last_tick) >= period))
+  {
+    vendor_last_tick = HAL_GetTick();
+    TELEM_Snapshot(&vendor_frame.u.Telem);
+    vendor_frame.Type = USBD_VENDOR_FRAME_TELEMETRY;
+    len = sizeof(TELEM_TypeDef);
+  }
+#if (TRACE_ENABLED == 1)
+  else if (((mask & USBD_VENDOR_STREAM_TRACE) != 0U) && (TRACE_Ring.Head != vendor_stream_cursor))
+  {
+    len = TRACE_Read(&vendor_stream_cursor, vendor_frame.u.Trace.Rec,
+                     USBD_VENDOR_TRACE_WORDS, &vendor_frame.u.Trace.Lost);
+    vendor_frame.Type = USBD_VENDOR_FRAME_TRACE;
+    len = 4U + len * 4U;
+  }
+#endif /* TRACE_ENABLED */
+  else
+  {
+    return 0;
+  }
+
+  vendor_frame.Seq = vendor_seq++;
+  vendor_frame.Len = (uint16_t)len;
+  len += 4U;
+
+  /* The host sees the end of a transfer at the first short packet */
+  if ((len & (VENDOR_EP_SIZE - 1U)) == 0U)
+  {
+    len += 4U;
+  }
+
+  return len;
+}
+
+/**
+  * @brief  Store SET_ROUTES rules and start APPLY_ROUTES rebuilds.
+  */
+static void USBD_Vendor_Routes(void)
+{
+  if (vendor_routes == USBD_VENDOR_REQ_SET_ROUTES)
+  {
+    /* A write still running takes the next pass */
+    if (CFG_Set(MIDI_ROUTE_CFG_KEY + vendor_routes_key, &vendor_routes_data,
+                vendor_routes_len) == HAL_BUSY)
+    {
+      return;
+    }
+  }
+  else
+  {
+    MIDI_Route_Apply();
+  }
+  vendor_routes = 0;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Send the next stream frame when the bulk IN endpoint is idle,
+  *         run a pending ROUTE_BENCH, SET_ROUTES or APPLY_ROUTES and restart
+  *         into the bootloader after ENTER_DFU. Call from the main loop.
+  * @retval None
+  */
+void USBD_Vendor_Poll(void)
+{
+  uint32_t primask;
+  uint32_t len;
+
+  /* Rules is written last: a reader that sees it non-zero sees the whole
+     result */
+  len = vendor_bench_rules;
+  if (len != 0U)
+  {
+    vendor_bench_rules = 0;
+    MIDI_Route_Bench(len, &vendor_bench);
+  }
+
+  if (vendor_routes != 0U)
+  {
+    USBD_Vendor_Routes();
+  }
+
+  /* Restart once the host has its status stage and flash is idle */
+  if ((vendor_dfu != 0U) && ((HAL_GetTick() - vendor_dfu_tick) >= VENDOR_DFU_DELAY) &&
+      (NVM_Busy() == 0U))
+  {
+    BOOT_EnterDfu();
+  }
+
+  if ((vendor_ready == 0U) || (vendor_tx_busy != 0U))
+  {
+    return;
+  }
+
+  /* Claim vendor_frame unless a control reply is still being sent from it */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (USBD_CtlSending() != 0U)
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+  vendor_tx_busy = 1;
+  __set_PRIMASK(primask);
+
+  len = USBD_Vendor_NextFrame();
+
+  __disable_irq();
+  if ((len != 0U) && (vendor_ready != 0U))
+  {
+    HAL_PCD_EP_Transmit(vendor_pcd, VENDOR_EP_IN, (uint8_t *)&vendor_frame, len);
+  }
+  else
+  {
+    vendor_tx_busy = 0;
+  }
+  __set_PRIMASK(primask);
+}
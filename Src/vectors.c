@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file    vectors.c
+  * @brief   Vector table in SRAM, remapped to address 0.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vectors.h"
+
+/* Private variables ---------------------------------------------------------*/
+extern const uint32_t g_pfnVectors[];   /* Startup code: the linked table */
+
+/* Placed at the very start of SRAM by the linker script */
+static __IO uint32_t vect_table[VECT_COUNT] __attribute__((section(".ram_vector")));
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Copy the vector table to SRAM and map SRAM at address 0. Call
+  *         first thing in main(), before any interrupt is enabled.
+  * @retval None
+  */
+void VECT_Relocate(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t i;
+
+  __disable_irq();
+  for (i = 0; i < VECT_COUNT; i++)
+  {
+    vect_table[i] = g_pfnVectors[i];
+  }
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+  __HAL_SYSCFG_REMAPMEMORY_SRAM();
+  __DSB();
+  __ISB();
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Point an exception or interrupt at another handler. Takes effect
+  *         from the next entry; the word write is atomic, so it is safe
+  *         from any context and with the interrupt enabled.
+  * @param  irq: IRQ number, negative for core exceptions
+  * @param  handler: new handler
+  * @retval Previous handler
+  */
+VECT_HandlerTypeDef VECT_Set(IRQn_Type irq, VECT_HandlerTypeDef handler)
+{
+  uint32_t idx = (uint32_t)((int32_t)irq + 16);
+  VECT_HandlerTypeDef prev = (VECT_HandlerTypeDef)vect_table[idx];
+
+  vect_table[idx] = (uint32_t)handler;
+  return prev;
+}
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Check that code in the .ramfunc section does not call out of it.
+
+Code in .ramfunc (Inc/ramfunc.h) has to keep running while the flash is
+erased or programmed, and a single call into .text stalls it on the flash.
+Disassembles .ramfunc and fails on every direct call whose target lies
+outside the section, or goes through a linker veneer (a long branch to
+flash). Calls through function pointers can not be followed and are not
+checked. Run by the build after linking:
+
+    check_ramfunc.py arm-none-eabi-objdump build/f1042-midi-interface.elf
+"""
+
+import re
+import subprocess
+import sys
+
+SECTION = ".ramfunc"
+CALL = re.compile(r"^\s*([0-9a-f]+):\s.*\tblx?\t([0-9a-f]+) <([^>]+)>")
+FUNC = re.compile(r"^([0-9a-f]+) <([^>]+)>:$")
+
+
+def section_range(objdump, elf):
+    out = subprocess.run([objdump, "-h", elf], check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 4 and fields[1] == SECTION:
+            start = int(fields[3], 16)
+            return start, start + int(fields[2], 16)
+    return None
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    objdump, elf = sys.argv[1:]
+    span = section_range(objdump, elf)
+    if span is None:
+        print("%s: no %s section" % (elf, SECTION))
+        return
+    out = subprocess.run([objdump, "-d", "-j", SECTION, elf], check=True,
+                         capture_output=True, text=True).stdout
+
+    func = "?"
+    bad = []
+    for line in out.splitlines():
+        m = FUNC.match(line)
+        if m:
+            func = m.group(2)
+            continue
+        m = CALL.match(line)
+        if not m:
+            continue
+        target = int(m.group(2), 16)
+        name = m.group(3).split("+")[0]
+        if not span[0] <= target < span[1] or "veneer" in name:
+            bad.append("%s calls %s" % (func, name))
+
+    if bad:
+        for b in sorted(set(bad)):
+            print("%s: %s" % (SECTION, b), file=sys.stderr)
+        sys.exit("%s: %d calls out of the section" % (SECTION, len(bad)))
+    print("%s: %d bytes, no calls out of the section" % (SECTION, span[1] - span[0]))
+
+
+if __name__ == "__main__":
+    main()
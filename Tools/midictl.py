@@ -0,0 +1,522 @@
+#!/usr/bin/env python3
+"""Talk to the vendor-specific USB interface of the F1042 MIDI interface.
+
+Uses EP0 vendor requests and the bulk stream endpoint described in
+Inc/usbd_vendor.h; the MIDI function is left alone, so this runs while a DAW
+has the ports open. Needs pyusb. On Windows the vendor interface must be
+bound to WinUSB (e.g. with Zadig) first.
+
+    midictl.py info
+    midictl.py telemetry [--reset] [--json]
+    midictl.py trace -o dump.bin [--stream] [--seconds N]
+    midictl.py param get stream_mask
+    midictl.py param set stream_period 50
+    midictl.py dfu
+    midictl.py route-bench [--max N]
+    midictl.py routes load rules.json
+    midictl.py routes clear
+
+Trace dumps are plain little-endian records and feed trace2perfetto.py.
+"dfu" restarts the device into its bootloader, ready for dfu-util.
+"route-bench" times the routing compiler and lookup on the device for
+1, 2, 4 ... N generated rules, then finds the rule count from which they no
+longer fit in the table rows.
+
+"routes load" stores routing rules in the device's configuration log and
+switches to them without interrupting MIDI traffic; "routes clear" goes back
+to the built-in rules. The file is a JSON list of rules:
+
+    [{"from": "port:0", "classes": ["note_on", "note_off"],
+      "channels": [1, 10], "to": ["host:0", "port:1"]}]
+
+"from" is "host:<cable>" or "port:<port>", "to" a list of those, "classes"
+names from CLASSES (default all) and "channels" a first and last channel,
+1 based (default all). A rule may also transform what it sends:
+
+    "transform": {"transpose": 12, "note_range": [36, 96],
+                  "velocity_curve": 4, "velocity_range": [20, 127]}
+
+every field optional; "velocity_curve" runs from -8 (hard) to 8 (soft).
+The other fields are "channel", 1 based, "cc_map", e.g. [1, 11] to renumber
+one controller, and "cc_range", e.g. [0, 100] to scale controller values.
+Transforms belong to a source and destination pair (Inc/midi_route.h).
+
+The device has room for few of them: each of channel, notes (transpose and
+note_range), velocities, cc_map and cc_range a transform changes takes a
+128 byte table, identical tables shared. A rule set may take XFORM_TABLES
+of them between all its transforms, one in the default build; the example
+above takes two, notes and velocities.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+import usb.core
+import usb.util
+
+VID = 0x1209
+PID = 0x0001
+ITF_VENDOR = 2
+EP_STREAM = 0x83
+
+# Keep in sync with Inc/usbd_vendor.h
+REQ_GET_INFO = 0x01
+REQ_GET_TELEMETRY = 0x02
+REQ_RESET_TELEMETRY = 0x03
+REQ_READ_TRACE = 0x04
+REQ_GET_PARAM = 0x05
+REQ_SET_PARAM = 0x06
+REQ_ENTER_DFU = 0x07
+REQ_ROUTE_BENCH = 0x08
+REQ_GET_ROUTE_BENCH = 0x09
+REQ_SET_ROUTES = 0x0A
+REQ_APPLY_ROUTES = 0x0B
+REQ_GET_ROUTE_STATUS = 0x0C
+ROUTE_BENCH_MAX = 1024
+
+# Keep in sync with Inc/midi_route.h, Inc/midi_xform.h and Inc/app_conf.h
+CLASSES = {"note_off": 1 << 0x08, "note_on": 1 << 0x09,
+           "poly_pressure": 1 << 0x0A, "control": 1 << 0x0B,
+           "program": 1 << 0x0C, "pressure": 1 << 0x0D,
+           "pitch_bend": 1 << 0x0E, "sysex": 1 << 0x10, "mtc": 1 << 0x11,
+           "song_position": 1 << 0x12, "song_select": 1 << 0x13,
+           "tune_request": 1 << 0x16, "clock": 1 << 0x18,
+           "start": 1 << 0x1A, "continue": 1 << 0x1B, "stop": 1 << 0x1C,
+           "active_sensing": 1 << 0x1E, "reset": 1 << 0x1F,
+           "channel": 0x00007F00, "system": 0xFFFF0000, "all": 0xFFFF7F00}
+ROUTE_FROM_PORT = 0x10
+ROUTE_RULE = struct.Struct("<BBHII")
+ROUTE_CFG_KEYS = 4
+ROUTE_CFG_RULES = 64 // ROUTE_RULE.size
+XFORM = struct.Struct("<bBBbBBBBBBBB")
+XFORM_KEEP = 0xFF
+XFORMS = 4
+XFORM_TABLES = 1
+HAL_STATUS = ("ok", "error", "busy", "timeout")
+
+PARAMS = {"stream_mask": 0, "stream_period": 1}
+STREAM_TRACE = 0x01
+STREAM_TELEMETRY = 0x02
+FRAME_TRACE = 0x01
+FRAME_TELEMETRY = 0x02
+TRACE_WORDS = 13
+
+BM_IN = 0xC1   # device to host, vendor, interface
+BM_OUT = 0x41  # host to device, vendor, interface
+
+DROP_CAUSES = ("queue_full", "parse", "framing")
+PATHS = ("usb_to_port", "port_to_usb")
+
+
+class Device:
+    def __init__(self):
+        self.dev = usb.core.find(idVendor=VID, idProduct=PID)
+        if self.dev is None:
+            sys.exit("device %04x:%04x not found" % (VID, PID))
+        self.info = self.get_info()
+
+    def ctrl_in(self, req, length, value=0):
+        return bytes(self.dev.ctrl_transfer(BM_IN, req, value, ITF_VENDOR, length))
+
+    def ctrl_out(self, req, data=None, value=0):
+        self.dev.ctrl_transfer(BM_OUT, req, value, ITF_VENDOR, data)
+
+    def ctrl_in_frame(self, req, length):
+        """ctrl_in for GET_TELEMETRY and READ_TRACE, which STALL while the
+        bulk stream sends a frame out of the same buffer."""
+        deadline = time.time() + 1.0
+        while True:
+            try:
+                return self.ctrl_in(req, length)
+            except usb.core.USBError:
+                if time.time() >= deadline:
+                    raise
+                time.sleep(0.001)
+
+    def get_info(self):
+        fields = struct.unpack("<HHBBHHHH", self.ctrl_in(REQ_GET_INFO, 14))
+        keys = ("protocol", "bcd_device", "ports", "trace_enabled",
+                "trace_ring_size", "telemetry_size", "latency_buckets",
+                "pma_free")
+        return dict(zip(keys, fields))
+
+    def telemetry(self):
+        return decode_telemetry(self.ctrl_in_frame(REQ_GET_TELEMETRY,
+                                                   self.info["telemetry_size"]),
+                                self.info)
+
+    def reset_telemetry(self):
+        self.ctrl_out(REQ_RESET_TELEMETRY)
+
+    def read_trace(self):
+        data = self.ctrl_in_frame(REQ_READ_TRACE, 4 + 4 * TRACE_WORDS)
+        return decode_trace(data)
+
+    def get_param(self, pid):
+        return struct.unpack("<I", self.ctrl_in(REQ_GET_PARAM, 4, pid))[0]
+
+    def set_param(self, pid, value):
+        self.ctrl_out(REQ_SET_PARAM, struct.pack("<I", value), pid)
+
+    def enter_dfu(self):
+        self.ctrl_out(REQ_ENTER_DFU)
+
+    def route_bench(self, rules, timeout=5.0):
+        """Run MIDI_Route_Bench() on the device, see Inc/midi_route.h."""
+        self.ctrl_out(REQ_ROUTE_BENCH, value=rules)
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            time.sleep(0.01)
+            try:
+                data = self.ctrl_in(REQ_GET_ROUTE_BENCH, 12)
+            except usb.core.USBTimeoutError:
+                continue
+            fields = struct.unpack("<HBBII", data)
+            if fields[0] != 0:
+                keys = ("rules", "rows", "status", "compile_us", "lookup_ns")
+                return dict(zip(keys, fields))
+        sys.exit("no route benchmark result for %d rules" % rules)
+
+    def route_status(self):
+        """(routes, config log) HAL status of the last update."""
+        return tuple(self.ctrl_in(REQ_GET_ROUTE_STATUS, 2))
+
+    def wait_routes(self, timeout=5.0):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            status = self.route_status()
+            if 2 not in status:
+                return status
+            time.sleep(0.01)
+        sys.exit("the device is still busy with the routes")
+
+    def set_routes(self, key, data):
+        """Store one configuration log key of rules, retrying while the
+        previous one is still being taken."""
+        deadline = time.time() + 5.0
+        while True:
+            try:
+                self.ctrl_out(REQ_SET_ROUTES, data or None, key)
+                return
+            except usb.core.USBError:
+                if time.time() >= deadline:
+                    raise
+                time.sleep(0.01)
+
+    def apply_routes(self):
+        self.ctrl_out(REQ_APPLY_ROUTES)
+
+    def frames(self, timeout_ms=500):
+        """Yield (type, seq, payload) from the bulk stream until interrupted."""
+        usb.util.claim_interface(self.dev, ITF_VENDOR)
+        try:
+            while True:
+                try:
+                    data = bytes(self.dev.read(EP_STREAM, 512, timeout_ms))
+                except usb.core.USBTimeoutError:
+                    yield None
+                    continue
+                ftype, seq, length = struct.unpack_from("<BBH", data)
+                yield ftype, seq, data[4:4 + length]
+        finally:
+            usb.util.release_interface(self.dev, ITF_VENDOR)
+
+
+def decode_trace(data):
+    lost = struct.unpack_from("<I", data)[0]
+    words = struct.unpack_from("<%dI" % ((len(data) - 4) // 4), data, 4)
+    return lost, words
+
+
+def decode_telemetry(data, info):
+    """Unpack a TELEM_TypeDef, see Inc/telemetry.h."""
+    (pma_overrun, bus_error, unrouted,
+     usb_in_hwm, out_pauses, suspends, resume_us_max,
+     remote_wakeups, idle_permille, wake_rate,
+     job_overruns) = struct.unpack_from("<IIIHHHHIHHI", data)
+    off = 32
+    ports = []
+    for _ in range(info["ports"]):
+        f = struct.unpack_from("<IIII3IHH", data, off)
+        off += 32
+        ports.append({"msg_in": f[0], "msg_out": f[1],
+                      "bytes_in": f[2], "bytes_out": f[3],
+                      "drop": dict(zip(DROP_CAUSES, f[4:7])),
+                      "out_queue_hwm": f[7], "in_queue_hwm": f[8]})
+    n = info["latency_buckets"]
+    latency = {}
+    for path in PATHS:
+        latency[path] = list(struct.unpack_from("<%dI" % n, data, off))
+        off += 4 * n
+    return {"pma_overrun": pma_overrun, "bus_error": bus_error,
+            "unrouted": unrouted, "usb_in_queue_hwm": usb_in_hwm,
+            "usb_out_pauses": out_pauses, "suspends": suspends,
+            "resume_us_max": resume_us_max, "remote_wakeups": remote_wakeups,
+            "idle_permille": idle_permille, "wake_rate": wake_rate,
+            "job_overruns": job_overruns,
+            "ports": ports, "latency_us_log2": latency}
+
+
+def print_telemetry(t):
+    print("usb: pma_overrun=%d bus_error=%d unrouted=%d in_queue_hwm=%d "
+          "out_pauses=%d"
+          % (t["pma_overrun"], t["bus_error"], t["unrouted"],
+             t["usb_in_queue_hwm"], t["usb_out_pauses"]))
+    print("power: suspends=%d resume_us_max=%d remote_wakeups=%d"
+          % (t["suspends"], t["resume_us_max"], t["remote_wakeups"]))
+    print("cpu: idle=%.1f%% wakes=%d/s job_overruns=%d"
+          % (t["idle_permille"] / 10.0, t["wake_rate"], t["job_overruns"]))
+    for i, p in enumerate(t["ports"]):
+        print("port %d: in %d msg/%d B, out %d msg/%d B, hwm in %d out %d"
+              % (i, p["msg_in"], p["bytes_in"], p["msg_out"], p["bytes_out"],
+                 p["in_queue_hwm"], p["out_queue_hwm"]))
+        print("        drops " + " ".join("%s=%d" % kv
+                                          for kv in p["drop"].items()))
+    for path, buckets in t["latency_us_log2"].items():
+        print("%s latency (bucket n counts [2^(n-1), 2^n) us):" % path)
+        print("    " + " ".join(str(b) for b in buckets))
+
+
+def cmd_info(dev, args):
+    for key, value in dev.info.items():
+        print("%-16s %s" % (key, value))
+
+
+def cmd_telemetry(dev, args):
+    t = dev.telemetry()
+    if args.json:
+        json.dump(t, sys.stdout, indent=2)
+        print()
+    else:
+        print_telemetry(t)
+    if args.reset:
+        dev.reset_telemetry()
+
+
+def cmd_trace(dev, args):
+    if not dev.info["trace_enabled"]:
+        print("warning: firmware built with TRACE_ENABLED 0", file=sys.stderr)
+    deadline = time.time() + args.seconds
+    total_lost = 0
+    count = 0
+    with open(args.output, "wb") as out:
+        if args.stream:
+            old_mask = dev.get_param(PARAMS["stream_mask"])
+            dev.set_param(PARAMS["stream_mask"], old_mask | STREAM_TRACE)
+            try:
+                for frame in dev.frames():
+                    if time.time() >= deadline:
+                        break
+                    if frame is None or frame[0] != FRAME_TRACE:
+                        continue
+                    lost, words = decode_trace(frame[2])
+                    total_lost += lost
+                    count += len(words)
+                    out.write(struct.pack("<%dI" % len(words), *words))
+            finally:
+                dev.set_param(PARAMS["stream_mask"], old_mask)
+        else:
+            while time.time() < deadline:
+                lost, words = dev.read_trace()
+                total_lost += lost
+                count += len(words)
+                out.write(struct.pack("<%dI" % len(words), *words))
+                if len(words) < TRACE_WORDS:
+                    time.sleep(0.001)
+    print("%d records, %d lost" % (count, total_lost), file=sys.stderr)
+
+
+def cmd_param(dev, args):
+    pid = PARAMS[args.name]
+    if args.action == "get":
+        print(dev.get_param(pid))
+    else:
+        dev.set_param(pid, int(args.value, 0))
+
+
+def cmd_dfu(dev, args):
+    dev.enter_dfu()
+    print("restarting into the bootloader; now run e.g.\n"
+          "  dfu-util -d %04x:%04x -D build/f1042-midi-interface.bin" % (VID, PID),
+          file=sys.stderr)
+
+
+def endpoint(name):
+    kind, _, num = name.partition(":")
+    if kind not in ("host", "port") or not num.isdigit():
+        sys.exit("bad endpoint %r, use host:<n> or port:<n>" % name)
+    return kind, int(num)
+
+
+def pack_xform(xform):
+    def pair(name, default, lo, hi):
+        a, b = xform.get(name, default)
+        if not lo <= a <= hi or not lo <= b <= hi:
+            sys.exit("bad %s %r" % (name, [a, b]))
+        return a, b
+
+    transpose = xform.get("transpose", 0)
+    curve = xform.get("velocity_curve", 0)
+    if not -127 <= transpose <= 127 or not -8 <= curve <= 8:
+        sys.exit("bad transform %r" % xform)
+    channel = xform.get("channel")
+    if channel is not None and not 1 <= channel <= 16:
+        sys.exit("bad channel %r" % channel)
+    cc_from, cc_to = pair("cc_map", [XFORM_KEEP, 0], 0, 255)
+    return XFORM.pack(transpose, *pair("note_range", [0, 127], 0, 127), curve,
+                      *pair("velocity_range", [1, 127], 1, 127),
+                      XFORM_KEEP if channel is None else channel - 1,
+                      cc_from, cc_to & 0x7F, *pair("cc_range", [0, 127], 0, 127), 0)
+
+
+def xform_tables(data):
+    """Tables a packed transform takes besides the identity, by contents."""
+    (transpose, note_lo, note_hi, curve, vel_lo, vel_hi, channel,
+     cc_from, cc_to, cc_lo, cc_hi, _) = XFORM.unpack(data)
+    tables = set()
+    if channel != XFORM_KEEP:
+        tables.add(("channel", channel))
+    if (transpose, note_lo, note_hi) != (0, 0, 127):
+        tables.add(("notes", transpose, note_lo, note_hi))
+    if (curve, vel_lo, vel_hi) != (0, 1, 127):
+        tables.add(("velocities", curve, vel_lo, vel_hi))
+    if cc_from < 128 and cc_from != cc_to:
+        tables.add(("cc_map", cc_from, cc_to))
+    if (cc_lo, cc_hi) != (0, 127):
+        tables.add(("cc_range", cc_lo, cc_hi))
+    return tables
+
+
+def pack_rule(rule, xforms):
+    kind, num = endpoint(rule["from"])
+    src = num | (ROUTE_FROM_PORT if kind == "port" else 0)
+    classes = 0
+    for name in rule.get("classes", ["all"]):
+        if name not in CLASSES:
+            sys.exit("unknown message class %r" % name)
+        classes |= CLASSES[name]
+    lo, hi = rule.get("channels", [1, 16])
+    if not 1 <= lo <= hi <= 16:
+        sys.exit("bad channel range %d..%d" % (lo, hi))
+    channels = ((0xFFFF << (lo - 1)) & (0xFFFF >> (16 - hi))) & 0xFFFF
+    dst = 0
+    for name in rule["to"]:
+        kind, num = endpoint(name)
+        dst |= 1 << (num + (16 if kind == "host" else 0))
+    xform = 0
+    if "transform" in rule:
+        data = pack_xform(rule["transform"])
+        if data not in xforms:
+            xforms.append(data)
+        xform = xforms.index(data) + 1
+    return ROUTE_RULE.pack(src, xform, channels, classes, dst)
+
+
+def cmd_routes(dev, args):
+    # Rule keys, then the transforms key
+    records = [b""] * (ROUTE_CFG_KEYS + 1)
+    if args.action == "load":
+        xforms = []
+        with open(args.file) as f:
+            rules = [pack_rule(r, xforms) for r in json.load(f)]
+        if len(rules) > ROUTE_CFG_KEYS * ROUTE_CFG_RULES:
+            sys.exit("at most %d rules" % (ROUTE_CFG_KEYS * ROUTE_CFG_RULES))
+        if len(xforms) > XFORMS:
+            sys.exit("at most %d different transforms" % XFORMS)
+        tables = set().union(*map(xform_tables, xforms))
+        if len(tables) > XFORM_TABLES:
+            sys.exit("the transforms take %d tables, at most %d"
+                     % (len(tables), XFORM_TABLES))
+        for i in range(ROUTE_CFG_KEYS):
+            records[i] = b"".join(rules[i * ROUTE_CFG_RULES:(i + 1) * ROUTE_CFG_RULES])
+        records[ROUTE_CFG_KEYS] = b"".join(xforms)
+    for key, data in enumerate(records):
+        dev.set_routes(key, data)
+        if dev.wait_routes()[1] != 0:
+            sys.exit("storing the rules failed")
+    dev.apply_routes()
+    routes, _ = dev.wait_routes()
+    if routes != 0:
+        sys.exit("the rules need too many table rows or transform tables, "
+                 "the old ones stay: %s"
+                 % HAL_STATUS[routes])
+
+
+def cmd_route_bench(dev, args):
+    print("%6s %5s %7s %11s %10s" % ("rules", "rows", "status", "compile_us", "lookup_ns"))
+    fits, fails, rows = 0, None, 0
+    rules = 1
+    while rules <= args.max:
+        r = dev.route_bench(rules)
+        print("%6d %5d %7s %11d %10d"
+              % (r["rules"], r["rows"], HAL_STATUS[r["status"]],
+                 r["compile_us"], r["lookup_ns"]))
+        if r["status"] == 0:
+            fits, rows = rules, r["rows"]
+        elif fails is None:
+            fails, rows = rules, r["rows"]
+        rules *= 2
+    if fails is None:
+        print("row limit: not reached, %d rules need %d rows" % (fits, rows))
+        return
+    # The failing compile reports the whole table, MIDI_ROUTE_ROWS
+    while fails - fits > 1:
+        mid = (fits + fails) // 2
+        if dev.route_bench(mid)["status"] == 0:
+            fits = mid
+        else:
+            fails = mid
+    print("row limit: %d rows, reached at %d generated rules" % (rows, fails))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    sub.add_parser("info", help="firmware build information")
+
+    p = sub.add_parser("telemetry", help="read the telemetry counters")
+    p.add_argument("--reset", action="store_true",
+                   help="clear the counters after reading")
+    p.add_argument("--json", action="store_true")
+
+    p = sub.add_parser("trace", help="capture the trace ring to a file")
+    p.add_argument("-o", "--output", required=True)
+    p.add_argument("--stream", action="store_true",
+                   help="use the bulk endpoint instead of EP0 polling")
+    p.add_argument("--seconds", type=float, default=5.0)
+
+    p = sub.add_parser("param", help="get or set a runtime parameter")
+    p.add_argument("action", choices=("get", "set"))
+    p.add_argument("name", choices=sorted(PARAMS))
+    p.add_argument("value", nargs="?")
+
+    sub.add_parser("dfu", help="restart into the DFU bootloader")
+
+    p = sub.add_parser("route-bench", help="time the MIDI routing tables")
+    p.add_argument("--max", type=int, default=256,
+                   help="largest rule count, up to %d" % ROUTE_BENCH_MAX)
+
+    p = sub.add_parser("routes", help="replace or reset the routing rules")
+    p.add_argument("action", choices=("load", "clear"))
+    p.add_argument("file", nargs="?", help="JSON rule list for load")
+
+    args = parser.parse_args()
+    if args.cmd == "param" and args.action == "set" and args.value is None:
+        parser.error("param set needs a value")
+    if args.cmd == "routes" and args.action == "load" and args.file is None:
+        parser.error("routes load needs a file")
+    if args.cmd == "route-bench" and not 1 <= args.max <= ROUTE_BENCH_MAX:
+        parser.error("--max must be 1..%d" % ROUTE_BENCH_MAX)
+
+    dev = Device()
+    {"info": cmd_info, "telemetry": cmd_telemetry,
+     "trace": cmd_trace, "param": cmd_param, "dfu": cmd_dfu,
+     "route-bench": cmd_route_bench, "routes": cmd_routes}[args.cmd](dev, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+"""Update the F1042 MIDI interface firmware over MIDI System Exclusive.
+
+For hosts that see the device as a class compliant MIDI interface only and
+cannot run DFU tools. The protocol is described in Inc/sysex_update.h. Needs
+python-rtmidi.
+
+    sysex_update.py build/f1042-midi-interface.bin
+    sysex_update.py --list
+    sysex_update.py --port "Updater" image.bin
+
+The application is asked to restart into its bootloader through its
+"System" port, unless the "Updater" port of the bootloader is already
+there. At the end the achieved rate is printed against the raw USB-MIDI
+bulk limit of a full-speed device.
+"""
+
+import argparse
+import queue
+import struct
+import sys
+import time
+
+import rtmidi
+
+# Keep in sync with Inc/sysex_update.h
+MANUFACTURER = 0x7D
+DEVICE = 0x46
+CMD_ENTER = 0x01
+CMD_BEGIN = 0x02
+CMD_DATA = 0x03
+CMD_END = 0x04
+CMD_ACK = 0x10
+
+OK = 0x00
+BUSY = 0x01
+DONE = 0x7F
+STATUS = {0x00: "ok", 0x01: "busy (DFU download running)", 0x02: "bad image size",
+          0x03: "unexpected block", 0x04: "block CRC error", 0x05: "image CRC mismatch",
+          0x06: "flash error", 0x7F: "done"}
+
+BLOCK = 256
+APP_MAX = 0x77F0 - 0x2000          # Inc/boot.h, BOOT_APP_MAX
+SYSTEM_PORT = "System"
+UPDATER_PORT = "Updater"
+
+# Full-speed bulk: at most 19 packets of 64 bytes per 1 ms frame; a 4-byte
+# USB-MIDI event packet carries 3 SysEx bytes
+USB_BULK_LIMIT = 19 * 64 * 1000
+SYSEX_LIMIT = USB_BULK_LIMIT * 3 // 4
+
+
+def groups(value, count):
+    return [(value >> (7 * i)) & 0x7F for i in range(count)]
+
+
+def pack7(data):
+    out = []
+    for i in range(0, len(data), 7):
+        chunk = data[i:i + 7]
+        out.append(sum(1 << k for k, b in enumerate(chunk) if b & 0x80))
+        out.extend(b & 0x7F for b in chunk)
+    return out
+
+
+def message(cmd, payload=()):
+    return [0xF0, MANUFACTURER, DEVICE, cmd] + list(payload) + [0xF7]
+
+
+def data_message(image, seq):
+    block = image[seq * BLOCK:(seq + 1) * BLOCK]
+    payload = groups(seq, 2) + pack7(block) + groups(crc32(block), 5)
+    return message(CMD_DATA, payload)
+
+
+def crc32(data):
+    """CRC-32 of the STM32 CRC unit (Inc/crc32.h): MSB first, whole
+    little-endian words, the data padded with 0xFF."""
+    padded = data + b"\xff" * (-len(data) % 4)
+    crc = 0xFFFFFFFF
+    for (word,) in struct.iter_unpack("<I", padded):
+        crc ^= word
+        for _ in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def usb_bytes(msg):
+    """Bytes of USB-MIDI event packets the host driver makes of a message."""
+    return 4 * ((len(msg) + 2) // 3)
+
+
+def find_port(api, name):
+    for i, port in enumerate(api.get_ports()):
+        if name.lower() in port.lower():
+            return i
+    return None
+
+
+class Link:
+    def __init__(self, name):
+        self.out = rtmidi.MidiOut()
+        self.inp = rtmidi.MidiIn()
+        o = find_port(self.out, name)
+        i = find_port(self.inp, name)
+        if o is None or i is None:
+            raise LookupError(name)
+        self.out.open_port(o)
+        self.inp.open_port(i)
+        self.inp.ignore_types(sysex=False, timing=True, active_sense=True)
+        self.acks = queue.Queue()
+        self.inp.set_callback(self._on_message)
+
+    def _on_message(self, event, data=None):
+        msg = event[0]
+        if (len(msg) == 10 and msg[:4] == [0xF0, MANUFACTURER, DEVICE, CMD_ACK]):
+            nxt = msg[4] | (msg[5] << 7)
+            limit = msg[6] | (msg[7] << 7)
+            self.acks.put((nxt, limit, msg[8]))
+
+    def send(self, msg):
+        self.out.send_message(msg)
+
+    def ack(self, timeout):
+        try:
+            return self.acks.get(timeout=timeout)
+        except queue.Empty:
+            return None
+
+    def close(self):
+        self.inp.close_port()
+        self.out.close_port()
+
+
+def open_updater(args):
+    try:
+        return Link(args.port)
+    except LookupError:
+        pass
+    try:
+        system = Link(SYSTEM_PORT)
+    except LookupError:
+        sys.exit("neither an '%s' nor a '%s' port found, try --list" % (args.port, SYSTEM_PORT))
+    print("restarting into the bootloader")
+    system.send(message(CMD_ENTER))
+    system.close()
+    deadline = time.monotonic() + args.enum_timeout
+    while time.monotonic() < deadline:
+        time.sleep(0.5)
+        try:
+            return Link(args.port)
+        except LookupError:
+            continue
+    sys.exit("the '%s' port did not appear" % args.port)
+
+
+def begin(link, size):
+    for _ in range(20):
+        link.send(message(CMD_BEGIN, groups(size, 3)))
+        reply = link.ack(1.0)
+        if reply is None:
+            continue
+        if reply[2] == OK:
+            return reply[1]
+        if reply[2] != BUSY:
+            sys.exit("BEGIN refused: %s" % STATUS.get(reply[2], reply[2]))
+        time.sleep(0.1)
+    sys.exit("no answer to BEGIN")
+
+
+def update(link, image, args):
+    blocks = (len(image) + BLOCK - 1) // BLOCK
+    messages = [data_message(image, n) for n in range(blocks)]
+    limit = begin(link, len(image))
+
+    start = time.monotonic()
+    acked = sent = 0
+    wire = usb = rewinds = 0
+    last_progress = start
+    while acked < blocks:
+        while sent < min(limit, blocks):
+            link.send(messages[sent])
+            wire += len(messages[sent])
+            usb += usb_bytes(messages[sent])
+            sent += 1
+        reply = link.ack(args.timeout)
+        if reply is None:
+            # Lost or ignored: go back to the last acknowledged block
+            if time.monotonic() - last_progress > 10 * args.timeout:
+                sys.exit("device stopped answering at block %d" % acked)
+            sent = acked
+            rewinds += 1
+            continue
+        nxt, limit, status = reply
+        if nxt > acked:
+            acked = nxt
+            last_progress = time.monotonic()
+        if status != OK:
+            if status not in (0x03, 0x04):
+                sys.exit("update failed: %s" % STATUS.get(status, status))
+            sent = nxt
+            rewinds += 1
+        if not args.quiet:
+            print("\r%5.1f %%" % (100.0 * acked / blocks), end="", flush=True)
+
+    link.send(message(CMD_END, groups(crc32(image), 5)))
+    while True:
+        reply = link.ack(5.0)
+        if reply is None:
+            sys.exit("no answer to END")
+        if reply[2] != OK:
+            break
+    elapsed = time.monotonic() - start
+    if not args.quiet:
+        print()
+    if reply[2] != DONE:
+        sys.exit("update failed: %s" % STATUS.get(reply[2], reply[2]))
+
+    print("%d bytes in %.2f s, %d rewinds" % (len(image), elapsed, rewinds))
+    print("image   %8.0f B/s" % (len(image) / elapsed))
+    print("SysEx   %8.0f B/s  %5.2f %% of %d B/s" % (wire / elapsed, 100.0 * wire / elapsed / SYSEX_LIMIT, SYSEX_LIMIT))
+    print("USB     %8.0f B/s  %5.2f %% of %d B/s (raw bulk limit)" % (usb / elapsed, 100.0 * usb / elapsed / USB_BULK_LIMIT, USB_BULK_LIMIT))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("image", nargs="?", help="application image (.bin)")
+    parser.add_argument("--list", action="store_true", help="list MIDI ports")
+    parser.add_argument("--port", default=UPDATER_PORT, help="bootloader port name")
+    parser.add_argument("--timeout", type=float, default=0.5, help="seconds without an ACK before going back")
+    parser.add_argument("--enum-timeout", type=float, default=10.0, help="seconds to wait for the bootloader")
+    parser.add_argument("--quiet", action="store_true")
+    args = parser.parse_args()
+
+    if args.list:
+        for port in rtmidi.MidiOut().get_ports():
+            print(port)
+        return
+    if args.image is None:
+        parser.error("no image given")
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not 8 <= len(image) <= APP_MAX:
+        sys.exit("image size %d out of range (8..%d)" % (len(image), APP_MAX))
+
+    link = open_updater(args)
+    try:
+        update(link, image, args)
+    finally:
+        link.close()
+
+
+if __name__ == "__main__":
+    main()
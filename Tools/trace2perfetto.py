@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Convert a firmware trace dump into Chrome Trace Event JSON.
+
+The dump is the raw content of TRACE_Ring as returned by TRACE_Read(): a
+sequence of little-endian 32-bit words laid out as described in Inc/trace.h.
+The output loads directly into https://ui.perfetto.dev or chrome://tracing.
+
+Every source id gets its own track. Handler ids produce duration slices from
+the enter/exit pairs, point event ids (queue operations, MIDI traffic)
+produce instant events.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+EXIT_FLAG = 0x80000000
+ID_POS = 27
+TICK_POS = 16
+TICK_MASK = 0x7FF
+MARK_BASE = 8
+
+# Keep in sync with TRACE_ID_xxx in Inc/trace.h
+NAMES = {
+    0: "USB",
+    1: "EXTI4_15",
+    2: "TIM1",
+    3: "DMA",
+    4: "USART",
+    5: "FLASH",
+    8: "queue put",
+    9: "queue get",
+    10: "queue drop",
+    11: "MIDI rx",
+    12: "MIDI tx",
+}
+
+
+def decode(words, load, tick_us):
+    """Yield (timestamp_us, source_id, is_exit) with a monotonic time base."""
+    period = load + 1
+    ms = None
+    last_tick = 0
+    last_ts = 0.0
+    for word in words:
+        source = (word >> ID_POS) & 0xF
+        tick = (word >> TICK_POS) & TICK_MASK
+        val = word & 0xFFFF
+        if ms is None:
+            ms = tick
+        else:
+            ms += (tick - last_tick) & TICK_MASK
+        last_tick = tick
+        ts = (ms + (period - 1 - val) / float(period)) * tick_us
+        # SysTick may reload between the tick and VAL reads inside a probe;
+        # such a record lands one tick early, put it back in order.
+        if ts < last_ts and last_ts - ts > tick_us / 2:
+            ts += tick_us
+        last_ts = ts
+        yield ts, source, bool(word & EXIT_FLAG)
+
+
+def to_events(records, pid):
+    events = []
+    seen = set()
+    for ts, source, is_exit in records:
+        name = NAMES.get(source, "id%d" % source)
+        if source not in seen:
+            seen.add(source)
+            events.append({"ph": "M", "pid": pid, "tid": source,
+                           "name": "thread_name", "args": {"name": name}})
+            events.append({"ph": "M", "pid": pid, "tid": source,
+                           "name": "thread_sort_index",
+                           "args": {"sort_index": source}})
+        if source >= MARK_BASE:
+            events.append({"ph": "i", "s": "t", "pid": pid, "tid": source,
+                           "ts": ts, "name": name})
+        else:
+            events.append({"ph": "E" if is_exit else "B", "pid": pid,
+                           "tid": source, "ts": ts, "name": name})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="binary trace dump, '-' for stdin")
+    parser.add_argument("-o", "--output", default="-",
+                        help="JSON output file, '-' for stdout")
+    parser.add_argument("--load", type=int, default=47999,
+                        help="SysTick->LOAD value (default: 48 MHz / 1 kHz)")
+    parser.add_argument("--tick-us", type=float, default=1000.0,
+                        help="HAL tick period in microseconds")
+    args = parser.parse_args()
+
+    if args.dump == "-":
+        raw = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, "rb") as f:
+            raw = f.read()
+    raw = raw[:len(raw) & ~3]
+    words = struct.unpack("<%dI" % (len(raw) // 4), raw)
+
+    trace = {
+        "displayTimeUnit": "ns",
+        "traceEvents": [{"ph": "M", "pid": 1, "name": "process_name",
+                         "args": {"name": "f1042-midi-interface"}}]
+        + to_events(decode(words, args.load, args.tick_us), 1),
+    }
+
+    if args.output == "-":
+        json.dump(trace, sys.stdout, indent=1)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(trace, f, indent=1)
+
+
+if __name__ == "__main__":
+    main()
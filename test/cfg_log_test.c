@@ -0,0 +1,237 @@
+/**
+  ******************************************************************************
+  * @file    cfg_log_test.c
+  * @brief   Host test of the configuration log across power cuts.
+  *
+  *          The two CONFIG pages are simulated in RAM behind the flash
+  *          writer's interface (nvm.h). Random keys get random values, and
+  *          a quarter of the writes lose power at a random halfword program
+  *          or page erase: the halfword is left with only some of its bits
+  *          cleared, the page with only some of its bits set. After every
+  *          cut the log is reopened with CFG_Init(), and each key must hold
+  *          its last completed value, or the interrupted one for the key
+  *          being written. Checks use the CRC32_SOFTWARE fallback.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cfg_log.h"
+#include "nvm.h"
+#include "pt.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_HWORDS           FLASH_PAGE_SIZE   /* Two pages of halfwords */
+#define TEST_ITERATIONS       200000L
+
+/* Private variables ---------------------------------------------------------*/
+uint16_t _scfg[TEST_HWORDS];      /* Stands in for the linker script symbol */
+
+static long test_ops;
+static long test_cut_at = -1;     /* Operation that loses power, -1 for none */
+static jmp_buf test_cut;
+static HAL_StatusTypeDef test_nvm_status = HAL_OK;
+static PT_JobTypeDef *test_job;
+
+static uint8_t test_value[CFG_KEY_COUNT][CFG_VALUE_MAX];
+static uint32_t test_len[CFG_KEY_COUNT];
+
+/* Stubs ---------------------------------------------------------------------*/
+
+void PT_Start(PT_JobTypeDef *job)
+{
+  job->Lc = 0;
+  test_job = job;
+}
+
+uint32_t PT_Running(const PT_JobTypeDef *job)
+{
+  (void)job;
+  return 0U;
+}
+
+uint32_t NVM_Busy(void)
+{
+  return 0U;
+}
+
+HAL_StatusTypeDef NVM_Status(void)
+{
+  return test_nvm_status;
+}
+
+static uint16_t *Test_Flash(uint32_t addr, uint32_t n)
+{
+  uint16_t *p = (uint16_t *)(uintptr_t)addr;
+
+  if ((p < _scfg) || ((p + n) > &_scfg[TEST_HWORDS]))
+  {
+    printf("access outside CONFIG at %08lx\n", (unsigned long)addr);
+    exit(1);
+  }
+  return p;
+}
+
+static void Test_Step(void)
+{
+  if (test_ops++ == test_cut_at)
+  {
+    test_cut_at = -1;
+    longjmp(test_cut, 1);
+  }
+}
+
+HAL_StatusTypeDef NVM_Program(uint32_t addr, const uint16_t *src, uint32_t n)
+{
+  uint16_t *p = Test_Flash(addr, n);
+  uint32_t i;
+
+  test_nvm_status = HAL_OK;
+  for (i = 0; i < n; i++)
+  {
+    if (p[i] != 0xFFFFU)
+    {
+      /* PGERR: programming a halfword that is not blank */
+      test_nvm_status = HAL_ERROR;
+      return HAL_OK;
+    }
+    if (test_ops == test_cut_at)
+    {
+      p[i] = (uint16_t)(src[i] | rand());
+    }
+    Test_Step();
+    p[i] = src[i];
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef NVM_Erase(uint32_t addr)
+{
+  uint16_t *p = Test_Flash(addr, FLASH_PAGE_SIZE / 2U);
+  uint32_t i;
+
+  if (test_ops == test_cut_at)
+  {
+    for (i = 0; i < (FLASH_PAGE_SIZE / 2U); i++)
+    {
+      p[i] |= (uint16_t)rand();
+    }
+  }
+  Test_Step();
+  memset(p, 0xFF, FLASH_PAGE_SIZE);
+  return HAL_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  CFG_Set() with the write job run to the end.
+  */
+static HAL_StatusTypeDef Test_Set(uint32_t key, const uint8_t *v, uint32_t len)
+{
+  HAL_StatusTypeDef status;
+
+  test_job = NULL;
+  status = CFG_Set(key, v, len);
+  if ((status != HAL_OK) || (test_job == NULL))
+  {
+    return status;
+  }
+  while (test_job->Run(test_job) != PT_ENDED)
+  {
+  }
+  return CFG_Status();
+}
+
+/**
+  * @brief  Compare every key with the model. The key that was being written
+  *         may hold either value; the model follows what it holds.
+  * @retval Number of keys that hold neither
+  */
+static long Test_Check(int32_t key, const uint8_t *v, uint32_t len)
+{
+  const uint8_t *got;
+  uint32_t got_len;
+  long bad = 0;
+  int32_t k;
+
+  for (k = 0; k < CFG_KEY_COUNT; k++)
+  {
+    got = CFG_Get(k, &got_len);
+    if (got == NULL)
+    {
+      got_len = 0;
+    }
+    if ((got_len == test_len[k]) && ((got_len == 0U) || (memcmp(got, test_value[k], got_len) == 0)))
+    {
+      continue;
+    }
+    if ((k == key) && (got_len == len) && ((len == 0U) || (memcmp(got, v, len) == 0)))
+    {
+      memcpy(test_value[k], v, len);
+      test_len[k] = len;
+      continue;
+    }
+    printf("key %ld lost its value\n", (long)k);
+    bad++;
+  }
+  return bad;
+}
+
+int main(void)
+{
+  uint8_t v[CFG_VALUE_MAX];
+  long bad = 0;
+  long cuts = 0;
+  long i;
+  uint32_t key;
+  uint32_t len;
+  uint32_t n;
+
+  srand(1);
+  memset(_scfg, 0xFF, sizeof(_scfg));
+  CFG_Init();
+  for (i = 0; i < TEST_ITERATIONS; i++)
+  {
+    key = (uint32_t)rand() % CFG_KEY_COUNT;
+    len = ((rand() % 10) == 0) ? 0U : ((uint32_t)rand() % (CFG_VALUE_MAX + 1U));
+    for (n = 0; n < len; n++)
+    {
+      v[n] = (uint8_t)rand();
+    }
+    test_cut_at = ((rand() % 4) == 0) ? (test_ops + (rand() % 80)) : -1;
+
+    if (setjmp(test_cut) == 0)
+    {
+      if (Test_Set(key, v, len) != HAL_OK)
+      {
+        printf("write %ld failed\n", i);
+        bad++;
+      }
+      else
+      {
+        memcpy(test_value[key], v, len);
+        test_len[key] = len;
+      }
+      test_cut_at = -1;
+      if ((rand() % 50) == 0)
+      {
+        CFG_Init();
+        bad += Test_Check(-1, NULL, 0);
+      }
+    }
+    else
+    {
+      cuts++;
+      CFG_Init();
+      bad += Test_Check((int32_t)key, v, len);
+    }
+  }
+  CFG_Init();
+  bad += Test_Check(-1, NULL, 0);
+
+  printf("%ld writes, %ld power cuts, %ld lost values\n", i, cuts, bad);
+  return (bad != 0) ? 1 : 0;
+}